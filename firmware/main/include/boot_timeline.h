@@ -0,0 +1,64 @@
+#ifndef __BOOT_TIMELINE_H__
+#define __BOOT_TIMELINE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/*
+ * Boot milestones. Each one is an event-group bit that boot tasks wait on
+ * to express their dependencies, and a timestamp for the boot timeline.
+ * Times are microseconds since the app started (bootloader not included).
+ */
+typedef enum
+{
+    BOOT_EV_APP_START = 0,
+    BOOT_EV_STORAGE_READY,      // Log storage mounted
+    BOOT_EV_NET_UP,             // TCP/IP stack and default event loop ready
+    BOOT_EV_WIFI_CONNECTED,     // Associated and got an IP address
+    BOOT_EV_USB_HOST_READY,     // USB host library installed
+    BOOT_EV_DEVICE_READY,       // USB device enumerated
+    BOOT_EV_TCP_LISTENING,      // USB/IP port accepting connections
+    BOOT_EV_HTTP_READY,
+    BOOT_EV_ATTACHABLE,         // Listening with a device enumerated
+    BOOT_EV_COUNT
+} boot_event_t;
+
+#define BOOT_BIT(ev) ((EventBits_t)1 << (ev))
+
+/**
+ * @brief Create the event group and stamp BOOT_EV_APP_START
+ */
+void boot_timeline_init(void);
+
+/**
+ * @brief Stamp a milestone and release tasks waiting for it
+ * 
+ * Only the first call per milestone is recorded. BOOT_EV_ATTACHABLE is
+ * marked automatically once its prerequisites are in.
+ */
+void boot_timeline_mark(boot_event_t ev);
+
+/**
+ * @brief Block until all milestones in bits have been reached
+ * 
+ * @param bits BOOT_BIT() values OR-ed together
+ * @param timeout Ticks to wait
+ * @return true if all were reached
+ */
+bool boot_timeline_wait(EventBits_t bits, TickType_t timeout);
+
+/**
+ * @brief Time a milestone was reached
+ * 
+ * @return int64_t Microseconds since app start, -1 if not reached yet
+ */
+int64_t boot_timeline_get(boot_event_t ev);
+
+/**
+ * @brief Milestone name for reports
+ */
+const char *boot_timeline_name(boot_event_t ev);
+
+#endif // __BOOT_TIMELINE_H__
@@ -0,0 +1,87 @@
+#ifndef __BOT_CACHE_H__
+#define __BOT_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "usb/usb_host.h"
+#include "usbip_codec.h"
+
+/*
+ * Read-ahead cache for USB mass storage (Bulk-Only Transport).
+ *
+ * The bulk URBs of a BOT interface are watched for CBWs. Once the host
+ * reads sequentially, the device itself issues READ(10) for the sectors
+ * that follow into a window of CONFIG_BOT_CACHE_SIZE bytes. A later
+ * READ(10) that lies inside the window is answered locally: its CBW, data
+ * and CSW URBs complete without touching the device. Every other command
+ * goes to the device; one that can change the medium empties the window,
+ * so writes are only ever acknowledged by the device itself.
+ */
+
+typedef struct
+{
+    bool active;                // A BOT interface is attached and the cache is usable
+    uint32_t block_size;        // From READ CAPACITY(10), 0 until seen
+    uint32_t last_lba;
+    uint32_t window_lba;        // First sector held
+    uint32_t window_count;      // Sectors held, 0 when empty
+    uint32_t hits;              // READs answered locally
+    uint32_t misses;            // READs passed to the device
+    uint32_t prefetches;
+    uint32_t prefetch_sectors;
+    uint32_t prefetch_errors;
+    uint32_t invalidations;
+    uint64_t bytes_served;
+} bot_cache_stats_t;
+
+#ifdef CONFIG_ENABLE_BOT_CACHE
+
+/**
+ * @brief Look for a Bulk-Only mass storage interface on a new device
+ *
+ * Call after its interfaces are claimed.
+ *
+ * @param dev Device handle
+ * @param config Active configuration descriptor
+ */
+void bot_cache_attach(usb_device_handle_t dev, const usb_config_desc_t *config);
+
+/**
+ * @brief Drop the cache and its transfers; the device is closed
+ */
+void bot_cache_detach(void);
+
+/**
+ * @brief Offer a CMD_SUBMIT to the cache before it goes to the device
+ *
+ * May block until a read-ahead in progress has finished.
+ *
+ * @param cmd CMD_SUBMIT from the client
+ * @param data Its OUT data; on return the IN data of a local answer
+ * @param ret RET_SUBMIT prepared for it
+ * @return true if answered locally; ret holds status and length, data the data
+ */
+bool bot_cache_submit(const usbip_submit_desc_t *cmd, uint8_t *data, usbip_ret_desc_t *ret);
+
+/**
+ * @brief Watch a bulk transfer completion of a passed-through URB
+ */
+void bot_cache_complete(const usb_transfer_t *transfer);
+
+/**
+ * @brief Copy cache state and counters
+ */
+void bot_cache_get_stats(bot_cache_stats_t *out);
+
+#else
+
+static inline void bot_cache_attach(usb_device_handle_t dev, const usb_config_desc_t *config) {}
+static inline void bot_cache_detach(void) {}
+static inline bool bot_cache_submit(const usbip_submit_desc_t *cmd, uint8_t *data, usbip_ret_desc_t *ret) { return false; }
+static inline void bot_cache_complete(const usb_transfer_t *transfer) {}
+
+#endif // CONFIG_ENABLE_BOT_CACHE
+
+#endif // __BOT_CACHE_H__
@@ -0,0 +1,98 @@
+#ifndef __FLIGHT_REC_H__
+#define __FLIGHT_REC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Crash flight recorder.
+ *
+ * The last CONFIG_FLIGHT_REC_ENTRIES URB and state events live in RTC memory
+ * that survives a panic or watchdog reset. After an abnormal reset the ring
+ * from the previous run is dumped into the log and kept for GET /crash.
+ */
+
+typedef enum
+{
+    FLIGHT_EV_URB_RECV = 0,     // CMD_SUBMIT read from the socket
+    FLIGHT_EV_URB_SUBMIT,       // Handed to the USB host library, arg = esp_err_t
+    FLIGHT_EV_URB_COMPLETE,     // Transfer callback, arg = usb_transfer_status_t
+    FLIGHT_EV_URB_SENT,         // RET_SUBMIT sent, arg = bytes or -1
+    FLIGHT_EV_URB_UNLINK,       // CMD_UNLINK read from the socket
+    FLIGHT_EV_CLIENT_CONNECT,
+    FLIGHT_EV_CLIENT_DISCONNECT,
+    FLIGHT_EV_DEV_CONNECT,      // arg = device address
+    FLIGHT_EV_DEV_GONE,
+    FLIGHT_EV_COUNT
+} flight_event_type_t;
+
+typedef struct
+{
+    uint32_t index;             // Ring position + 1, written last to detect torn entries
+    uint32_t ts_ms;             // Milliseconds since boot
+    uint32_t seqnum;
+    int32_t arg;
+    uint32_t heap_free;
+    uint8_t type;
+    uint8_t ep;
+    uint16_t reserved;
+} flight_event_t;
+
+#ifdef CONFIG_ENABLE_FLIGHT_REC
+
+/**
+ * @brief Save the RTC ring after an abnormal reset and start a new one
+ * 
+ * Call before any task can record events.
+ */
+void flight_rec_init(void);
+
+/**
+ * @brief Write the saved record, if any, to the log
+ * 
+ * Call once log storage is up; the record is too large for the early buffer.
+ */
+void flight_rec_log_crash(void);
+
+/**
+ * @brief Record an event; lock-free and safe from any task
+ * 
+ * @param type Event type
+ * @param seqnum USB/IP seqnum, 0 for state events
+ * @param ep Endpoint number
+ * @param arg Event-specific value
+ */
+void flight_rec_event(flight_event_type_t type, uint32_t seqnum, uint8_t ep, int32_t arg);
+
+/**
+ * @brief Events saved from before the last abnormal reset
+ * 
+ * @param count Number of events, oldest first
+ * @param reason Name of the reset reason
+ * @return const flight_event_t* Events, NULL if the last reset was normal
+ */
+const flight_event_t *flight_rec_get_crash(size_t *count, const char **reason);
+
+/**
+ * @brief Format one event as a text line (no trailing newline)
+ * 
+ * @return int Characters written, as snprintf
+ */
+int flight_rec_format(const flight_event_t *ev, char *buf, size_t len);
+
+#else
+
+// Stub implementations when the flight recorder is disabled
+static inline void flight_rec_init(void) { }
+static inline void flight_rec_log_crash(void) { }
+static inline void flight_rec_event(flight_event_type_t type, uint32_t seqnum, uint8_t ep, int32_t arg)
+{
+    (void)type; (void)seqnum; (void)ep; (void)arg;
+}
+
+#endif // CONFIG_ENABLE_FLIGHT_REC
+
+#endif // __FLIGHT_REC_H__
@@ -0,0 +1,74 @@
+#ifndef __LOG_FLASH_H__
+#define __LOG_FLASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "log_handler.h"
+
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+
+/*
+ * Circular log store on a raw data partition.
+ *
+ * Every 4 KiB sector starts with a header holding a sequence number and the
+ * logical log offset of its first byte. Records never straddle sectors and
+ * carry their own CRC32, so torn writes after a power loss are skipped on
+ * read. The sector after the head is always kept erased by a background
+ * task, so log_flash_append() normally never waits for an erase.
+ */
+
+/**
+ * @brief Map the log partition and locate the head
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t log_flash_init(void);
+
+/**
+ * @brief Append one record; the caller serializes calls (log_mutex)
+ * 
+ * Fails with ESP_ERR_INVALID_STATE, dropping the record, while a reader
+ * still holds the sector the head would have to erase next.
+ * 
+ * @param data Record bytes
+ * @param len Number of bytes
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t log_flash_append(const char *data, size_t len);
+
+/**
+ * @brief Logical offset of the oldest byte still stored
+ */
+size_t log_flash_start(void);
+
+/**
+ * @brief Logical offset one past the newest byte
+ */
+size_t log_flash_end(void);
+
+/**
+ * @brief Walk stored bytes in [start, end) straight from the flash mapping
+ * 
+ * The callback receives pointers into memory-mapped flash, no copy is made.
+ * The sector being walked is pinned, so the writer and the erase task
+ * leave it alone until the callback returns.
+ */
+esp_err_t log_flash_foreach(size_t start, size_t end, log_chunk_cb_t cb, void *ctx);
+
+/**
+ * @brief Copy stored bytes starting at a logical offset
+ */
+size_t log_flash_read(size_t offset, char *buffer, size_t len);
+
+/**
+ * @brief Erase the whole partition and start a new log
+ * 
+ * Refused with ESP_ERR_INVALID_STATE while a reader is walking the log.
+ */
+esp_err_t log_flash_clear(void);
+
+#endif // CONFIG_LOG_BACKEND_PARTITION
+
+#endif // __LOG_FLASH_H__
@@ -11,16 +11,41 @@
 
 #define LOG_FILE_PATH "/spiffs/system.log"  // Log file on SPIFFS partition
 #define LOG_MAX_SIZE (128 * 1024)  // 128KB max log file size before rotation
+#define LOG_CHUNK_SIZE 1024  // Bytes read per step when streaming the log out
+#define LOG_EARLY_BUF_SIZE 2048  // Records held in RAM until log storage is mounted
+
+/**
+ * @brief Callback receiving consecutive pieces of the log
+ *
+ * @param data Log bytes (not NUL terminated)
+ * @param len Number of bytes in data
+ * @param ctx User context passed to log_foreach_chunk()
+ * @return esp_err_t ESP_OK to continue, anything else stops the iteration
+ */
+typedef esp_err_t (*log_chunk_cb_t)(const char *data, size_t len, void *ctx);
 
 #ifdef CONFIG_ENABLE_LOG_HANDLER
 
 /**
- * @brief Initialize the in-memory log handler
+ * @brief Initialize the log handler
+ * 
+ * Cheap; log_write() works right after it, buffering records in RAM
+ * until log_handler_start() has mounted the storage backend.
  * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t log_handler_init(void);
 
+/**
+ * @brief Mount log storage, write the boot header and flush buffered records
+ * 
+ * May take seconds (SPIFFS can format on first boot); run it off the
+ * critical boot path.
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t log_handler_start(void);
+
 /**
  * @brief Write a log entry to the in-memory buffer
  * 
@@ -29,6 +54,16 @@ esp_err_t log_handler_init(void);
  */
 void log_write(const char *format, ...);
 
+/**
+ * @brief Write an error or warning log entry
+ * 
+ * Same as log_write(), but never shed under memory pressure.
+ * 
+ * @param format printf-style format string
+ * @param ... variable arguments
+ */
+void log_write_err(const char *format, ...);
+
 /**
  * @brief Get the current log buffer contents
  * 
@@ -38,6 +73,32 @@ void log_write(const char *format, ...);
  */
 size_t log_get_buffer(char *buffer, size_t buffer_size);
 
+/**
+ * @brief Read part of the log starting at a byte offset
+ * 
+ * The log mutex is only held for the duration of this call, so writers
+ * are never blocked for longer than one read.
+ * 
+ * @param offset Byte offset into the log
+ * @param buffer Destination buffer (not NUL terminated)
+ * @param len Maximum number of bytes to read
+ * @return size_t Number of bytes read, 0 at end of log
+ */
+size_t log_read(size_t offset, char *buffer, size_t len);
+
+/**
+ * @brief Walk the log between two offsets in LOG_CHUNK_SIZE pieces
+ * 
+ * The log mutex is released before every callback invocation.
+ * 
+ * @param start First byte offset
+ * @param end Byte offset to stop at (exclusive)
+ * @param cb Callback receiving each piece
+ * @param ctx User context for the callback
+ * @return esp_err_t ESP_OK, or the first error returned by cb
+ */
+esp_err_t log_foreach_chunk(size_t start, size_t end, log_chunk_cb_t cb, void *ctx);
+
 /**
  * @brief Get the current log buffer pointer (for direct access)
  * 
@@ -46,12 +107,22 @@ size_t log_get_buffer(char *buffer, size_t buffer_size);
 const char* log_get_buffer_ptr(void);
 
 /**
- * @brief Get the current size of logged data
+ * @brief Get the offset one past the newest logged byte
  * 
  * @return size_t Size of logged data
  */
 size_t log_get_size(void);
 
+/**
+ * @brief Get the offset of the oldest byte still stored
+ * 
+ * Always 0 for the SPIFFS backend; the circular partition backend drops
+ * old sectors, so valid offsets are [log_get_start_offset(), log_get_size()).
+ * 
+ * @return size_t Offset of the oldest stored byte
+ */
+size_t log_get_start_offset(void);
+
 /**
  * @brief Clear the log buffer
  */
@@ -68,10 +139,15 @@ uint32_t log_get_boot_count(void);
 
 // Stub implementations when log handler is disabled
 static inline esp_err_t log_handler_init(void) { return ESP_OK; }
+static inline esp_err_t log_handler_start(void) { return ESP_OK; }
 static inline void log_write(const char *format, ...) { (void)format; }
+static inline void log_write_err(const char *format, ...) { (void)format; }
 static inline size_t log_get_buffer(char *buffer, size_t buffer_size) { (void)buffer; (void)buffer_size; return 0; }
+static inline size_t log_read(size_t offset, char *buffer, size_t len) { (void)offset; (void)buffer; (void)len; return 0; }
+static inline esp_err_t log_foreach_chunk(size_t start, size_t end, log_chunk_cb_t cb, void *ctx) { (void)start; (void)end; (void)cb; (void)ctx; return ESP_OK; }
 static inline const char* log_get_buffer_ptr(void) { return NULL; }
 static inline size_t log_get_size(void) { return 0; }
+static inline size_t log_get_start_offset(void) { return 0; }
 static inline void log_clear(void) { }
 static inline uint32_t log_get_boot_count(void) { return 0; }
 
@@ -0,0 +1,68 @@
+#ifndef __LOG_INDEX_H__
+#define __LOG_INDEX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Sparse index over the log: the byte stream is cut into segments of at most
+ * CONFIG_LOG_INDEX_SEGMENT_BYTES bytes or CONFIG_LOG_INDEX_WINDOW_MS of time.
+ * Each segment remembers its offsets, its time window and a 64-bit bloom mask
+ * of the "[TAG]" prefixes it contains, so queries only scan matching segments.
+ */
+
+typedef struct
+{
+    uint32_t start;      // First byte offset
+    uint32_t end;        // One past the last byte offset
+    uint32_t t_first;    // ms since boot of the first record
+    uint32_t t_last;     // ms since boot of the last record
+    uint64_t tag_mask;   // Bloom bits of the tags seen in the segment
+} log_segment_t;
+
+#ifdef CONFIG_ENABLE_LOG_QUERY
+
+/**
+ * @brief Start a fresh index
+ * 
+ * @param existing_start Offset of the oldest byte already stored
+ * @param existing_end Offset one past the newest byte already stored
+ */
+void log_index_init(size_t existing_start, size_t existing_end);
+
+/**
+ * @brief Account one record written at `offset`; caller holds log_mutex
+ */
+void log_index_add(size_t offset, const char *data, size_t len);
+
+/**
+ * @brief Bloom bit for a tag (the text between the brackets of "[TAG]")
+ */
+uint64_t log_index_tag_bit(const char *tag, size_t len);
+
+/**
+ * @brief Range of segment sequence numbers currently held, [first, last]
+ * 
+ * @return false if the index is empty
+ */
+bool log_index_range(uint32_t *first, uint32_t *last);
+
+/**
+ * @brief Copy one segment by sequence number
+ * 
+ * @return false if the segment was evicted or does not exist yet
+ */
+bool log_index_get(uint32_t seq, log_segment_t *out);
+
+#else
+
+// Stub implementations when log queries are disabled
+static inline void log_index_init(size_t existing_start, size_t existing_end) { (void)existing_start; (void)existing_end; }
+static inline void log_index_add(size_t offset, const char *data, size_t len) { (void)offset; (void)data; (void)len; }
+
+#endif // CONFIG_ENABLE_LOG_QUERY
+
+#endif // __LOG_INDEX_H__
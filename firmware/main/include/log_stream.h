@@ -0,0 +1,46 @@
+#ifndef __LOG_STREAM_H__
+#define __LOG_STREAM_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_ENABLE_LOG_STREAM
+
+#include <esp_http_server.h>
+
+/**
+ * @brief Create the in-RAM log ring and the viewer task
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t log_stream_init(void);
+
+/**
+ * @brief Append a log record to the ring
+ * 
+ * Never blocks: viewers that fall more than one ring behind skip ahead.
+ * Must be called by a single writer at a time (log_write holds log_mutex).
+ * 
+ * @param data Record bytes
+ * @param len Number of bytes
+ */
+void log_stream_push(const char *data, size_t len);
+
+/**
+ * @brief Hand an HTTP request over to the viewer task as a Server-Sent Events stream
+ * 
+ * @param req Request from the /logs/stream handler
+ * @return esp_err_t ESP_OK if the viewer was attached
+ */
+esp_err_t log_stream_attach(httpd_req_t *req);
+
+#else
+
+// Stub implementations when log streaming is disabled
+static inline esp_err_t log_stream_init(void) { return ESP_OK; }
+static inline void log_stream_push(const char *data, size_t len) { (void)data; (void)len; }
+
+#endif // CONFIG_ENABLE_LOG_STREAM
+
+#endif // __LOG_STREAM_H__
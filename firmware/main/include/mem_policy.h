@@ -0,0 +1,73 @@
+#ifndef __MEM_POLICY_H__
+#define __MEM_POLICY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+/*
+ * Heap placement for everything off the URB path.
+ *
+ * Each user of the heap asks for memory under one of the uses below and
+ * gets it from internal RAM or, with PSRAM enabled, from SPIRAM as set
+ * under "Memory Placement". A SPIRAM allocation that fails falls back to
+ * internal RAM. USB transfers are not covered: the host library allocates
+ * them in DMA-capable internal RAM, and the session arena holds them for
+ * the whole run.
+ */
+
+typedef enum
+{
+    MEM_USE_LOG = 0,        // Live log ring, crash record copy
+    MEM_USE_CAPTURE,        // USB/IP capture and usbmon rings, pcapng export buffers
+    MEM_USE_CACHE,          // Session replay ring
+    MEM_USE_HTTP,           // Response buffers, gzip encoders, query state, snapshots
+    MEM_USE_COUNT
+} mem_use_t;
+
+typedef struct
+{
+    uint32_t internal;      // Bytes held in internal RAM now
+    uint32_t spiram;        // Bytes held in SPIRAM now
+    uint32_t peak;          // Most bytes held at once, both together
+    uint32_t allocs;
+    uint32_t fallbacks;     // Wanted SPIRAM, got internal RAM
+    uint32_t failures;      // Got nothing
+} mem_use_stats_t;
+
+/**
+ * @brief Allocate memory for a use
+ *
+ * @param use What the memory is for
+ * @param size Bytes wanted
+ * @return Pointer to free with mem_free() under the same use, or NULL
+ */
+void *mem_alloc(mem_use_t use, size_t size);
+
+/**
+ * @brief Allocate zeroed memory for a use
+ */
+void *mem_calloc(mem_use_t use, size_t n, size_t size);
+
+/**
+ * @brief Free memory from mem_alloc() or mem_calloc(); NULL is ignored
+ */
+void mem_free(mem_use_t use, void *ptr);
+
+/**
+ * @brief Whether a use is placed in SPIRAM in this build
+ */
+bool mem_use_in_spiram(mem_use_t use);
+
+/**
+ * @brief Name of a use, for reports
+ */
+const char *mem_use_name(mem_use_t use);
+
+/**
+ * @brief Copy the counters of a use
+ */
+void mem_get_stats(mem_use_t use, mem_use_stats_t *out);
+
+#endif // __MEM_POLICY_H__
@@ -0,0 +1,95 @@
+#ifndef __MEM_PRESSURE_H__
+#define __MEM_PRESSURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Load shedding when free heap runs low.
+ *
+ * A monitor task samples free heap and moves between tiers. Each tier
+ * keeps the effects of the ones below it:
+ * - quiet: only errors, warnings and tier changes are logged; USB/IP
+ *   capture and usbmon stop recording
+ * - shed: log and capture downloads are refused with 503
+ * - critical: fewer URBs are admitted, so TCP flow control slows the
+ *   client down before the budget's heap reserve is reached
+ * A tier is entered when free heap drops below its threshold and left
+ * only once free heap is back above threshold plus hysteresis.
+ */
+
+typedef enum
+{
+    MEM_PRESSURE_NORMAL = 0,
+    MEM_PRESSURE_QUIET,
+    MEM_PRESSURE_SHED,
+    MEM_PRESSURE_CRITICAL,
+    MEM_PRESSURE_TIER_COUNT
+} mem_pressure_tier_t;
+
+/* What was given up under pressure */
+typedef enum
+{
+    MEM_PRESSURE_DROP_LOG = 0,      // Log record not written
+    MEM_PRESSURE_DROP_CAPTURE,      // PDU or transfer event not captured
+    MEM_PRESSURE_DROP_HTTP,         // Download refused
+    MEM_PRESSURE_DROP_COUNT
+} mem_pressure_drop_t;
+
+typedef struct
+{
+    uint32_t tier;                                  // mem_pressure_tier_t now
+    uint32_t free_heap;                             // At the last sample
+    uint32_t min_free_heap;
+    uint32_t changes;                               // Tier changes, either way
+    uint32_t entered[MEM_PRESSURE_TIER_COUNT];      // Times each tier was entered
+    uint64_t time_us[MEM_PRESSURE_TIER_COUNT];      // Time spent in each tier
+    uint32_t dropped[MEM_PRESSURE_DROP_COUNT];
+} mem_pressure_stats_t;
+
+#ifdef CONFIG_ENABLE_MEM_PRESSURE
+
+/**
+ * @brief Start the monitor task
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mem_pressure_init(void);
+
+/**
+ * @brief Current tier; a plain load, cheap enough for every log record
+ */
+mem_pressure_tier_t mem_pressure_tier(void);
+
+/**
+ * @brief URBs the budget may admit at the current tier
+ */
+uint32_t mem_pressure_max_urbs(void);
+
+/**
+ * @brief Count something given up under pressure
+ */
+void mem_pressure_note_drop(mem_pressure_drop_t what);
+
+/**
+ * @brief Name of a tier, for logs and reports
+ */
+const char *mem_pressure_tier_name(mem_pressure_tier_t tier);
+
+/**
+ * @brief Copy current counts; time_us includes the tier in progress
+ */
+void mem_pressure_get_stats(mem_pressure_stats_t *out);
+
+#else
+
+static inline esp_err_t mem_pressure_init(void) { return ESP_OK; }
+static inline mem_pressure_tier_t mem_pressure_tier(void) { return MEM_PRESSURE_NORMAL; }
+static inline uint32_t mem_pressure_max_urbs(void) { return CONFIG_URB_BUDGET_MAX_URBS; }
+static inline void mem_pressure_note_drop(mem_pressure_drop_t what) { (void)what; }
+
+#endif // CONFIG_ENABLE_MEM_PRESSURE
+
+#endif // __MEM_PRESSURE_H__
@@ -0,0 +1,75 @@
+#ifndef __PCAPNG_H__
+#define __PCAPNG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * Minimal pcapng writer: one section, any number of interfaces, enhanced
+ * packet blocks. Output is batched in a small buffer and handed to a sink
+ * callback, so an HTTP handler can stream a capture of any size.
+ */
+
+#define PCAPNG_LINKTYPE_ETHERNET    1
+#define PCAPNG_LINKTYPE_USB_LINUX_MMAPPED 220
+
+#define PCAPNG_BUF_SIZE 1024
+
+typedef esp_err_t (*pcapng_write_fn)(const void *data, size_t len, void *ctx);
+
+typedef struct
+{
+    pcapng_write_fn write;
+    void *ctx;
+    esp_err_t err;
+    size_t len;
+    uint8_t buf[PCAPNG_BUF_SIZE];
+} pcapng_writer_t;
+
+/**
+ * @brief Prepare a writer and emit the section header block
+ * 
+ * @param w Writer state
+ * @param write Sink receiving the file bytes
+ * @param ctx User context for the sink
+ */
+void pcapng_begin(pcapng_writer_t *w, pcapng_write_fn write, void *ctx);
+
+/**
+ * @brief Emit an interface description block
+ * 
+ * Interfaces are numbered from 0 in the order they are added.
+ * 
+ * @param linktype PCAPNG_LINKTYPE_*
+ * @param snaplen Maximum captured bytes per packet
+ * @param name Interface name shown by Wireshark, may be NULL
+ */
+void pcapng_add_interface(pcapng_writer_t *w, uint16_t linktype, uint32_t snaplen, const char *name);
+
+/**
+ * @brief Emit an enhanced packet block
+ * 
+ * The packet is hdr followed by data, so link-layer headers can be
+ * synthesized without copying the payload first.
+ * 
+ * @param if_id Interface number
+ * @param ts_us Timestamp in microseconds
+ * @param hdr Leading bytes of the packet, may be NULL
+ * @param hdr_len Length of hdr
+ * @param data Captured payload
+ * @param data_len Length of data
+ * @param orig_len Length of the packet on the wire, including hdr
+ */
+void pcapng_add_packet(pcapng_writer_t *w, uint32_t if_id, uint64_t ts_us,
+                       const void *hdr, size_t hdr_len,
+                       const void *data, size_t data_len, uint32_t orig_len);
+
+/**
+ * @brief Push out buffered bytes
+ * 
+ * @return esp_err_t First error returned by the sink, ESP_OK otherwise
+ */
+esp_err_t pcapng_end(pcapng_writer_t *w);
+
+#endif // __PCAPNG_H__
@@ -0,0 +1,65 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Heap capability classes reported: internal, DMA-capable, SPIRAM */
+#define PROFILER_HEAP_KINDS 3
+
+typedef struct
+{
+    TaskHandle_t handle;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    eTaskState state;
+    uint32_t stack_free;        // Stack high-water mark in bytes (least ever free)
+    uint32_t runtime;           // Run-time counter ticks since boot
+} profiler_task_t;
+
+typedef struct
+{
+    const char *name;
+    size_t total;
+    size_t free;
+    size_t min_free;            // Low-water mark since boot
+    size_t largest;             // Largest allocatable block
+} profiler_heap_t;
+
+typedef struct
+{
+    int64_t timestamp_us;
+    uint32_t total_runtime;     // Run-time counter ticks since boot, per core
+    profiler_heap_t heap[PROFILER_HEAP_KINDS];
+    UBaseType_t num_tasks;
+    profiler_task_t tasks[];
+} profiler_snapshot_t;
+
+#ifdef CONFIG_ENABLE_PROFILER
+
+/**
+ * @brief Capture task run-time counters, stack high-water marks and heap usage
+ * 
+ * @return profiler_snapshot_t* Snapshot to mem_free(MEM_USE_HTTP, ...) after use, NULL if out of memory
+ */
+profiler_snapshot_t *profiler_snapshot(void);
+
+/**
+ * @brief Find a task in a snapshot
+ * 
+ * @return const profiler_task_t* Entry for handle, NULL if the task did not exist then
+ */
+const profiler_task_t *profiler_find_task(const profiler_snapshot_t *snap, TaskHandle_t handle);
+
+/**
+ * @brief Short name of a task state
+ */
+const char *profiler_state_name(eTaskState state);
+
+#endif // CONFIG_ENABLE_PROFILER
+
+#endif // __PROFILER_H__
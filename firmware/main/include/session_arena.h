@@ -0,0 +1,93 @@
+#ifndef __SESSION_ARENA_H__
+#define __SESSION_ARENA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "usbip_server.h"
+#include "usbip_codec.h"
+
+/*
+ * Per-session storage for URBs.
+ *
+ * Every URB admitted by the budget takes one slot from a static region of
+ * CONFIG_URB_BUDGET_MAX_URBS slots. A slot holds the decoded CMD_SUBMIT, its
+ * RET_SUBMIT and a USB transfer allocated once at boot, so serving a URB
+ * allocates nothing from the heap. When a session ends,
+ * transfers still on the bus are cancelled, URBs still queued are dropped
+ * unserved, and once the last slot is back the region is reset as a whole.
+ */
+
+typedef struct urb_slot_t
+{
+    usbip_submit_desc_t cmd;        // CMD_SUBMIT, decoded as it came off the socket
+    usbip_ret_desc_t res;           // Its RET_SUBMIT, encoded into wire when sent
+    urb_timestamps ts;
+    int sock;
+    uint32_t budget_bytes;          // Charged by urb_budget_acquire()
+    uint8_t xfer_type;              // usb_transfer_type_t of the endpoint
+    /* RET_SUBMIT as sent. Until then its transfer_buffer holds the OUT data
+     * read off the socket; an OUT URB's response carries no data. */
+    usbip_ret_submit wire __attribute__((aligned(4)));
+    usb_transfer_t *transfer;       // Reused by every URB served from this slot
+    struct urb_slot_t *next_free;
+    uint32_t generation;            // Session the slot was taken for
+    bool on_bus;                    // Submitted to the USB host library
+} urb_slot_t;
+
+typedef struct
+{
+    uint32_t slots;
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t generation;            // Sessions torn down so far
+    uint32_t resets;                // Times the region was reset as a whole
+    uint32_t cancelled;             // Endpoints flushed at teardown
+    uint32_t dropped;               // Queued URBs dropped at teardown
+    uint32_t exhausted;             // Allocations that found no free slot
+} session_arena_stats_t;
+
+/**
+ * @brief Allocate the transfers; call once at boot
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t session_arena_init(void);
+
+/**
+ * @brief Take a slot for an admitted URB
+ *
+ * @return The slot, or NULL if none is free
+ */
+urb_slot_t *session_arena_alloc(void);
+
+/**
+ * @brief Give a slot back once its URB has been answered or dropped
+ */
+void session_arena_free(urb_slot_t *slot);
+
+/**
+ * @brief Whether the slot was taken for a session that has since been torn down
+ */
+bool session_arena_is_stale(const urb_slot_t *slot);
+
+/**
+ * @brief Mark a slot's transfer as submitted to, or returned by, the host library
+ */
+void session_arena_set_on_bus(urb_slot_t *slot, bool on_bus);
+
+/**
+ * @brief End the session's use of the arena
+ *
+ * Halts, flushes and clears every endpoint with a transfer on the bus so it
+ * completes as cancelled. The region is reset once every slot is back.
+ */
+void session_arena_teardown(void);
+
+/**
+ * @brief Copy current counts
+ */
+void session_arena_get_stats(session_arena_stats_t *out);
+
+#endif // __SESSION_ARENA_H__
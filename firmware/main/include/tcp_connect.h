@@ -34,4 +34,7 @@ void tcp_server_start(void *pvParameters);
 // Thread-safe socket send function
 int tcp_send_locked(int socket, const void *data, size_t length, int flags);
 
+// Ends the USB/IP session, attached or held for a resume (device unplugged); an attached client sees the connection close
+void tcp_server_drop_session(void);
+
 #endif
\ No newline at end of file
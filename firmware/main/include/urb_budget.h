@@ -0,0 +1,64 @@
+#ifndef __URB_BUDGET_H__
+#define __URB_BUDGET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Admission control for CMD_SUBMITs.
+ *
+ * Every URB taken off the socket is charged against a budget of
+ * CONFIG_URB_BUDGET_MAX_URBS URBs and CONFIG_URB_BUDGET_MAX_BYTES transfer
+ * bytes until its RET_SUBMIT has been sent. While the budget is used up,
+ * or free heap is below CONFIG_URB_BUDGET_HEAP_RESERVE, the socket reader
+ * waits instead of reading on, so TCP flow control slows the client down.
+ */
+
+typedef struct
+{
+    uint32_t urbs;              // In flight now
+    uint32_t bytes;
+    uint32_t peak_urbs;
+    uint32_t peak_bytes;
+    uint32_t admitted;
+    uint32_t stalls;            // Admissions that had to wait
+    uint64_t stall_us;          // Total time the reader waited
+    uint32_t timeouts;          // Waited CONFIG_URB_BUDGET_WAIT_MS and gave up
+    uint32_t rejected;          // URBs completed with an error status at once
+} urb_budget_stats_t;
+
+/**
+ * @brief Create the wake-up semaphore
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t urb_budget_init(void);
+
+/**
+ * @brief Charge a URB, waiting up to CONFIG_URB_BUDGET_WAIT_MS for room
+ *
+ * With nothing in flight a URB is always admitted.
+ *
+ * @param bytes Transfer buffer length
+ * @return true if admitted; false if the caller must reject the URB
+ */
+bool urb_budget_acquire(uint32_t bytes);
+
+/**
+ * @brief Return what urb_budget_acquire() charged once the URB is answered
+ */
+void urb_budget_release(uint32_t bytes);
+
+/**
+ * @brief Count a URB completed with an error status instead of being served
+ */
+void urb_budget_note_rejected(void);
+
+/**
+ * @brief Copy current usage and counters
+ */
+void urb_budget_get_stats(urb_budget_stats_t *out);
+
+#endif // __URB_BUDGET_H__
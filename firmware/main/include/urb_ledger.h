@@ -0,0 +1,78 @@
+#ifndef __URB_LEDGER_H__
+#define __URB_LEDGER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+/*
+ * Lifecycle ledger for URBs, for debug builds.
+ *
+ * Records allocate, submit, complete, send and free for every URB in a
+ * fixed table keyed by seqnum, and flags URBs that are freed twice, freed
+ * without being answered, or never complete. Findings are logged as they
+ * happen and at disconnect, and served at GET /ledger. Compiled out unless
+ * CONFIG_ENABLE_URB_LEDGER is set.
+ */
+
+typedef enum
+{
+    URB_LEDGER_ALLOC    = 0x01,     // Slot taken off the session arena
+    URB_LEDGER_SUBMIT   = 0x02,     // Handed to the USB host library
+    URB_LEDGER_COMPLETE = 0x04,     // Transfer callback ran
+    URB_LEDGER_SEND     = 0x08,     // RET_SUBMIT written to the socket
+    URB_LEDGER_DROP     = 0x10,     // Deliberately left unanswered (session ended)
+    URB_LEDGER_FREE     = 0x20      // Slot returned
+} urb_ledger_stage_t;
+
+typedef enum
+{
+    URB_LEDGER_DOUBLE_FREE = 0,
+    URB_LEDGER_UNANSWERED,          // Freed without a RET_SUBMIT
+    URB_LEDGER_INCOMPLETE,          // Still on the bus at disconnect
+    URB_LEDGER_UNSENT,              // Completed but not answered at disconnect
+    URB_LEDGER_UNKNOWN,             // Event for a seqnum not in the table
+    URB_LEDGER_DUPLICATE,           // Allocated while the same seqnum was live
+    URB_LEDGER_FINDING_COUNT
+} urb_ledger_finding_t;
+
+#ifdef CONFIG_ENABLE_URB_LEDGER
+
+/**
+ * @brief Start a URB's entry
+ *
+ * @param seqnum USB/IP seqnum in host order
+ */
+void urb_ledger_alloc(uint32_t seqnum);
+
+/**
+ * @brief Record a later stage of a URB
+ *
+ * @param seqnum USB/IP seqnum in host order
+ * @param stage One of urb_ledger_stage_t other than URB_LEDGER_ALLOC
+ */
+void urb_ledger_mark(uint32_t seqnum, urb_ledger_stage_t stage);
+
+/**
+ * @brief Log every URB still live, flagging those that never completed or were never answered
+ *
+ * @param why What ended the session, for the log
+ */
+void urb_ledger_report(const char *why);
+
+/**
+ * @brief Write findings and live entries as text
+ *
+ * @return Number of bytes written, excluding the terminator
+ */
+int urb_ledger_format(char *buf, int size);
+
+#else
+
+static inline void urb_ledger_alloc(uint32_t seqnum) {}
+static inline void urb_ledger_mark(uint32_t seqnum, urb_ledger_stage_t stage) {}
+static inline void urb_ledger_report(const char *why) {}
+
+#endif // CONFIG_ENABLE_URB_LEDGER
+
+#endif // __URB_LEDGER_H__
@@ -0,0 +1,106 @@
+#ifndef __URB_STATS_H__
+#define __URB_STATS_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/* Log2 buckets in microseconds: bucket 0 is < 2 us, bucket N is [2^N, 2^(N+1)) us,
+ * and the last bucket collects everything above */
+#define URB_STATS_NUM_BUCKETS 16
+
+/* Endpoint types, same order as usb_transfer_type_t */
+#define URB_STATS_NUM_EP_TYPES 4
+
+/* Pipeline stages measured for each URB */
+typedef enum
+{
+    URB_STAGE_DISPATCH = 0, /* do_recv -> _usb_ip_event_handler_2 (esp_event hop) */
+    URB_STAGE_DEVICE,       /* dispatch -> transfer_cb (USB host library + device) */
+    URB_STAGE_SEND,         /* transfer_cb -> RET_SUBMIT handed to the socket */
+    URB_STAGE_TOTAL,        /* do_recv -> RET_SUBMIT handed to the socket */
+    URB_STAGE_COUNT
+} urb_stage_t;
+
+/* esp_timer stamps in microseconds carried along with each URB; 0 means not stamped */
+typedef struct urb_timestamps_t
+{
+    int64_t recv;
+    int64_t dispatch;
+    int64_t complete;
+    int64_t sent;
+} urb_timestamps;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[URB_STATS_NUM_BUCKETS];
+} urb_stats_hist_t;
+
+typedef struct
+{
+    urb_stats_hist_t hist[URB_STATS_NUM_EP_TYPES][URB_STAGE_COUNT];
+} urb_stats_snapshot_t;
+
+#ifdef CONFIG_ENABLE_URB_STATS
+
+#include "esp_timer.h"
+
+/* 64-bit microseconds: unlike CCOUNT it neither wraps on a long-idle
+ * interrupt endpoint nor drifts when DFS changes the CPU clock */
+#define URB_STATS_NOW() esp_timer_get_time()
+
+/**
+ * @brief Initialize the latency histograms
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t urb_stats_init(void);
+
+/**
+ * @brief Account a finished URB into the histograms of its endpoint type
+ *
+ * @param xfer_type usb_transfer_type_t of the endpoint
+ * @param ts Stamps collected along the pipeline
+ */
+void urb_stats_record(uint8_t xfer_type, const urb_timestamps *ts);
+
+/**
+ * @brief Copy the current histograms
+ *
+ * @param out Destination snapshot
+ */
+void urb_stats_snapshot(urb_stats_snapshot_t *out);
+
+/**
+ * @brief Clear all histograms
+ */
+void urb_stats_reset(void);
+
+/**
+ * @brief Get the human readable name of a stage
+ */
+const char *urb_stats_stage_name(urb_stage_t stage);
+
+/**
+ * @brief Get the human readable name of an endpoint type
+ */
+const char *urb_stats_type_name(uint8_t xfer_type);
+
+#else
+
+#define URB_STATS_NOW() 0
+
+// Stub implementations when URB statistics are disabled
+static inline esp_err_t urb_stats_init(void) { return ESP_OK; }
+static inline void urb_stats_record(uint8_t xfer_type, const urb_timestamps *ts) { (void)xfer_type; (void)ts; }
+static inline void urb_stats_snapshot(urb_stats_snapshot_t *out) { (void)out; }
+static inline void urb_stats_reset(void) { }
+static inline const char *urb_stats_stage_name(urb_stage_t stage) { (void)stage; return ""; }
+static inline const char *urb_stats_type_name(uint8_t xfer_type) { (void)xfer_type; return ""; }
+
+#endif // CONFIG_ENABLE_URB_STATS
+
+#endif // __URB_STATS_H__
@@ -0,0 +1,73 @@
+#ifndef __URB_WATCHDOG_H__
+#define __URB_WATCHDOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "usb/usb_host.h"
+
+/*
+ * Deadlines for transfers handed to the USB host library.
+ *
+ * Each submitted transfer is put on a timer wheel with a deadline that
+ * depends on its endpoint. When it passes, the endpoint is halted, flushed
+ * and cleared; the transfer then completes as cancelled and the URB is
+ * answered with -ETIMEDOUT. EP0 cannot be flushed, so an expired control
+ * transfer is only counted as stuck until it completes.
+ */
+
+typedef struct
+{
+    uint32_t armed;             // Transfers being watched now
+    uint32_t stuck;             // Past their deadline and not completed yet
+    uint32_t expired;           // Flushed and answered with -ETIMEDOUT
+    uint32_t stuck_total;       // Ever past their deadline
+    uint32_t untracked;         // Submitted while every slot was in use
+} urb_watchdog_stats_t;
+
+#ifdef CONFIG_ENABLE_URB_WATCHDOG
+
+/**
+ * @brief Start the watchdog task
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t urb_watchdog_init(void);
+
+/**
+ * @brief Start the deadline of a submitted transfer
+ *
+ * Control transfers and OUT transfers get CONFIG_URB_WATCHDOG_TRANSFER_MS
+ * plus the endpoint interval. IN transfers on bulk and interrupt
+ * endpoints may legitimately wait for the device to have data, so they get
+ * the ceiling, CONFIG_URB_WATCHDOG_CEILING_MS.
+ *
+ * @param transfer Submitted transfer
+ * @param seqnum USB/IP seqnum, for the log
+ * @param xfer_type usb_transfer_type_t of the endpoint
+ * @param interval bInterval of the endpoint in ms, 0 if none
+ */
+void urb_watchdog_arm(usb_transfer_t *transfer, uint32_t seqnum, uint8_t xfer_type, uint32_t interval);
+
+/**
+ * @brief Stop watching a transfer; call from its completion callback
+ *
+ * @return true if the watchdog flushed it; answer the URB with -ETIMEDOUT
+ */
+bool urb_watchdog_disarm(usb_transfer_t *transfer);
+
+/**
+ * @brief Copy current counts
+ */
+void urb_watchdog_get_stats(urb_watchdog_stats_t *out);
+
+#else
+
+static inline esp_err_t urb_watchdog_init(void) { return ESP_OK; }
+static inline void urb_watchdog_arm(usb_transfer_t *transfer, uint32_t seqnum, uint8_t xfer_type, uint32_t interval) {}
+static inline bool urb_watchdog_disarm(usb_transfer_t *transfer) { return false; }
+
+#endif // CONFIG_ENABLE_URB_WATCHDOG
+
+#endif // __URB_WATCHDOG_H__
@@ -40,11 +40,13 @@ const usb_config_desc_t *get_config_desc();
 /* Fills the usbip_ret_submit struct with the required information */
 void get_usbip_ret_submit(usbip_cmd_submit *dev, usbip_header_basic *header, int sock);
 
+/* Completes a CMD_SUBMIT that was not admitted at once with a negative errno status; uses ~1.1 KB of stack */
+void usb_handler_reject_urb(const usbip_header_basic *header, int sock, int32_t status);
+
 /* Fills the usbip_ret_unlink struct with the required information */
 void init_unlink(uint32_t seqnum);
 
-/* Endpoint transfer pending flags (for preventing memory exhaustion) */
-extern bool ep1_transfer_pending;
-extern bool ep2_transfer_pending;
+/* Lets every endpoint take a new URB; for when nobody will collect the completions in flight */
+void usb_handler_clear_pending(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,112 @@
+#ifndef __USBIP_CAPTURE_H__
+#define __USBIP_CAPTURE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "pcapng.h"
+
+/* Largest USB/IP PDU this firmware exchanges: 48-byte header plus the largest transfer */
+#define USBIP_CAPTURE_MAX_SNAPLEN   (48 + CONFIG_USBIP_MAX_TRANSFER_SIZE)
+
+/* Command filter bits; URB commands use their USBIP_CMD_* / USBIP_RET_* value */
+#define USBIP_CAPTURE_CMD_OP        (1u << 0)
+#define USBIP_CAPTURE_CMD(cmd)      (1u << (cmd))
+#define USBIP_CAPTURE_CMD_ALL       0x1F
+
+typedef enum
+{
+    USBIP_CAPTURE_RX = 0,   // Client to device
+    USBIP_CAPTURE_TX = 1,   // Device to client
+} usbip_capture_dir_t;
+
+typedef struct
+{
+    uint16_t ep_mask;       // Bit per endpoint number
+    uint8_t cmd_mask;       // USBIP_CAPTURE_CMD_* bits
+    uint32_t seq_min;       // Inclusive seqnum range for URB PDUs
+    uint32_t seq_max;
+    uint16_t snaplen;       // Bytes kept per PDU
+} usbip_capture_filter_t;
+
+typedef struct
+{
+    bool active;
+    uint32_t captured;      // PDUs stored since the last start
+    uint32_t overwritten;   // Oldest PDUs evicted to make room
+    uint32_t dropped;       // PDUs lost to lock contention
+    uint32_t used;          // Ring bytes in use
+    uint32_t size;          // Ring size
+} usbip_capture_status_t;
+
+#ifdef CONFIG_ENABLE_USBIP_CAPTURE
+
+/**
+ * @brief Allocate the capture ring; capture starts stopped
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t usbip_capture_init(void);
+
+/**
+ * @brief Fill a filter that matches everything with the default snap length
+ */
+void usbip_capture_default_filter(usbip_capture_filter_t *filter);
+
+/**
+ * @brief Clear the ring and start capturing with the given filter
+ */
+void usbip_capture_start(const usbip_capture_filter_t *filter);
+
+/**
+ * @brief Stop capturing; the ring is kept for export
+ */
+void usbip_capture_stop(void);
+
+/**
+ * @brief Record one USB/IP PDU given as up to two pieces
+ * 
+ * Called on the socket paths. Costs a filter check and a ring copy; never
+ * blocks for long and drops the PDU instead.
+ * 
+ * @param dir Direction of the PDU
+ * @param hdr First piece, must start with the USB/IP header
+ * @param hdr_len Length of hdr
+ * @param body Second piece, may be NULL
+ * @param body_len Length of body
+ */
+void usbip_capture_frame(usbip_capture_dir_t dir, const void *hdr, size_t hdr_len,
+                         const void *body, size_t body_len);
+
+/**
+ * @brief Write the ring as a pcapng file
+ * 
+ * PDUs are wrapped in synthetic Ethernet/IPv4/TCP headers on port 3240 so
+ * Wireshark's USB/IP dissector decodes them.
+ * 
+ * @param write Sink receiving the file bytes
+ * @param ctx User context for the sink
+ * @return esp_err_t ESP_OK on success, or the sink's error
+ */
+esp_err_t usbip_capture_export(pcapng_write_fn write, void *ctx);
+
+/**
+ * @brief Snapshot of the capture counters
+ */
+void usbip_capture_get_status(usbip_capture_status_t *status);
+
+#else
+
+// Stub implementations when packet capture is disabled
+static inline esp_err_t usbip_capture_init(void) { return ESP_OK; }
+static inline void usbip_capture_frame(usbip_capture_dir_t dir, const void *hdr, size_t hdr_len,
+                                       const void *body, size_t body_len)
+{
+    (void)dir; (void)hdr; (void)hdr_len; (void)body; (void)body_len;
+}
+
+#endif // CONFIG_ENABLE_USBIP_CAPTURE
+
+#endif // __USBIP_CAPTURE_H__
@@ -0,0 +1,67 @@
+#ifndef __USBIP_CODEC_H__
+#define __USBIP_CODEC_H__
+
+#include <stdint.h>
+#include "usbip_proto.h"
+
+/*
+ * Conversion between USB/IP frames and the aligned, host-order form used
+ * inside the server.
+ *
+ * The wire structs in usbip_proto.h are packed and big-endian. A
+ * CMD_SUBMIT is decoded once as it comes off the socket and its RET_SUBMIT
+ * is encoded once as it is sent; everything in between reads plain fields.
+ */
+
+/* CMD_SUBMIT header in host order */
+typedef struct
+{
+    uint32_t seqnum;
+    uint32_t devid;
+    uint32_t direction;         // 0 = OUT, 1 = IN
+    uint32_t ep;
+    uint32_t transfer_flags;
+    uint32_t transfer_buffer_length;
+    int32_t start_frame;
+    int32_t number_of_packets;
+    int32_t interval;
+    usb_setup_packet_t setup;   // Little-endian, as the USB host library wants it
+} usbip_submit_desc_t;
+
+/* RET_SUBMIT header in host order */
+typedef struct
+{
+    uint32_t seqnum;
+    uint32_t devid;
+    uint32_t ep;
+    int32_t status;             // 0 or a negative Linux errno
+    uint32_t actual_length;
+    int32_t start_frame;
+    int32_t number_of_packets;
+    int32_t error_count;
+} usbip_ret_desc_t;
+
+/**
+ * @brief Decode the fixed part of a CMD_SUBMIT
+ *
+ * @param header Basic header as read off the socket
+ * @param cmd CMD_SUBMIT fields that follow it
+ * @param out Decoded header
+ */
+void usbip_decode_cmd_submit(const usbip_header_basic *header, const usbip_cmd_submit *cmd, usbip_submit_desc_t *out);
+
+/**
+ * @brief Start the RET_SUBMIT for a decoded CMD_SUBMIT
+ *
+ * Status 0, actual_length 0 and the request's start_frame.
+ */
+void usbip_ret_desc_init(const usbip_submit_desc_t *cmd, usbip_ret_desc_t *out);
+
+/**
+ * @brief Encode a RET_SUBMIT header in front of its transfer data
+ *
+ * Only the header is written; transfer_buffer is left alone.
+ */
+void usbip_encode_ret_submit(const usbip_ret_desc_t *ret, usbip_ret_submit *wire);
+
+#endif // __USBIP_CODEC_H__
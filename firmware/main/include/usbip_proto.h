@@ -0,0 +1,87 @@
+#ifndef __USBIP_PROTO_H__
+#define __USBIP_PROTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "usb/usb_host.h"
+
+/*
+ * USB/IP wire format of the URB phase (after OP_REQ_IMPORT). All fields are
+ * big-endian on the wire; usbip_codec.h converts to and from host order.
+ * Kept free of FreeRTOS and lwIP so the codec also builds on the host.
+ */
+
+#define USBIP_CMD_SUBMIT 0x00000001
+#define USBIP_RET_SUBMIT 0x00000003
+
+#define USBIP_CMD_UNLINK 0x00000002
+#define USBIP_RET_UNLINK 0x00000004
+
+/* Linux errno values for a RET_SUBMIT status, sent negated; newlib's differ for some */
+#define USBIP_ENOMEM 12     // No memory for the transfer
+#define USBIP_EBUSY 16      // Endpoint already has a transfer in flight
+#define USBIP_EPIPE 32      // Endpoint stalled
+#define USBIP_ENODEV 19     // Device gone
+#define USBIP_EPROTO 71     // Submit or transfer failed
+#define USBIP_ETIMEDOUT 110 // Flushed by the URB watchdog
+
+/* Largest transfer buffer a URB may carry; set by the device profile */
+#define USBIP_MAX_TRANSFER_SIZE CONFIG_USBIP_MAX_TRANSFER_SIZE
+
+/* Linux URB transfer_flags bits honoured by the USB host library */
+#define USBIP_URB_ZERO_PACKET 0x0040
+
+typedef struct usbip_header_basic_t
+{
+    uint32_t command;
+    uint32_t seqnum;
+    uint32_t devid;
+    uint32_t direction;
+    uint32_t ep;
+} __attribute__((packed)) usbip_header_basic;
+
+typedef struct usbip_cmd_submit_t
+{
+    uint32_t transfer_flags;
+    uint32_t transfer_buffer_length;
+
+    uint32_t start_frame;
+    uint32_t number_of_packets;
+    uint32_t interval;
+
+    usb_setup_packet_t setup;
+    // OUT transfer data follows on the wire
+} __attribute__((packed)) usbip_cmd_submit;
+
+typedef struct usbip_ret_submit_t
+{
+    usbip_header_basic base;
+    uint32_t status;
+    uint32_t actual_length;
+    uint32_t start_frame;
+    uint32_t number_of_packets;
+    uint32_t error_count;
+
+    unsigned char padding[8];
+    // device_desc transfer_buffer;
+    uint8_t transfer_buffer[USBIP_MAX_TRANSFER_SIZE];
+} __attribute__((packed)) usbip_ret_submit;
+
+/* Size of the RET_SUBMIT header that precedes the transfer data on the wire */
+#define USBIP_RET_SUBMIT_HEADER_SIZE offsetof(usbip_ret_submit, transfer_buffer)
+
+typedef struct usbip_cmd_unlink_t
+{
+    uint32_t unlink_seqnum;
+    unsigned char padding[24];
+} __attribute__((packed)) usbip_cmd_unlink;
+
+typedef struct usbip_ret_unlink_t
+{
+    usbip_header_basic base;
+    uint32_t status;
+    unsigned char padding[24];
+} __attribute__((packed)) usbip_ret_unlink;
+
+#endif // __USBIP_PROTO_H__
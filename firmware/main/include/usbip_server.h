@@ -2,18 +2,22 @@
 #define __USBIP_SERVER_H__
 
 #include <stdio.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include "usb_handler.h"
 #include "esp_intr_alloc.h"
 #include "usb/usb_host.h"
 #include "esp_event.h"
 
+#include "usbip_proto.h"
 #include "tcp_connect.h"
 #include "usb_handler.h"
+#include "urb_stats.h"
 #include "global.h"
 
 ESP_EVENT_DECLARE_BASE(USBIP_EVENT_BASE);
@@ -25,16 +29,17 @@ ESP_EVENT_DECLARE_BASE(USBIP_EVENT_BASE);
 #define OP_REQ_DEVLIST 0x8005
 #define OP_REQ_IMPORT 0x8003
 
-#define USBIP_CMD_SUBMIT 0x00000001
-#define USBIP_RET_SUBMIT 0x00000003
-
-#define USBIP_CMD_UNLINK 0x00000002
-#define USBIP_RET_UNLINK 0x00000004
-
 /* Reply Codes */
 #define OP_REP_DEVLIST 0x0005
 #define OP_REP_IMPORT 0x0003
 
+/* Session resume, an extension of this server (see usbip_session.h) */
+#define OP_REQ_RESUME 0x80f0
+#define OP_REP_RESUME 0x00f0
+
+/* OP_REQ_IMPORT status asking for op_rep_import_session after a successful reply; stock clients send 0 */
+#define USBIP_IMPORT_WANT_SESSION 0x000080f0
+
 /* When UNLINK is successful, status is -ECONNRESET */
 #define ECONNRESET 104
 
@@ -92,6 +97,19 @@ typedef struct op_req_import_t
     char bus_id[32];
 } __attribute__((packed)) op_req_import;
 
+/* Body following the common header of OP_REQ_RESUME; reply is a bare usbip_header_common */
+typedef struct op_req_resume_t
+{
+    uint32_t session_id;
+    uint32_t last_seqnum;   // Last RET_SUBMIT the client received, in arrival order, not the highest
+} __attribute__((packed)) op_req_resume;
+
+/* Follows a successful OP_REP_IMPORT requested with USBIP_IMPORT_WANT_SESSION */
+typedef struct op_rep_import_session_t
+{
+    uint32_t session_id;    // For OP_REQ_RESUME; 0 when the session cannot be resumed
+} __attribute__((packed)) op_rep_import_session;
+
 typedef struct op_rep_import_t
 {
     uint16_t usbip_version;
@@ -114,15 +132,6 @@ typedef struct op_rep_import_t
 
 } __attribute__((packed)) op_rep_import;
 
-typedef struct usbip_header_basic_t
-{
-    uint32_t command;
-    uint32_t seqnum;
-    uint32_t devid;
-    uint32_t direction;
-    uint32_t ep;
-} __attribute__((packed)) usbip_header_basic;
-
 typedef struct device_desc_t
 {
 
@@ -143,63 +152,6 @@ typedef struct device_desc_t
     // uint8_t bNumConfigurations;         /**< Number of possible configurations */
 } __attribute__((packed)) device_desc;
 
-typedef struct usbip_cmd_submit_t
-{
-    uint32_t transfer_flags;
-    uint32_t transfer_buffer_length;
-
-    uint32_t start_frame;
-    uint32_t number_of_packets;
-    uint32_t interval;
-
-    usb_setup_packet_t setup;
-    uint8_t transfer_buffer[1024];
-} __attribute__((packed)) usbip_cmd_submit;
-
-typedef struct usbip_submit_t
-{
-    // usbip_header_basic base;
-    // uint32_t transfer_flags;
-    // uint32_t transfer_buffer_length;
-
-    // uint32_t start_frame;
-    // uint32_t number_of_packets;
-    // uint32_t interval;
-
-    // usb_setup_packet_t setup;
-    // uint8_t transfer_buffer[1024];
-    usbip_header_basic header;
-    usbip_cmd_submit cmd_submit;
-    int sock;
-} __attribute__((packed)) submit;
-
-typedef struct usbip_ret_submit_t
-{
-    usbip_header_basic base;
-    uint32_t status;
-    uint32_t actual_length;
-    uint32_t start_frame;
-    uint32_t number_of_packets;
-    uint32_t error_count;
-
-    unsigned char padding[8];
-    // device_desc transfer_buffer;
-    uint8_t transfer_buffer[1024];
-} __attribute__((packed)) usbip_ret_submit;
-
-typedef struct usbip_cmd_unlink_t
-{
-    uint32_t unlink_seqnum;
-    unsigned char padding[24];
-} __attribute__((packed)) usbip_cmd_unlink;
-
-typedef struct usbip_ret_unlink_t
-{
-    usbip_header_basic base;
-    uint32_t status;
-    unsigned char padding[24];
-} __attribute__((packed)) usbip_ret_unlink;
-
 /* Initialise USB/IP Server */
 esp_err_t usbip_server_init();
 
@@ -0,0 +1,118 @@
+#ifndef __USBIP_SESSION_H__
+#define __USBIP_SESSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "tcp_connect.h"
+
+/*
+ * Attached USB/IP session that survives a short network drop.
+ *
+ * Every RET_SUBMIT is kept in a replay ring. When the connection is lost
+ * while attached the session enters a grace window: the device stays
+ * claimed, endpoint state is kept and completions are buffered instead of
+ * sent. A client that reconnects within the window and sends OP_REQ_RESUME
+ * with the session id and the seqnum of the last RET_SUBMIT it received
+ * gets every RET_SUBMIT sent after that one replayed in the original order
+ * and continues with CMD_SUBMITs. The id is sent after OP_REP_IMPORT to a
+ * client that asks for it (USBIP_IMPORT_WANT_SESSION). Stock vhci clients
+ * re-import instead, which ends the old session.
+ */
+
+typedef enum
+{
+    USBIP_SESSION_NONE = 0,
+    USBIP_SESSION_ACTIVE,
+    USBIP_SESSION_GRACE
+} usbip_session_state_t;
+
+typedef struct
+{
+    usbip_session_state_t state;
+    uint32_t id;
+    uint32_t buffered;          // RET_SUBMITs held in the replay ring
+    uint32_t buffered_bytes;
+    uint32_t grace_left_ms;
+    uint32_t suspends;
+    uint32_t resumes;
+    uint32_t expired;
+} usbip_session_status_t;
+
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+
+/**
+ * @brief Allocate the replay ring
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t usbip_session_init(void);
+
+/**
+ * @brief Start a new session after a successful import
+ *
+ * Ends a session still in its grace window.
+ *
+ * @param sock Client socket
+ * @return uint32_t Session id to present in OP_REQ_RESUME, 0 if it cannot be resumed
+ */
+uint32_t usbip_session_begin(int sock);
+
+/**
+ * @brief Send a RET_SUBMIT, keeping a copy for replay
+ *
+ * While suspended the PDU is only buffered. Outside a session it is sent
+ * on sock unchanged.
+ *
+ * @param sock Socket the CMD_SUBMIT came from
+ * @param seqnum Host-order seqnum of the PDU
+ * @return int Bytes sent (or buffered), negative on error
+ */
+int usbip_session_send_ret(int sock, const void *data, size_t len, uint32_t seqnum);
+
+/**
+ * @brief The connection of an attached session was lost
+ *
+ * @return true if a grace window was started; endpoint state must be kept
+ */
+bool usbip_session_suspend(void);
+
+/**
+ * @brief The client detached cleanly or the device went away
+ *
+ * A session in its grace window is dropped along with its endpoint state;
+ * it can no longer be resumed.
+ */
+void usbip_session_end(void);
+
+/**
+ * @brief Handle OP_REQ_RESUME on a new connection and send the reply
+ *
+ * @param sock New client socket
+ * @param id Session id from the request
+ * @param last_seqnum Seqnum of the last RET_SUBMIT the client received, in arrival order
+ * @return true if resumed; the connection continues with CMD_SUBMITs
+ */
+bool usbip_session_resume(int sock, uint32_t id, uint32_t last_seqnum);
+
+/**
+ * @brief Current session state for reports
+ */
+void usbip_session_get_status(usbip_session_status_t *out);
+
+#else
+
+static inline esp_err_t usbip_session_init(void) { return ESP_OK; }
+static inline uint32_t usbip_session_begin(int sock) { return 0; }
+static inline int usbip_session_send_ret(int sock, const void *data, size_t len, uint32_t seqnum)
+{
+    return tcp_send_locked(sock, data, len, 0);
+}
+static inline bool usbip_session_suspend(void) { return false; }
+static inline void usbip_session_end(void) {}
+
+#endif // CONFIG_ENABLE_USBIP_RESUME
+
+#endif // __USBIP_SESSION_H__
@@ -0,0 +1,67 @@
+#ifndef __USBMON_H__
+#define __USBMON_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "usb/usb_host.h"
+#include "pcapng.h"
+
+typedef enum
+{
+    USBMON_SUBMIT = 'S',
+    USBMON_COMPLETE = 'C',
+    USBMON_ERROR = 'E',     // Submission rejected by the host library
+} usbmon_event_t;
+
+#ifdef CONFIG_ENABLE_USBMON
+
+/**
+ * @brief Allocate the event ring
+ * 
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t usbmon_init(void);
+
+/**
+ * @brief Record a device-side transfer event
+ * 
+ * Stores a Linux usbmon header plus the first CONFIG_USBMON_DATA_BYTES of
+ * data. Safe to call from the USB client task and the transfer callbacks.
+ * 
+ * @param event Submit, complete or submission error
+ * @param transfer Transfer being submitted or completed
+ * @param urb_id Identifier pairing submit and complete (the USB/IP seqnum)
+ * @param xfer_type usb_transfer_type_t of the endpoint
+ * @param devnum Device address
+ */
+void usbmon_record(usbmon_event_t event, const usb_transfer_t *transfer, uint32_t urb_id,
+                   uint8_t xfer_type, uint8_t devnum);
+
+/**
+ * @brief Write the ring as pcapng with LINKTYPE_USB_LINUX_MMAPPED
+ * 
+ * @param write Sink receiving the file bytes
+ * @param ctx User context for the sink
+ * @return esp_err_t ESP_OK on success, or the sink's error
+ */
+esp_err_t usbmon_export(pcapng_write_fn write, void *ctx);
+
+/**
+ * @brief Drop all recorded events
+ */
+void usbmon_clear(void);
+
+#else
+
+// Stub implementations when usbmon capture is disabled
+static inline esp_err_t usbmon_init(void) { return ESP_OK; }
+static inline void usbmon_record(usbmon_event_t event, const usb_transfer_t *transfer, uint32_t urb_id,
+                                 uint8_t xfer_type, uint8_t devnum)
+{
+    (void)event; (void)transfer; (void)urb_id; (void)xfer_type; (void)devnum;
+}
+
+#endif // CONFIG_ENABLE_USBMON
+
+#endif // __USBMON_H__
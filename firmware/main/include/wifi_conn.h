@@ -0,0 +1,123 @@
+#ifndef __WIFI_CONN_H__
+#define __WIFI_CONN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Station connection policy, kept free of esp_wifi so it can run on the
+ * host against a stand-in wifi_ops_t.
+ *
+ * With a cached AP the station first associates directly with that BSSID
+ * on its channel (one-channel scan, optionally with a static IP so DHCP is
+ * skipped). If that does not bring the link up in time, a full all-channel
+ * scan with the configured IP settings follows. When a whole round fails,
+ * wifi_conn_until_up() backs off (doubling, capped) and starts over.
+ */
+
+/* IPv4 settings in network byte order; ip == 0 means DHCP */
+typedef struct
+{
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_ip_config_t;
+
+/* Last good link; channel == 0 means nothing cached */
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_ip_config_t ip;
+} wifi_cache_t;
+
+typedef enum
+{
+    WIFI_PATH_NONE = 0,
+    WIFI_PATH_FAST,         // Direct association with the cached BSSID/channel
+    WIFI_PATH_SCAN          // Full scan fallback
+} wifi_conn_path_t;
+
+/* Radio and storage primitives; ctx is passed back to every call */
+typedef struct
+{
+    // bssid == NULL selects a full scan for the configured SSID
+    esp_err_t (*set_target)(void *ctx, const uint8_t *bssid, uint8_t channel);
+    // ip == NULL selects DHCP
+    esp_err_t (*set_ip)(void *ctx, const wifi_ip_config_t *ip);
+    esp_err_t (*connect)(void *ctx);
+    // Blocks until the link has an address; fills in what it connected to
+    esp_err_t (*wait)(void *ctx, uint32_t timeout_ms, wifi_cache_t *link);
+    void (*disconnect)(void *ctx);
+    void (*cache_store)(void *ctx, const wifi_cache_t *cache);
+    int64_t (*now_us)(void *ctx);
+    void (*sleep_ms)(void *ctx, uint32_t ms);
+    void *ctx;
+} wifi_ops_t;
+
+typedef struct
+{
+    wifi_ip_config_t static_ip;     // Used on both paths when ip != 0
+    bool reuse_lease;               // Apply the cached lease as static IP on the fast path
+    uint32_t fast_timeout_ms;
+    uint32_t scan_timeout_ms;
+    uint8_t scan_attempts;
+    uint32_t retry_delay_ms;        // Backoff after the first failed round
+    uint32_t retry_max_delay_ms;    // Doubling stops here
+    uint32_t max_rounds;            // 0 retries forever
+} wifi_conn_params_t;
+
+typedef struct
+{
+    wifi_conn_path_t path;
+    uint32_t fast_ms;               // Spent on the direct attempt, 0 if not tried
+    uint32_t total_ms;
+    uint8_t scan_attempts;
+    uint32_t retries;               // Failed rounds (wifi_conn_until_up only)
+    uint32_t backoff_ms;            // Slept between them
+    bool cache_updated;
+    esp_err_t fast_err;             // Why the direct attempt failed
+    wifi_cache_t link;
+} wifi_conn_result_t;
+
+/**
+ * @brief Connect using the cache first, then fall back to scanning
+ *
+ * @param ops Radio primitives
+ * @param params Timeouts and IP policy
+ * @param cache Last good link; updated (and stored through ops) when it changes
+ * @param res Filled with the path taken and timings
+ * @return esp_err_t ESP_OK once the link has an address
+ */
+esp_err_t wifi_conn_run(const wifi_ops_t *ops, const wifi_conn_params_t *params,
+                        wifi_cache_t *cache, wifi_conn_result_t *res);
+
+/**
+ * @brief Delay before retrying after a failed round
+ *
+ * @param params Backoff settings
+ * @param failed Rounds failed so far (>= 1)
+ * @return uint32_t retry_delay_ms doubled per further failure, capped at retry_max_delay_ms
+ */
+uint32_t wifi_conn_backoff_ms(const wifi_conn_params_t *params, uint32_t failed);
+
+/**
+ * @brief Repeat wifi_conn_run() with backoff until the link is up
+ *
+ * total_ms covers every round including the backoff sleeps.
+ *
+ * @param on_retry Optional; called after each failed round with the delay about to be slept
+ * @return esp_err_t ESP_OK once connected, else the last error after max_rounds
+ */
+esp_err_t wifi_conn_until_up(const wifi_ops_t *ops, const wifi_conn_params_t *params,
+                             wifi_cache_t *cache, wifi_conn_result_t *res,
+                             void (*on_retry)(const wifi_conn_result_t *res, uint32_t delay_ms));
+
+/**
+ * @brief Path name for reports
+ */
+const char *wifi_conn_path_name(wifi_conn_path_t path);
+
+#endif // __WIFI_CONN_H__
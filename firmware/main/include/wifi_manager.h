@@ -0,0 +1,51 @@
+#ifndef __WIFI_MANAGER_H__
+#define __WIFI_MANAGER_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "wifi_conn.h"
+
+typedef struct
+{
+    uint32_t connects;              // Successful connections, including reconnects
+    uint32_t fast_hits;             // ... made on the cached BSSID/channel
+    uint32_t scan_fallbacks;        // ... that needed a full scan
+    uint32_t first_connect_ms;
+    uint32_t reconnects;
+    uint32_t last_reconnect_ms;     // Link lost to address back
+    uint32_t max_reconnect_ms;
+    wifi_conn_result_t last;        // Most recent connection
+} wifi_manager_stats_t;
+
+#ifdef CONFIG_ENABLE_WIFI_MANAGER
+
+/**
+ * @brief Start the station and block until it has an address
+ *
+ * Replaces example_connect(). Needs NVS, esp_netif and the default event
+ * loop. Keeps a task running that reconnects (cache first) whenever the
+ * link drops.
+ *
+ * @return esp_err_t ESP_OK once connected
+ */
+esp_err_t wifi_manager_start(void);
+
+/**
+ * @brief Copy the connection statistics
+ */
+void wifi_manager_get_stats(wifi_manager_stats_t *out);
+
+/**
+ * @brief Drop the cached AP and lease; the next connect scans
+ */
+void wifi_manager_forget(void);
+
+#else
+
+static inline void wifi_manager_get_stats(wifi_manager_stats_t *out) { *out = (wifi_manager_stats_t){0}; }
+static inline void wifi_manager_forget(void) {}
+
+#endif // CONFIG_ENABLE_WIFI_MANAGER
+
+#endif // __WIFI_MANAGER_H__
@@ -0,0 +1,70 @@
+#ifndef __WIFI_PS_H__
+#define __WIFI_PS_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+
+#define WIFI_PS_NUM_MODES 3     // WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM
+
+typedef struct
+{
+    uint64_t time_us;           // Time spent in this mode
+    uint32_t entries;           // Times the controller switched into it
+    uint32_t samples;           // Turnarounds measured while in it
+    uint64_t sum_us;
+    uint32_t max_us;
+} wifi_ps_mode_stats_t;
+
+typedef struct
+{
+    wifi_ps_type_t current;
+    wifi_ps_mode_stats_t mode[WIFI_PS_NUM_MODES];
+} wifi_ps_stats_t;
+
+#ifdef CONFIG_ENABLE_WIFI_PS_CONTROL
+
+/**
+ * @brief Start the power-save controller task
+ *
+ * The radio stays in the idle mode until a session is attached and URBs
+ * arrive, then runs with WIFI_PS_NONE until no URB has been seen for
+ * CONFIG_WIFI_PS_IDLE_MS.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t wifi_ps_init(void);
+
+/**
+ * @brief Note an incoming CMD_SUBMIT; wakes the radio if it is sleeping
+ *
+ * Also measures the turnaround since the last RET_SUBMIT, which includes
+ * the time the request waited at the AP for the station to wake up.
+ */
+void wifi_ps_urb_received(void);
+
+/**
+ * @brief Note a RET_SUBMIT handed to the socket
+ */
+void wifi_ps_urb_sent(void);
+
+/**
+ * @brief Copy per-mode time and turnaround statistics
+ */
+void wifi_ps_get_stats(wifi_ps_stats_t *out);
+
+/**
+ * @brief Mode name for reports
+ */
+const char *wifi_ps_mode_name(wifi_ps_type_t mode);
+
+#else
+
+static inline esp_err_t wifi_ps_init(void) { return ESP_OK; }
+static inline void wifi_ps_urb_received(void) {}
+static inline void wifi_ps_urb_sent(void) {}
+
+#endif // CONFIG_ENABLE_WIFI_PS_CONTROL
+
+#endif // __WIFI_PS_H__
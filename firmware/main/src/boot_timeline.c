@@ -0,0 +1,68 @@
+#include "boot_timeline.h"
+#include "log_handler.h"
+#include "esp_timer.h"
+
+#define ATTACHABLE_BITS (BOOT_BIT(BOOT_EV_TCP_LISTENING) | BOOT_BIT(BOOT_EV_DEVICE_READY))
+
+static EventGroupHandle_t boot_events = NULL;
+static int64_t stamps[BOOT_EV_COUNT];
+
+static const char *const names[BOOT_EV_COUNT] = {
+    [BOOT_EV_APP_START]      = "app_start",
+    [BOOT_EV_STORAGE_READY]  = "storage_ready",
+    [BOOT_EV_NET_UP]         = "net_up",
+    [BOOT_EV_WIFI_CONNECTED] = "wifi_connected",
+    [BOOT_EV_USB_HOST_READY] = "usb_host_ready",
+    [BOOT_EV_DEVICE_READY]   = "device_ready",
+    [BOOT_EV_TCP_LISTENING]  = "tcp_listening",
+    [BOOT_EV_HTTP_READY]     = "http_ready",
+    [BOOT_EV_ATTACHABLE]     = "attachable",
+};
+
+void boot_timeline_init(void)
+{
+    for (int i = 0; i < BOOT_EV_COUNT; i++) {
+        stamps[i] = -1;
+    }
+    boot_events = xEventGroupCreate();
+    boot_timeline_mark(BOOT_EV_APP_START);
+}
+
+void boot_timeline_mark(boot_event_t ev)
+{
+    if (boot_events == NULL || ev >= BOOT_EV_COUNT) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    EventBits_t prev = xEventGroupGetBits(boot_events);
+    if (prev & BOOT_BIT(ev)) {
+        return;
+    }
+    stamps[ev] = now;
+    EventBits_t bits = xEventGroupSetBits(boot_events, BOOT_BIT(ev));
+    log_write("[BOOT] %s at %lld us", names[ev], now);
+
+    if ((bits & ATTACHABLE_BITS) == ATTACHABLE_BITS && !(bits & BOOT_BIT(BOOT_EV_ATTACHABLE))) {
+        boot_timeline_mark(BOOT_EV_ATTACHABLE);
+    }
+}
+
+bool boot_timeline_wait(EventBits_t bits, TickType_t timeout)
+{
+    if (boot_events == NULL) {
+        return false;
+    }
+    EventBits_t got = xEventGroupWaitBits(boot_events, bits, pdFALSE, pdTRUE, timeout);
+    return (got & bits) == bits;
+}
+
+int64_t boot_timeline_get(boot_event_t ev)
+{
+    return (ev < BOOT_EV_COUNT) ? stamps[ev] : -1;
+}
+
+const char *boot_timeline_name(boot_event_t ev)
+{
+    return (ev < BOOT_EV_COUNT) ? names[ev] : "?";
+}
@@ -0,0 +1,460 @@
+#include "bot_cache.h"
+#include "log_handler.h"
+#include "usbip_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define BOT_INTF_CLASS      0x08        // Mass storage
+#define BOT_INTF_PROTOCOL   0x50        // Bulk-Only Transport
+
+/* CBW/CSW fields are little-endian like the CPU */
+#define CBW_SIGNATURE       0x43425355  // "USBC"
+#define CSW_SIGNATURE       0x53425355  // "USBS"
+#define CBW_LEN             31
+#define CSW_LEN             13
+#define CBW_FLAG_IN         0x80
+
+#define SCSI_READ_CAPACITY_10   0x25
+#define SCSI_READ_10            0x28
+
+#define PREFETCH_WAIT_MS    2000        // A read-ahead never takes this long unless the device hung
+
+typedef struct
+{
+    uint32_t signature;
+    uint32_t tag;
+    uint32_t data_length;
+    uint8_t flags;
+    uint8_t lun;
+    uint8_t cb_length;
+    uint8_t cb[16];
+} __attribute__((packed)) bot_cbw_t;
+
+typedef struct
+{
+    uint32_t signature;
+    uint32_t tag;
+    uint32_t residue;
+    uint8_t status;
+} __attribute__((packed)) bot_csw_t;
+
+typedef enum
+{
+    PHASE_IDLE = 0,
+    PHASE_PASS,             // The device is executing the host's command
+    PHASE_LOCAL_DATA,       // Answering a cached READ: data URBs
+    PHASE_LOCAL_CSW         // Answering a cached READ: status URB
+} bot_phase_t;
+
+static volatile bool active = false;
+static uint8_t ep_in = 0;               // Endpoint numbers, without the direction bit
+static uint8_t ep_out = 0;
+static uint16_t mps_in = 0;
+static usb_transfer_t *cbw_xfer = NULL;
+static usb_transfer_t *data_xfer = NULL;   // Its buffer is the window
+static usb_transfer_t *csw_xfer = NULL;
+static SemaphoreHandle_t device_free = NULL;   // Held while a read-ahead owns the device
+
+/* Host command in progress */
+static volatile bot_phase_t phase = PHASE_IDLE;
+static bot_cbw_t cur;
+static uint32_t local_pos = 0;
+static uint32_t local_left = 0;
+static uint32_t next_lba = UINT32_MAX;  // Sector after the host's last READ
+static bool prefetch_after = false;     // Read ahead once the passed-through READ completes
+
+/* Read-ahead in progress */
+static uint32_t prefetch_tag = 0;
+static uint32_t prefetch_lba = 0;
+static uint32_t prefetch_count = 0;
+static uint8_t prefetch_lun = 0;
+
+/* Window */
+static volatile uint32_t window_lba = 0;
+static volatile uint32_t window_count = 0;
+static uint8_t window_lun = 0;
+static uint32_t block_size = 0;
+static uint32_t last_lba = 0;
+
+static bot_cache_stats_t stats;
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* Commands that cannot change what is on the medium; anything else empties the window */
+static bool is_read_only(uint8_t opcode)
+{
+    switch (opcode) {
+        case 0x00:  // TEST UNIT READY
+        case 0x03:  // REQUEST SENSE
+        case 0x12:  // INQUIRY
+        case 0x1a:  // MODE SENSE(6)
+        case 0x1e:  // PREVENT ALLOW MEDIUM REMOVAL
+        case 0x23:  // READ FORMAT CAPACITIES
+        case SCSI_READ_CAPACITY_10:
+        case SCSI_READ_10:
+        case 0x35:  // SYNCHRONIZE CACHE(10)
+        case 0x5a:  // MODE SENSE(10)
+        case 0x9e:  // READ CAPACITY(16)
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void invalidate(void)
+{
+    if (window_count != 0) {
+        window_count = 0;
+        stats.invalidations++;
+    }
+}
+
+/* The device may be left in the middle of a command; stop reading ahead on it */
+static void prefetch_fail(const char *stage, int status)
+{
+    log_write("[BOT] Read-ahead of LBA %lu failed at %s (status %d), cache disabled for this device",
+              prefetch_lba, stage, status);
+    stats.prefetch_errors++;
+    active = false;
+    window_count = 0;
+    xSemaphoreGive(device_free);
+}
+
+static void prefetch_csw_cb(usb_transfer_t *transfer)
+{
+    const bot_csw_t *csw = (const bot_csw_t *)transfer->data_buffer;
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED || transfer->actual_num_bytes < CSW_LEN ||
+        csw->signature != CSW_SIGNATURE || csw->tag != prefetch_tag) {
+        prefetch_fail("CSW", transfer->status);
+        return;
+    }
+
+    // A failed READ leaves the window empty; the host's own READ gets the error
+    if (csw->status == 0 && csw->residue == 0 &&
+        data_xfer->actual_num_bytes == prefetch_count * block_size) {
+        window_lba = prefetch_lba;
+        window_lun = prefetch_lun;
+        window_count = prefetch_count;
+        stats.prefetch_sectors += prefetch_count;
+    }
+    xSemaphoreGive(device_free);
+}
+
+static void prefetch_data_cb(usb_transfer_t *transfer)
+{
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+        prefetch_fail("data", transfer->status);
+        return;
+    }
+    esp_err_t err = usb_host_transfer_submit(csw_xfer);
+    if (err != ESP_OK) {
+        prefetch_fail("CSW submit", err);
+    }
+}
+
+static void prefetch_cbw_cb(usb_transfer_t *transfer)
+{
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+        prefetch_fail("CBW", transfer->status);
+        return;
+    }
+    esp_err_t err = usb_host_transfer_submit(data_xfer);
+    if (err != ESP_OK) {
+        prefetch_fail("data submit", err);
+    }
+}
+
+/* Issue READ(10) for the window starting at lba; runs on its own through the callbacks */
+static void prefetch_start(uint32_t lba, uint8_t lun)
+{
+    if (!active || block_size == 0 || lba > last_lba) {
+        return;
+    }
+    uint32_t count = CONFIG_BOT_CACHE_SIZE / block_size;
+    if (count > last_lba - lba + 1) {
+        count = last_lba - lba + 1;
+    }
+    if (count == 0 || xSemaphoreTake(device_free, 0) != pdTRUE) {
+        return;
+    }
+
+    window_count = 0;
+    prefetch_lba = lba;
+    prefetch_count = count;
+    prefetch_lun = lun;
+
+    bot_cbw_t *cbw = (bot_cbw_t *)cbw_xfer->data_buffer;
+    memset(cbw, 0, CBW_LEN);
+    cbw->signature = CBW_SIGNATURE;
+    cbw->tag = ++prefetch_tag;
+    cbw->data_length = count * block_size;
+    cbw->flags = CBW_FLAG_IN;
+    cbw->lun = lun;
+    cbw->cb_length = 10;
+    cbw->cb[0] = SCSI_READ_10;
+    put_be32(&cbw->cb[2], lba);
+    cbw->cb[7] = count >> 8;
+    cbw->cb[8] = count;
+    cbw_xfer->num_bytes = CBW_LEN;
+    data_xfer->num_bytes = usb_round_up_to_mps(count * block_size, mps_in);
+    csw_xfer->num_bytes = usb_round_up_to_mps(CSW_LEN, mps_in);
+
+    stats.prefetches++;
+    esp_err_t err = usb_host_transfer_submit(cbw_xfer);
+    if (err != ESP_OK) {
+        prefetch_fail("CBW submit", err);
+    }
+}
+
+/* A new CBW from the host; true if the whole command is answered from the window */
+static bool command(const bot_cbw_t *cbw, usbip_ret_desc_t *ret)
+{
+    cur = *cbw;
+    phase = PHASE_PASS;
+    prefetch_after = false;
+
+    if (cbw->cb[0] != SCSI_READ_10) {
+        if (!is_read_only(cbw->cb[0])) {
+            invalidate();
+        }
+        return false;
+    }
+
+    uint32_t lba = get_be32(&cbw->cb[2]);
+    uint32_t count = ((uint32_t)cbw->cb[7] << 8) | cbw->cb[8];
+    uint32_t bytes = count * block_size;
+    bool sequential = (lba == next_lba);
+    next_lba = lba + count;
+
+    if (block_size != 0 && count != 0 && window_count != 0 &&
+        cbw->lun == window_lun && (cbw->flags & CBW_FLAG_IN) && cbw->data_length == bytes &&
+        bytes <= USBIP_MAX_TRANSFER_SIZE &&
+        lba >= window_lba && lba + count <= window_lba + window_count) {
+        local_pos = (lba - window_lba) * block_size;
+        local_left = bytes;
+        phase = PHASE_LOCAL_DATA;
+        stats.hits++;
+        ret->actual_length = CBW_LEN;
+        return true;
+    }
+
+    stats.misses++;
+    prefetch_after = sequential;
+    return false;
+}
+
+static void wait_device_free(void)
+{
+    if (xSemaphoreTake(device_free, pdMS_TO_TICKS(PREFETCH_WAIT_MS)) != pdTRUE) {
+        log_write("[BOT] Read-ahead did not finish, cache disabled for this device");
+        active = false;
+        window_count = 0;
+        return;
+    }
+    xSemaphoreGive(device_free);
+}
+
+void bot_cache_attach(usb_device_handle_t dev, const usb_config_desc_t *config)
+{
+    uint16_t out_mps = 0;
+    int intf_num = -1;
+
+    for (int i = 0; i < config->bNumInterfaces && intf_num < 0; i++) {
+        int offset = 0;
+        const usb_intf_desc_t *intf = usb_parse_interface_descriptor(config, i, 0, &offset);
+        if (intf == NULL || intf->bInterfaceClass != BOT_INTF_CLASS ||
+            intf->bInterfaceProtocol != BOT_INTF_PROTOCOL) {
+            continue;
+        }
+        ep_in = ep_out = 0;
+        for (int e = 0; e < intf->bNumEndpoints; e++) {
+            int ep_offset = offset;
+            const usb_ep_desc_t *ep = usb_parse_endpoint_descriptor_by_index(intf, e, config->wTotalLength, &ep_offset);
+            if (ep == NULL || USB_EP_DESC_GET_XFERTYPE(ep) != USB_TRANSFER_TYPE_BULK) {
+                continue;
+            }
+            if (USB_EP_DESC_GET_EP_DIR(ep)) {
+                ep_in = USB_EP_DESC_GET_EP_NUM(ep);
+                mps_in = USB_EP_DESC_GET_MPS(ep);
+            } else {
+                ep_out = USB_EP_DESC_GET_EP_NUM(ep);
+                out_mps = USB_EP_DESC_GET_MPS(ep);
+            }
+        }
+        if (ep_in != 0 && ep_out != 0) {
+            intf_num = i;
+        }
+    }
+    if (intf_num < 0) {
+        ep_in = ep_out = 0;
+        return;
+    }
+
+    if (device_free == NULL) {
+        device_free = xSemaphoreCreateBinary();
+        if (device_free == NULL) {
+            ep_in = ep_out = 0;
+            return;
+        }
+        xSemaphoreGive(device_free);
+    }
+    if (usb_host_transfer_alloc(usb_round_up_to_mps(CBW_LEN, out_mps), 0, &cbw_xfer) != ESP_OK ||
+        usb_host_transfer_alloc(usb_round_up_to_mps(CONFIG_BOT_CACHE_SIZE, mps_in), 0, &data_xfer) != ESP_OK ||
+        usb_host_transfer_alloc(usb_round_up_to_mps(CSW_LEN, mps_in), 0, &csw_xfer) != ESP_OK) {
+        log_write_err("[BOT] ERROR: Failed to allocate %d byte read-ahead window", CONFIG_BOT_CACHE_SIZE);
+        bot_cache_detach();
+        return;
+    }
+    usb_transfer_t *xfers[] = { cbw_xfer, data_xfer, csw_xfer };
+    usb_transfer_cb_t cbs[] = { prefetch_cbw_cb, prefetch_data_cb, prefetch_csw_cb };
+    for (int i = 0; i < 3; i++) {
+        xfers[i]->device_handle = dev;
+        xfers[i]->bEndpointAddress = (i == 0) ? ep_out : (ep_in | 0x80);
+        xfers[i]->callback = cbs[i];
+        xfers[i]->context = NULL;
+    }
+
+    phase = PHASE_IDLE;
+    next_lba = UINT32_MAX;
+    window_count = 0;
+    block_size = 0;
+    last_lba = 0;
+    active = true;
+    log_write("[BOT] Mass storage on interface %d (bulk IN 0x%02x, OUT 0x%02x), %d byte read-ahead window",
+              intf_num, ep_in | 0x80, ep_out, CONFIG_BOT_CACHE_SIZE);
+}
+
+void bot_cache_detach(void)
+{
+    active = false;
+    window_count = 0;
+    phase = PHASE_IDLE;
+    ep_in = ep_out = 0;
+    usb_transfer_t **xfers[] = { &cbw_xfer, &data_xfer, &csw_xfer };
+    for (int i = 0; i < 3; i++) {
+        if (*xfers[i] != NULL) {
+            usb_host_transfer_free(*xfers[i]);
+            *xfers[i] = NULL;
+        }
+    }
+    if (device_free != NULL) {
+        // A read-ahead cut short by the unplug may not have handed the device back
+        xSemaphoreGive(device_free);
+    }
+}
+
+bool bot_cache_submit(const usbip_submit_desc_t *cmd, uint8_t *data, usbip_ret_desc_t *ret)
+{
+    if (!active) {
+        return false;
+    }
+
+    uint32_t ep = cmd->ep & 0x0F;
+    bool in = cmd->direction != 0;
+    uint32_t len = cmd->transfer_buffer_length;
+
+    if (ep == 0) {
+        // Bulk-Only Mass Storage Reset or CLEAR_FEATURE(ENDPOINT_HALT): the host is recovering
+        const usb_setup_packet_t *setup = &cmd->setup;
+        if ((setup->bmRequestType == 0x21 && setup->bRequest == 0xff) ||
+            (setup->bmRequestType == 0x02 && setup->bRequest == 0x01)) {
+            phase = PHASE_IDLE;
+            invalidate();
+        }
+        return false;
+    }
+
+    if (ep == ep_out && !in) {
+        const bot_cbw_t *cbw = (const bot_cbw_t *)data;
+        if (len != CBW_LEN || cbw->signature != CBW_SIGNATURE) {
+            return false;
+        }
+        wait_device_free();
+        return active && command(cbw, ret);
+    }
+
+    if (ep == ep_in && in && phase == PHASE_LOCAL_DATA) {
+        uint32_t n = (len < local_left) ? len : local_left;
+        memcpy(data, data_xfer->data_buffer + local_pos, n);
+        local_pos += n;
+        local_left -= n;
+        ret->actual_length = n;
+        stats.bytes_served += n;
+        if (local_left == 0) {
+            phase = PHASE_LOCAL_CSW;
+        }
+        return true;
+    }
+
+    if (ep == ep_in && in && phase == PHASE_LOCAL_CSW && len >= CSW_LEN) {
+        bot_csw_t csw = {
+            .signature = CSW_SIGNATURE,
+            .tag = cur.tag,
+            .residue = 0,
+            .status = 0,
+        };
+        memcpy(data, &csw, CSW_LEN);
+        ret->actual_length = CSW_LEN;
+        phase = PHASE_IDLE;
+        // Window used up by a sequential reader: fetch the next one
+        if (next_lba == window_lba + window_count) {
+            prefetch_start(next_lba, cur.lun);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void bot_cache_complete(const usb_transfer_t *transfer)
+{
+    if (!active || phase != PHASE_PASS || transfer->status != USB_TRANSFER_STATUS_COMPLETED ||
+        transfer->bEndpointAddress != (ep_in | 0x80)) {
+        return;
+    }
+
+    const uint8_t *data = transfer->data_buffer;
+    const bot_csw_t *csw = (const bot_csw_t *)data;
+    if (transfer->actual_num_bytes == CSW_LEN && csw->signature == CSW_SIGNATURE && csw->tag == cur.tag) {
+        phase = PHASE_IDLE;
+        if (csw->status != 0) {
+            // Medium changed, or the READ failed; start over
+            invalidate();
+        } else if (prefetch_after) {
+            prefetch_start(next_lba, cur.lun);
+        }
+        return;
+    }
+
+    if (cur.cb[0] == SCSI_READ_CAPACITY_10 && transfer->actual_num_bytes >= 8) {
+        uint32_t size = get_be32(&data[4]);
+        if (size != block_size || get_be32(data) != last_lba) {
+            invalidate();
+        }
+        last_lba = get_be32(data);
+        block_size = size;
+        log_write("[BOT] Capacity: %lu blocks of %lu bytes", last_lba + 1, block_size);
+    }
+}
+
+void bot_cache_get_stats(bot_cache_stats_t *out)
+{
+    *out = stats;
+    out->active = active;
+    out->block_size = block_size;
+    out->last_lba = last_lba;
+    out->window_lba = window_lba;
+    out->window_count = window_count;
+}
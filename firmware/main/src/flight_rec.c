@@ -0,0 +1,142 @@
+#include "flight_rec.h"
+#include "log_handler.h"
+#include "mem_policy.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRIES         CONFIG_FLIGHT_REC_ENTRIES
+#define FLIGHT_MAGIC    0x464C5431  // "FLT1"
+
+typedef struct
+{
+    uint32_t magic;
+    flight_event_t events[ENTRIES];
+} flight_ring_t;
+
+static const char *TAG = "FLIGHT_REC";
+
+/* Left untouched by the bootloader and startup code across software, panic and watchdog resets */
+static RTC_NOINIT_ATTR flight_ring_t ring;
+
+/* Kept in DRAM where atomics are supported; after a reset it is rebuilt from the slot indexes */
+static uint32_t head = 0;
+
+static flight_event_t *crash_events = NULL;
+static size_t crash_count = 0;
+static const char *crash_reason = NULL;
+
+static const char *const event_names[FLIGHT_EV_COUNT] = {
+    [FLIGHT_EV_URB_RECV]          = "urb_recv",
+    [FLIGHT_EV_URB_SUBMIT]        = "urb_submit",
+    [FLIGHT_EV_URB_COMPLETE]      = "urb_complete",
+    [FLIGHT_EV_URB_SENT]          = "urb_sent",
+    [FLIGHT_EV_URB_UNLINK]        = "urb_unlink",
+    [FLIGHT_EV_CLIENT_CONNECT]    = "client_connect",
+    [FLIGHT_EV_CLIENT_DISCONNECT] = "client_disconnect",
+    [FLIGHT_EV_DEV_CONNECT]       = "dev_connect",
+    [FLIGHT_EV_DEV_GONE]          = "dev_gone",
+};
+
+/* Resets worth a post-mortem; NULL for power-on, deep sleep and requested restarts */
+static const char *abnormal_reset_name(esp_reset_reason_t reason)
+{
+    switch (reason) {
+        case ESP_RST_PANIC:      return "PANIC/EXCEPTION";
+        case ESP_RST_INT_WDT:    return "INTERRUPT_WATCHDOG";
+        case ESP_RST_TASK_WDT:   return "TASK_WATCHDOG";
+        case ESP_RST_WDT:        return "OTHER_WATCHDOG";
+        case ESP_RST_BROWNOUT:   return "BROWNOUT";
+        default:                 return NULL;
+    }
+}
+
+/* Copies the consistent part of the previous run's ring to the heap, oldest first */
+static void save_crash(const char *reason)
+{
+    // The newest finished event has the highest index; a slot is valid only
+    // if it holds the index that belongs in it within the last ENTRIES events
+    uint32_t last = 0;
+    for (int i = 0; i < ENTRIES; i++) {
+        uint32_t index = ring.events[i].index;
+        if (index != 0 && (index - 1) % ENTRIES == i && index > last) {
+            last = index;
+        }
+    }
+    uint32_t first = (last > ENTRIES) ? last - ENTRIES + 1 : 1;
+
+    crash_events = mem_alloc(MEM_USE_LOG, ENTRIES * sizeof(flight_event_t));
+    if (crash_events == NULL) {
+        return;
+    }
+    for (uint32_t index = first; last != 0 && index <= last; index++) {
+        const flight_event_t *ev = &ring.events[(index - 1) % ENTRIES];
+        // Skip slots that were claimed but not finished when the reset hit
+        if (ev->index == index && ev->type < FLIGHT_EV_COUNT) {
+            crash_events[crash_count++] = *ev;
+        }
+    }
+    crash_reason = reason;
+}
+
+void flight_rec_init(void)
+{
+    const char *reason = abnormal_reset_name(esp_reset_reason());
+
+    if (ring.magic == FLIGHT_MAGIC && reason != NULL) {
+        save_crash(reason);
+        ESP_LOGW(TAG, "Reset by %s, %u event(s) recorded before it", reason, crash_count);
+    }
+
+    // RTC memory holds garbage after power-on, so always start a clean ring
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = FLIGHT_MAGIC;
+}
+
+void flight_rec_log_crash(void)
+{
+    if (crash_reason == NULL) {
+        return;
+    }
+
+    log_write("[FLIGHT] ===== Last %u event(s) before %s reset =====", crash_count, crash_reason);
+    char line[128];
+    for (size_t i = 0; i < crash_count; i++) {
+        flight_rec_format(&crash_events[i], line, sizeof(line));
+        log_write("[FLIGHT] %s", line);
+    }
+    log_write("[FLIGHT] ===== End of flight record =====");
+}
+
+void flight_rec_event(flight_event_type_t type, uint32_t seqnum, uint8_t ep, int32_t arg)
+{
+    uint32_t i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    flight_event_t *ev = &ring.events[i % ENTRIES];
+
+    ev->index = 0;
+    ev->ts_ms = esp_timer_get_time() / 1000;
+    ev->seqnum = seqnum;
+    ev->arg = arg;
+    ev->heap_free = esp_get_free_heap_size();
+    ev->type = type;
+    ev->ep = ep;
+    __atomic_store_n(&ev->index, i + 1, __ATOMIC_RELEASE);
+}
+
+const flight_event_t *flight_rec_get_crash(size_t *count, const char **reason)
+{
+    *count = crash_count;
+    *reason = crash_reason;
+    return crash_reason ? crash_events : NULL;
+}
+
+int flight_rec_format(const flight_event_t *ev, char *buf, size_t len)
+{
+    const char *name = (ev->type < FLIGHT_EV_COUNT) ? event_names[ev->type] : "?";
+    return snprintf(buf, len, "%10lu ms %-17s seq=%-8lu ep=%-2u arg=%-6ld heap=%lu",
+                    ev->ts_ms, name, ev->seqnum, ev->ep, ev->arg, ev->heap_free);
+}
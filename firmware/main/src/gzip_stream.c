@@ -0,0 +1,253 @@
+#include "gzip_stream.h"
+#include "mem_policy.h"
+#include "esp_rom_crc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define BUF_SIZE    (2 * GZIP_WINDOW_SIZE)
+#define HASH_BITS   10
+#define HASH_SIZE   (1 << HASH_BITS)
+#define MIN_MATCH   3
+#define MAX_MATCH   258
+#define OUT_SIZE    512
+
+struct gzip_stream
+{
+    gzip_out_fn out;
+    void *ctx;
+    esp_err_t err;
+
+    uint8_t buf[BUF_SIZE];      // Window history followed by pending input
+    uint16_t head[HASH_SIZE];   // Last position + 1 per hash, 0 for none
+    uint32_t fill;              // Bytes held in buf
+    uint32_t pos;               // Next byte to encode
+
+    uint32_t crc;
+    uint32_t isize;
+
+    uint32_t bit_buf;
+    uint32_t bit_count;
+    uint8_t out_buf[OUT_SIZE];
+    size_t out_len;
+};
+
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void out_flush(gzip_stream_t *gz)
+{
+    if (gz->out_len > 0 && gz->err == ESP_OK) {
+        gz->err = gz->out(gz->out_buf, gz->out_len, gz->ctx);
+    }
+    gz->out_len = 0;
+}
+
+static inline void out_byte(gzip_stream_t *gz, uint8_t b)
+{
+    gz->out_buf[gz->out_len++] = b;
+    if (gz->out_len == OUT_SIZE) {
+        out_flush(gz);
+    }
+}
+
+/* Deflate packs bits LSB first */
+static inline void put_bits(gzip_stream_t *gz, uint32_t value, uint32_t n)
+{
+    gz->bit_buf |= value << gz->bit_count;
+    gz->bit_count += n;
+    while (gz->bit_count >= 8) {
+        out_byte(gz, gz->bit_buf & 0xFF);
+        gz->bit_buf >>= 8;
+        gz->bit_count -= 8;
+    }
+}
+
+/* Huffman codes are defined MSB first, so they go out reversed */
+static inline void put_code(gzip_stream_t *gz, uint32_t code, uint32_t n)
+{
+    uint32_t rev = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        rev = (rev << 1) | ((code >> i) & 1);
+    }
+    put_bits(gz, rev, n);
+}
+
+/* Fixed literal/length code (RFC 1951 3.2.6) */
+static void put_symbol(gzip_stream_t *gz, uint32_t sym)
+{
+    if (sym < 144) {
+        put_code(gz, 0x30 + sym, 8);
+    } else if (sym < 256) {
+        put_code(gz, 0x190 + sym - 144, 9);
+    } else if (sym < 280) {
+        put_code(gz, sym - 256, 7);
+    } else {
+        put_code(gz, 0xC0 + sym - 280, 8);
+    }
+}
+
+static void put_match(gzip_stream_t *gz, uint32_t len, uint32_t dist)
+{
+    int lc = 28;
+    while (len_base[lc] > len) {
+        lc--;
+    }
+    put_symbol(gz, 257 + lc);
+    put_bits(gz, len - len_base[lc], len_extra[lc]);
+
+    int dc = 29;
+    while (dist_base[dc] > dist) {
+        dc--;
+    }
+    put_code(gz, dc, 5);
+    put_bits(gz, dist - dist_base[dc], dist_extra[dc]);
+}
+
+/* Multiplicative hash; the top bits depend on all three bytes */
+static inline uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Encodes buffered input, keeping MAX_MATCH bytes of lookahead unless finishing */
+static void encode(gzip_stream_t *gz, bool finish)
+{
+    uint32_t limit = finish ? gz->fill : gz->fill - MAX_MATCH;
+
+    while (gz->pos < limit) {
+        uint32_t p = gz->pos;
+        uint32_t best = 0;
+        uint32_t dist = 0;
+
+        if (p + MIN_MATCH <= gz->fill) {
+            uint32_t h = hash3(&gz->buf[p]);
+            uint32_t cand = gz->head[h];
+            gz->head[h] = p + 1;
+
+            if (cand != 0) {
+                cand--;
+                dist = p - cand;
+                if (dist <= GZIP_WINDOW_SIZE) {
+                    uint32_t max = gz->fill - p;
+                    if (max > MAX_MATCH) {
+                        max = MAX_MATCH;
+                    }
+                    while (best < max && gz->buf[cand + best] == gz->buf[p + best]) {
+                        best++;
+                    }
+                }
+            }
+        }
+
+        if (best >= MIN_MATCH) {
+            put_match(gz, best, dist);
+            for (uint32_t i = 1; i < best && p + i + MIN_MATCH <= gz->fill; i++) {
+                gz->head[hash3(&gz->buf[p + i])] = p + i + 1;
+            }
+            gz->pos += best;
+        } else {
+            put_symbol(gz, gz->buf[p]);
+            gz->pos++;
+        }
+    }
+}
+
+/* Drops the oldest half of the buffer once it is only needed as history */
+static void slide(gzip_stream_t *gz)
+{
+    memmove(gz->buf, gz->buf + GZIP_WINDOW_SIZE, gz->fill - GZIP_WINDOW_SIZE);
+    gz->fill -= GZIP_WINDOW_SIZE;
+    gz->pos -= GZIP_WINDOW_SIZE;
+    for (int i = 0; i < HASH_SIZE; i++) {
+        gz->head[i] = (gz->head[i] > GZIP_WINDOW_SIZE) ? gz->head[i] - GZIP_WINDOW_SIZE : 0;
+    }
+}
+
+gzip_stream_t *gzip_stream_create(gzip_out_fn out, void *ctx)
+{
+    gzip_stream_t *gz = mem_calloc(MEM_USE_HTTP, 1, sizeof(gzip_stream_t));
+    if (gz == NULL) {
+        return NULL;
+    }
+    gz->out = out;
+    gz->ctx = ctx;
+
+    // Member header: deflate, no flags, no mtime, unknown OS
+    static const uint8_t header[10] = { 0x1F, 0x8B, 0x08, 0, 0, 0, 0, 0, 0, 0xFF };
+    for (int i = 0; i < sizeof(header); i++) {
+        out_byte(gz, header[i]);
+    }
+
+    // One open-ended fixed-Huffman block, closed by an empty final block
+    put_bits(gz, 0, 1);
+    put_bits(gz, 1, 2);
+    return gz;
+}
+
+esp_err_t gzip_stream_write(gzip_stream_t *gz, const void *data, size_t len)
+{
+    const uint8_t *src = (const uint8_t *)data;
+
+    gz->crc = esp_rom_crc32_le(gz->crc, src, len);
+    gz->isize += len;
+
+    while (len > 0 && gz->err == ESP_OK) {
+        size_t n = BUF_SIZE - gz->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&gz->buf[gz->fill], src, n);
+        gz->fill += n;
+        src += n;
+        len -= n;
+
+        if (gz->fill == BUF_SIZE) {
+            encode(gz, false);
+            slide(gz);
+        }
+    }
+    return gz->err;
+}
+
+esp_err_t gzip_stream_finish(gzip_stream_t *gz)
+{
+    encode(gz, true);
+    put_symbol(gz, 256);
+
+    put_bits(gz, 1, 1);
+    put_bits(gz, 1, 2);
+    put_symbol(gz, 256);
+    if (gz->bit_count > 0) {
+        put_bits(gz, 0, 8 - gz->bit_count);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        out_byte(gz, (gz->crc >> (8 * i)) & 0xFF);
+    }
+    for (int i = 0; i < 4; i++) {
+        out_byte(gz, (gz->isize >> (8 * i)) & 0xFF);
+    }
+    out_flush(gz);
+    return gz->err;
+}
+
+void gzip_stream_free(gzip_stream_t *gz)
+{
+    mem_free(MEM_USE_HTTP, gz);
+}
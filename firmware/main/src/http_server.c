@@ -1,38 +1,446 @@
 #include "http_server.h"
 #include "log_handler.h"
+#include "urb_stats.h"
+#include "log_stream.h"
+#include "log_index.h"
+#include "gzip_stream.h"
+#include "usbip_capture.h"
+#include "usbmon.h"
+#include "profiler.h"
+#include "flight_rec.h"
+#include "boot_timeline.h"
+#include "wifi_manager.h"
+#include "wifi_ps.h"
+#include "usbip_session.h"
+#include "mem_policy.h"
+#include "mem_pressure.h"
+#include "bot_cache.h"
+#include "urb_budget.h"
+#include "session_arena.h"
+#include "urb_ledger.h"
+#include "urb_watchdog.h"
+#include "usbip_server.h"
 #include <esp_http_server.h>
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include <string.h>
+#include <stdlib.h>
 #include <esp_system.h>
 
 static const char *TAG = "HTTP_SERVER";
 static httpd_handle_t server = NULL;
 
-/* HTTP GET handler for /logs endpoint */
+/* Chunked response body, gzip-compressed when the client accepts it */
+typedef struct
+{
+    httpd_req_t *req;
+#ifdef CONFIG_ENABLE_GZIP
+    gzip_stream_t *gz;
+#endif
+} log_out_t;
+
+#ifdef CONFIG_ENABLE_GZIP
+static esp_err_t gzip_send_chunk(const uint8_t *data, size_t len, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len);
+}
+#endif
+
+/* Must be called before the first chunk so Content-Encoding can still be set */
+static void log_out_begin(log_out_t *out, httpd_req_t *req, bool allow_gzip)
+{
+    out->req = req;
+#ifdef CONFIG_ENABLE_GZIP
+    out->gz = NULL;
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    
+    char accept[128];
+    if (allow_gzip &&
+        httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) == ESP_OK &&
+        strstr(accept, "gzip") != NULL) {
+        out->gz = gzip_stream_create(gzip_send_chunk, req);
+        if (out->gz != NULL) {
+            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        } else {
+            ESP_LOGW(TAG, "No memory for gzip, sending uncompressed");
+        }
+    }
+#endif
+}
+
+/* Sends one piece of the log; ctx is a log_out_t */
+static esp_err_t send_log_chunk(const char *data, size_t len, void *ctx)
+{
+    log_out_t *out = (log_out_t *)ctx;
+#ifdef CONFIG_ENABLE_GZIP
+    if (out->gz != NULL) {
+        return gzip_stream_write(out->gz, data, len);
+    }
+#endif
+    return httpd_resp_send_chunk(out->req, data, len);
+}
+
+/* Flushes the encoder and terminates the chunked response */
+static esp_err_t log_out_end(log_out_t *out, esp_err_t ret)
+{
+#ifdef CONFIG_ENABLE_GZIP
+    if (out->gz != NULL) {
+        if (ret == ESP_OK) {
+            ret = gzip_stream_finish(out->gz);
+        }
+        gzip_stream_free(out->gz);
+        out->gz = NULL;
+    }
+#endif
+    if (ret != ESP_OK) {
+        // Client went away; the connection is closed by returning an error
+        return ret;
+    }
+    return httpd_resp_send_chunk(out->req, NULL, 0);
+}
+
+/* Finds the offset where the last `lines` lines in [first, end) start */
+static size_t find_tail_offset(size_t first, size_t end, unsigned long lines)
+{
+    char block[256];
+    size_t pos = end;
+    
+    // The final newline terminates the last line, it does not start a new one
+    unsigned long newlines = 0;
+    bool skip_trailing = true;
+    
+    while (pos > first) {
+        size_t step = (pos - first < sizeof(block)) ? pos - first : sizeof(block);
+        size_t got = log_read(pos - step, block, step);
+        if (got != step) {
+            return first;
+        }
+        for (size_t i = step; i > 0; i--) {
+            if (block[i - 1] != '\n') {
+                skip_trailing = false;
+                continue;
+            }
+            if (skip_trailing) {
+                skip_trailing = false;
+                continue;
+            }
+            if (++newlines == lines) {
+                return pos - step + i;
+            }
+        }
+        pos -= step;
+    }
+    return first;
+}
+
+/* Parses "bytes=a-b", "bytes=a-" and "bytes=-n" against stored offsets [first, size) */
+static bool parse_range(const char *hdr, size_t first_stored, size_t size, size_t *start, size_t *end)
+{
+    if (strncmp(hdr, "bytes=", 6) != 0 || size <= first_stored) {
+        return false;
+    }
+    const char *p = hdr + 6;
+    char *dash;
+    
+    if (*p == '-') {
+        unsigned long suffix = strtoul(p + 1, NULL, 10);
+        if (suffix == 0) {
+            return false;
+        }
+        *start = (suffix >= size - first_stored) ? first_stored : size - suffix;
+        *end = size;
+        return true;
+    }
+    
+    unsigned long first = strtoul(p, &dash, 10);
+    if (dash == p || *dash != '-' || first >= size) {
+        return false;
+    }
+    unsigned long last = size - 1;
+    if (*(dash + 1) != '\0') {
+        last = strtoul(dash + 1, NULL, 10);
+        if (last < first) {
+            return false;
+        }
+        if (last >= size) {
+            last = size - 1;
+        }
+    }
+    if (last < first_stored) {
+        return false;
+    }
+    *start = (first < first_stored) ? first_stored : first;
+    *end = last + 1;
+    return true;
+}
+
+/* Answers 503 instead of starting a download while free heap is low */
+static bool refuse_under_pressure(httpd_req_t *req)
+{
+    if (mem_pressure_tier() < MEM_PRESSURE_SHED) {
+        return false;
+    }
+    mem_pressure_note_drop(MEM_PRESSURE_DROP_HTTP);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    httpd_resp_sendstr(req, "Low on memory, try again later\n");
+    return true;
+}
+
+/* HTTP GET handler for /logs endpoint
+ *
+ * The log is streamed from a small buffer in chunks so memory use does not
+ * depend on the log size. Supported selectors:
+ *   ?tail=N        - only the last N lines
+ *   ?since=OFFSET  - only bytes written after OFFSET (see X-Log-Size)
+ *   Range: bytes=  - a single byte range, answered with 206
+ *
+ * Sent gzip-encoded when Accept-Encoding allows it and no Range was asked for.
+ */
 static esp_err_t logs_get_handler(httpd_req_t *req)
 {
+    if (refuse_under_pressure(req)) {
+        return ESP_OK;
+    }
     httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
     
     size_t log_size = log_get_size();
+    size_t log_first = log_get_start_offset();
+    size_t start = log_first;
+    size_t end = log_size;
     
-    if (log_size == 0) {
-        const char *empty = "(No logs)\n";
-        return httpd_resp_send(req, empty, strlen(empty));
+    char query[64];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            start = strtoul(value, NULL, 10);
+            if (start > log_size || start < log_first) {
+                // The log was cleared or wrapped since the client's last poll
+                start = log_first;
+            }
+        }
+        if (httpd_query_key_value(query, "tail", value, sizeof(value)) == ESP_OK) {
+            size_t tail_start = find_tail_offset(log_first, log_size, strtoul(value, NULL, 10));
+            if (tail_start > start) {
+                start = tail_start;
+            }
+        }
     }
     
-    // Allocate temporary buffer for log data
-    char *log_buffer = malloc(log_size + 1);
-    if (log_buffer == NULL) {
-        const char *error = "Error: Failed to allocate memory for logs\n";
-        return httpd_resp_send(req, error, strlen(error));
+    char range[48];
+    char content_range[64];
+    bool ranged = httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) == ESP_OK;
+    if (ranged) {
+        if (!parse_range(range, log_first, log_size, &start, &end)) {
+            snprintf(content_range, sizeof(content_range), "bytes */%u", log_size);
+            httpd_resp_set_status(req, HTTPD_416);
+            httpd_resp_set_hdr(req, "Content-Range", content_range);
+            return httpd_resp_send(req, NULL, 0);
+        }
+        snprintf(content_range, sizeof(content_range), "bytes %u-%u/%u", start, end - 1, log_size);
+        httpd_resp_set_status(req, HTTPD_206);
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
     }
     
-    size_t bytes_read = log_get_buffer(log_buffer, log_size + 1);
-    esp_err_t ret = httpd_resp_send(req, log_buffer, bytes_read);
+    // Lets clients poll with ?since= for new data only
+    char size_hdr[16];
+    snprintf(size_hdr, sizeof(size_hdr), "%u", end);
+    httpd_resp_set_hdr(req, "X-Log-Size", size_hdr);
+    
+    if (log_size == log_first) {
+        const char *empty = "(No logs)\n";
+        return httpd_resp_send(req, empty, strlen(empty));
+    }
     
-    free(log_buffer);
+    // Byte ranges refer to the uncompressed log, so they are never gzipped
+    log_out_t out;
+    log_out_begin(&out, req, !ranged);
+    esp_err_t ret = log_foreach_chunk(start, end, send_log_chunk, &out);
+    return log_out_end(&out, ret);
+}
+
+#ifdef CONFIG_ENABLE_LOG_QUERY
+#define QUERY_LINE_MAX 512
+
+typedef struct
+{
+    log_out_t resp;
+    char tag[40];           // "[TAG]" prefix, empty for any
+    size_t tag_len;
+    char grep[64];          // Substring, empty for any
+    char line[QUERY_LINE_MAX + 1];
+    size_t line_len;
+    char out[1024];
+    size_t out_len;
+    esp_err_t err;
+} log_query_t;
+
+/* Decodes %XX and '+' in place */
+static void url_decode(char *str)
+{
+    char *out = str;
+    for (char *in = str; *in; in++) {
+        if (*in == '%' && in[1] && in[2]) {
+            char hex[3] = { in[1], in[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else if (*in == '+') {
+            *out++ = ' ';
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+static esp_err_t query_flush(log_query_t *q)
+{
+    if (q->out_len > 0 && q->err == ESP_OK) {
+        q->err = send_log_chunk(q->out, q->out_len, &q->resp);
+    }
+    q->out_len = 0;
+    return q->err;
+}
+
+static void query_match_line(log_query_t *q)
+{
+    q->line[q->line_len] = '\0';
+    if (q->tag_len > 0 && strncmp(q->line, q->tag, q->tag_len) != 0) {
+        return;
+    }
+    if (q->grep[0] != '\0' && strstr(q->line, q->grep) == NULL) {
+        return;
+    }
+    if (q->out_len + q->line_len > sizeof(q->out)) {
+        query_flush(q);
+    }
+    memcpy(&q->out[q->out_len], q->line, q->line_len);
+    q->out_len += q->line_len;
+}
+
+/* Splits the scanned bytes into lines and filters them */
+static esp_err_t query_chunk_cb(const char *data, size_t len, void *ctx)
+{
+    log_query_t *q = (log_query_t *)ctx;
+
+    for (size_t i = 0; i < len; i++) {
+        if (q->line_len < QUERY_LINE_MAX) {
+            q->line[q->line_len++] = data[i];
+        }
+        if (data[i] == '\n') {
+            query_match_line(q);
+            q->line_len = 0;
+        }
+    }
+    return q->err;
+}
+
+/* HTTP GET handler for /logs/query endpoint
+ *
+ *   ?tag=USB_CB    - only lines starting with "[USB_CB]"
+ *   ?from=MS&to=MS - time window in ms since boot (segment granularity)
+ *   ?grep=TEXT     - only lines containing TEXT
+ *
+ * Only index segments whose time window and tag bloom mask can match are read.
+ * Sent gzip-encoded when Accept-Encoding allows it.
+ */
+static esp_err_t logs_query_handler(httpd_req_t *req)
+{
+    if (refuse_under_pressure(req)) {
+        return ESP_OK;
+    }
+    log_query_t *q = mem_calloc(MEM_USE_HTTP, 1, sizeof(log_query_t));
+    if (q == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+    uint64_t tag_bit = ~0ULL;
+
+    char query[256];
+    char value[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "tag", value, sizeof(value)) == ESP_OK) {
+            url_decode(value);
+            // Accept both "USB_CB" and "[USB_CB]"
+            char *tag = value;
+            size_t len = strlen(tag);
+            if (len >= 2 && tag[0] == '[' && tag[len - 1] == ']') {
+                tag++;
+                len -= 2;
+            }
+            if (len > 0 && len + 2 < sizeof(q->tag)) {
+                q->tag_len = snprintf(q->tag, sizeof(q->tag), "[%.*s]", (int)len, tag);
+                tag_bit = log_index_tag_bit(tag, len);
+            }
+        }
+        if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+            from = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+            to = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "grep", q->grep, sizeof(q->grep)) == ESP_OK) {
+            url_decode(q->grep);
+        }
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    log_out_begin(&q->resp, req, true);
+
+    uint32_t first, last;
+    uint32_t scanned = 0;
+    if (log_index_range(&first, &last)) {
+        size_t log_first = log_get_start_offset();
+        for (uint32_t seq = first; (int32_t)(last - seq) >= 0 && q->err == ESP_OK; seq++) {
+            log_segment_t seg;
+            if (!log_index_get(seq, &seg)) {
+                continue;
+            }
+            if (seg.t_last < from || seg.t_first > to || !(seg.tag_mask & tag_bit)) {
+                continue;
+            }
+            if (seg.end <= log_first) {
+                continue;  // Already recycled by the storage backend
+            }
+            q->line_len = 0;
+            log_foreach_chunk(seg.start < log_first ? log_first : seg.start, seg.end, query_chunk_cb, q);
+            if (q->line_len > 0) {
+                query_match_line(q);  // Record without trailing newline
+            }
+            scanned++;
+        }
+    }
+
+    esp_err_t ret = log_out_end(&q->resp, query_flush(q));
+    log_write("[HTTP] Log query tag='%s' grep='%s' scanned %lu segment(s)", q->tag, q->grep, scanned);
+    mem_free(MEM_USE_HTTP, q);
     return ret;
 }
+#endif // CONFIG_ENABLE_LOG_QUERY
+
+#ifdef CONFIG_ENABLE_LOG_STREAM
+/* HTTP GET handler for /logs/stream endpoint (Server-Sent Events) */
+static esp_err_t logs_stream_handler(httpd_req_t *req)
+{
+    if (refuse_under_pressure(req)) {
+        return ESP_OK;
+    }
+    esp_err_t err = log_stream_attach(req);
+    if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many log viewers\n");
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Log streaming unavailable");
+    }
+    // The viewer task owns the response from here on
+    return ESP_OK;
+}
+#endif // CONFIG_ENABLE_LOG_STREAM
 
 /* HTTP GET handler for root endpoint */
 static esp_err_t root_get_handler(httpd_req_t *req)
@@ -78,6 +486,589 @@ static esp_err_t restart_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+#ifdef CONFIG_ENABLE_URB_STATS
+/* HTTP GET handler for /stats/latency endpoint */
+static esp_err_t latency_get_handler(httpd_req_t *req)
+{
+    urb_stats_snapshot_t *snap = mem_alloc(MEM_USE_HTTP, sizeof(urb_stats_snapshot_t));
+    if (snap == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    urb_stats_snapshot(snap);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    char line[256];
+    int len = snprintf(line, sizeof(line), "# URB latency, log2 buckets in us (bucket N counts [2^N, 2^(N+1)))\n%-5s %-18s %8s %8s %8s |",
+                       "type", "stage", "count", "avg_us", "max_us");
+    for (int b = 0; b < URB_STATS_NUM_BUCKETS && len < sizeof(line); b++) {
+        len += snprintf(line + len, sizeof(line) - len, " %6u", 1u << b);
+    }
+    httpd_resp_sendstr_chunk(req, line);
+
+    for (int t = 0; t < URB_STATS_NUM_EP_TYPES; t++) {
+        for (int s = 0; s < URB_STAGE_COUNT; s++) {
+            const urb_stats_hist_t *h = &snap->hist[t][s];
+            if (h->count == 0) {
+                continue;
+            }
+            len = snprintf(line, sizeof(line), "\n%-5s %-18s %8lu %8lu %8lu |",
+                           urb_stats_type_name(t), urb_stats_stage_name(s), h->count,
+                           (uint32_t)(h->sum_us / h->count), h->max_us);
+            for (int b = 0; b < URB_STATS_NUM_BUCKETS && len < sizeof(line); b++) {
+                len += snprintf(line + len, sizeof(line) - len, " %6lu", h->buckets[b]);
+            }
+            httpd_resp_sendstr_chunk(req, line);
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "\n");
+
+    mem_free(MEM_USE_HTTP, snap);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* HTTP GET handler for /stats/latency/reset endpoint */
+static esp_err_t latency_reset_handler(httpd_req_t *req)
+{
+    urb_stats_reset();
+    log_write("[HTTP] URB latency histograms reset");
+
+    const char *resp = "Latency histograms reset\n";
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, resp, strlen(resp));
+}
+#endif // CONFIG_ENABLE_URB_STATS
+
+#if defined(CONFIG_ENABLE_USBIP_CAPTURE) || defined(CONFIG_ENABLE_USBMON)
+static esp_err_t send_pcapng_chunk(const void *data, size_t len, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len);
+}
+#endif
+
+#ifdef CONFIG_ENABLE_USBIP_CAPTURE
+/* HTTP GET handler for /capture/start endpoint
+ *
+ *   ?ep=1,2            - endpoint numbers
+ *   ?seq=100-200       - seqnum range (a single number for one URB)
+ *   ?cmd=submit,...    - submit, ret_submit, unlink, ret_unlink, op
+ *   ?snaplen=N         - bytes kept per PDU
+ */
+static esp_err_t capture_start_handler(httpd_req_t *req)
+{
+    usbip_capture_filter_t filter;
+    usbip_capture_default_filter(&filter);
+
+    char query[160];
+    char value[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "ep", value, sizeof(value)) == ESP_OK) {
+            char *save;
+            filter.ep_mask = 0;
+            for (char *tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                unsigned long ep = strtoul(tok, NULL, 0) & 0x7F;  // Accept 0x81 as well as 1
+                if (ep < 16) {
+                    filter.ep_mask |= 1u << ep;
+                }
+            }
+        }
+        if (httpd_query_key_value(query, "seq", value, sizeof(value)) == ESP_OK) {
+            char *dash;
+            filter.seq_min = strtoul(value, &dash, 10);
+            filter.seq_max = (*dash == '-') ? strtoul(dash + 1, NULL, 10) : filter.seq_min;
+        }
+        if (httpd_query_key_value(query, "cmd", value, sizeof(value)) == ESP_OK) {
+            char *save;
+            filter.cmd_mask = 0;
+            for (char *tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                if (strcmp(tok, "submit") == 0) {
+                    filter.cmd_mask |= USBIP_CAPTURE_CMD(USBIP_CMD_SUBMIT);
+                } else if (strcmp(tok, "ret_submit") == 0) {
+                    filter.cmd_mask |= USBIP_CAPTURE_CMD(USBIP_RET_SUBMIT);
+                } else if (strcmp(tok, "unlink") == 0) {
+                    filter.cmd_mask |= USBIP_CAPTURE_CMD(USBIP_CMD_UNLINK);
+                } else if (strcmp(tok, "ret_unlink") == 0) {
+                    filter.cmd_mask |= USBIP_CAPTURE_CMD(USBIP_RET_UNLINK);
+                } else if (strcmp(tok, "op") == 0) {
+                    filter.cmd_mask |= USBIP_CAPTURE_CMD_OP;
+                }
+            }
+        }
+        if (httpd_query_key_value(query, "snaplen", value, sizeof(value)) == ESP_OK) {
+            filter.snaplen = strtoul(value, NULL, 10);
+        }
+    }
+
+    usbip_capture_start(&filter);
+
+    char resp[128];
+    snprintf(resp, sizeof(resp), "Capture started: ep_mask=0x%04x cmd_mask=0x%02x seq=%lu-%lu\n",
+             filter.ep_mask, filter.cmd_mask, filter.seq_min, filter.seq_max);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, resp, strlen(resp));
+}
+
+/* HTTP GET handler for /capture/stop endpoint */
+static esp_err_t capture_stop_handler(httpd_req_t *req)
+{
+    usbip_capture_stop();
+
+    usbip_capture_status_t st;
+    usbip_capture_get_status(&st);
+
+    char resp[160];
+    snprintf(resp, sizeof(resp), "Capture stopped: %lu captured, %lu overwritten, %lu dropped, %lu/%lu bytes used\n",
+             st.captured, st.overwritten, st.dropped, st.used, st.size);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, resp, strlen(resp));
+}
+
+/* HTTP GET handler for /capture.pcapng endpoint */
+static esp_err_t capture_pcapng_handler(httpd_req_t *req)
+{
+    if (refuse_under_pressure(req)) {
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/x-pcapng");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"usbip.pcapng\"");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    esp_err_t ret = usbip_capture_export(send_pcapng_chunk, req);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif // CONFIG_ENABLE_USBIP_CAPTURE
+
+#ifdef CONFIG_ENABLE_USBMON
+/* HTTP GET handler for /usbmon.pcapng endpoint */
+static esp_err_t usbmon_pcapng_handler(httpd_req_t *req)
+{
+    if (refuse_under_pressure(req)) {
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/x-pcapng");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"usbmon.pcapng\"");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    esp_err_t ret = usbmon_export(send_pcapng_chunk, req);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* HTTP GET handler for /usbmon/clear endpoint */
+static esp_err_t usbmon_clear_handler(httpd_req_t *req)
+{
+    usbmon_clear();
+    log_write("[HTTP] usbmon ring cleared");
+
+    const char *resp = "usbmon ring cleared\n";
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, resp, strlen(resp));
+}
+#endif // CONFIG_ENABLE_USBMON
+
+#ifdef CONFIG_ENABLE_PROFILER
+typedef struct
+{
+    const profiler_task_t *task;
+    uint32_t runtime;
+} profile_row_t;
+
+static int profile_row_cmp(const void *a, const void *b)
+{
+    uint32_t ra = ((const profile_row_t *)a)->runtime;
+    uint32_t rb = ((const profile_row_t *)b)->runtime;
+    return (ra < rb) - (ra > rb);
+}
+
+/* HTTP GET handler for /profile endpoint
+ *
+ *   ?window=MS - CPU use over the next MS milliseconds (100-10000) instead of
+ *                since boot; the HTTP server is blocked while sampling
+ *
+ * stack_free is the least free stack a task has ever had, in bytes.
+ */
+static esp_err_t profile_get_handler(httpd_req_t *req)
+{
+    uint32_t window_ms = 0;
+    char query[32];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "window", value, sizeof(value)) == ESP_OK) {
+        window_ms = strtoul(value, NULL, 10);
+        if (window_ms < 100) {
+            window_ms = 100;
+        } else if (window_ms > 10000) {
+            window_ms = 10000;
+        }
+    }
+
+    profiler_snapshot_t *before = NULL;
+    if (window_ms > 0) {
+        before = profiler_snapshot();
+        vTaskDelay(pdMS_TO_TICKS(window_ms));
+    }
+    profiler_snapshot_t *after = profiler_snapshot();
+    profile_row_t *rows = after ? mem_alloc(MEM_USE_HTTP, after->num_tasks * sizeof(profile_row_t)) : NULL;
+    if (after == NULL || rows == NULL || (window_ms > 0 && before == NULL)) {
+        mem_free(MEM_USE_HTTP, before);
+        mem_free(MEM_USE_HTTP, after);
+        mem_free(MEM_USE_HTTP, rows);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    // Each core's idle task accumulates the full counter, so 100% is total * cores
+    uint64_t total = (uint64_t)(after->total_runtime - (before ? before->total_runtime : 0)) * portNUM_PROCESSORS;
+    for (UBaseType_t i = 0; i < after->num_tasks; i++) {
+        const profiler_task_t *prev = before ? profiler_find_task(before, after->tasks[i].handle) : NULL;
+        rows[i].task = &after->tasks[i];
+        rows[i].runtime = after->tasks[i].runtime - (prev ? prev->runtime : 0);
+    }
+    qsort(rows, after->num_tasks, sizeof(profile_row_t), profile_row_cmp);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    char line[160];
+    if (window_ms > 0) {
+        snprintf(line, sizeof(line), "# CPU over a %lu ms window, %d core(s)\n", window_ms, portNUM_PROCESSORS);
+    } else {
+        snprintf(line, sizeof(line), "# CPU since boot (counter wraps), %d core(s)\n", portNUM_PROCESSORS);
+    }
+    httpd_resp_sendstr_chunk(req, line);
+    snprintf(line, sizeof(line), "%-16s %4s %-5s %7s %12s %10s\n",
+             "task", "prio", "state", "cpu", "runtime", "stack_free");
+    httpd_resp_sendstr_chunk(req, line);
+
+    for (UBaseType_t i = 0; i < after->num_tasks; i++) {
+        const profiler_task_t *t = rows[i].task;
+        uint32_t permille = total ? (uint32_t)((uint64_t)rows[i].runtime * 1000 / total) : 0;
+        snprintf(line, sizeof(line), "%-16s %4u %-5s %5lu.%lu%% %12lu %10lu\n",
+                 t->name, t->priority, profiler_state_name(t->state),
+                 permille / 10, permille % 10, rows[i].runtime, t->stack_free);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+
+    snprintf(line, sizeof(line), "\n%-10s %10s %10s %10s %10s %10s\n",
+             "heap", "total", "free", "min_free", "largest", "delta");
+    httpd_resp_sendstr_chunk(req, line);
+    for (int k = 0; k < PROFILER_HEAP_KINDS; k++) {
+        const profiler_heap_t *h = &after->heap[k];
+        if (h->total == 0) {
+            continue;  // No memory with these capabilities on this chip
+        }
+        int delta = before ? (int)h->free - (int)before->heap[k].free : 0;
+        snprintf(line, sizeof(line), "%-10s %10u %10u %10u %10u %+10d\n",
+                 h->name, h->total, h->free, h->min_free, h->largest, delta);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+
+    mem_free(MEM_USE_HTTP, rows);
+    mem_free(MEM_USE_HTTP, before);
+    mem_free(MEM_USE_HTTP, after);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif // CONFIG_ENABLE_PROFILER
+
+#ifdef CONFIG_ENABLE_FLIGHT_REC
+/* HTTP GET handler for /crash endpoint: flight record from before the last abnormal reset */
+static esp_err_t crash_get_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    size_t count;
+    const char *reason;
+    const flight_event_t *events = flight_rec_get_crash(&count, &reason);
+    if (events == NULL) {
+        const char *resp = "No abnormal reset since power-on\n";
+        return httpd_resp_send(req, resp, strlen(resp));
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "# Last %u event(s) before %s reset, oldest first\n", count, reason);
+    httpd_resp_sendstr_chunk(req, line);
+    for (size_t i = 0; i < count; i++) {
+        int len = flight_rec_format(&events[i], line, sizeof(line) - 1);
+        if (len > sizeof(line) - 2) {
+            len = sizeof(line) - 2;
+        }
+        line[len++] = '\n';
+        line[len] = '\0';
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif // CONFIG_ENABLE_FLIGHT_REC
+
+#ifdef CONFIG_ENABLE_WIFI_MANAGER
+/* HTTP GET handler for /wifi endpoint: connection path and reconnect times, ?forget=1 drops the AP cache */
+static esp_err_t wifi_get_handler(httpd_req_t *req)
+{
+    char query[32];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "forget", value, sizeof(value)) == ESP_OK && value[0] == '1') {
+        wifi_manager_forget();
+    }
+
+    wifi_manager_stats_t st;
+    wifi_manager_get_stats(&st);
+    const wifi_conn_result_t *last = &st.last;
+    const uint8_t *b = last->link.bssid;
+    const uint8_t *ip = (const uint8_t *)&last->link.ip.ip;
+
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+        "ap: %02x:%02x:%02x:%02x:%02x:%02x channel %u\n"
+        "ip: %u.%u.%u.%u\n"
+        "last connect: %s in %lu ms (cached AP attempt %lu ms, %u scan(s), %lu retries)\n"
+        "first connect after boot: %lu ms\n"
+        "connects: %lu (%lu cached AP, %lu full scan)\n"
+        "reconnects: %lu, last %lu ms, max %lu ms\n",
+        b[0], b[1], b[2], b[3], b[4], b[5], last->link.channel,
+        ip[0], ip[1], ip[2], ip[3],
+        wifi_conn_path_name(last->path), last->total_ms, last->fast_ms, last->scan_attempts, last->retries,
+        st.first_connect_ms,
+        st.connects, st.fast_hits, st.scan_fallbacks,
+        st.reconnects, st.last_reconnect_ms, st.max_reconnect_ms);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, buf, len);
+}
+#endif // CONFIG_ENABLE_WIFI_MANAGER
+
+#ifdef CONFIG_ENABLE_WIFI_PS_CONTROL
+/* HTTP GET handler for /power endpoint: time and turnaround per power-save mode */
+static esp_err_t power_get_handler(httpd_req_t *req)
+{
+    wifi_ps_stats_t st;
+    wifi_ps_get_stats(&st);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    char line[128];
+    snprintf(line, sizeof(line), "current: %s\n"
+             "# mode       time_ms  entries  turnarounds  avg_us  max_us\n",
+             wifi_ps_mode_name(st.current));
+    httpd_resp_sendstr_chunk(req, line);
+    for (int m = 0; m < WIFI_PS_NUM_MODES; m++) {
+        const wifi_ps_mode_stats_t *ms = &st.mode[m];
+        snprintf(line, sizeof(line), "%-10s %9llu %8lu %12lu %7lu %7lu\n",
+                 wifi_ps_mode_name(m), ms->time_us / 1000, ms->entries, ms->samples,
+                 ms->samples ? (uint32_t)(ms->sum_us / ms->samples) : 0, ms->max_us);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif // CONFIG_ENABLE_WIFI_PS_CONTROL
+
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+/* HTTP GET handler for /session endpoint: attached session and replay buffer */
+static esp_err_t session_get_handler(httpd_req_t *req)
+{
+    static const char *state_names[] = { "none", "active", "grace" };
+    usbip_session_status_t st;
+    usbip_session_get_status(&st);
+
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf),
+        "state: %s\n"
+        "id: %08lx\n"
+        "buffered: %lu (%lu bytes of %d)\n"
+        "grace_left_ms: %lu\n"
+        "suspends: %lu, resumes: %lu, expired: %lu\n",
+        state_names[st.state], st.id,
+        st.buffered, st.buffered_bytes, CONFIG_USBIP_RESUME_BUFFER_SIZE,
+        st.grace_left_ms,
+        st.suspends, st.resumes, st.expired);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, buf, len);
+}
+#endif // CONFIG_ENABLE_USBIP_RESUME
+
+#ifdef CONFIG_ENABLE_BOT_CACHE
+/* HTTP GET handler for /msc endpoint: mass storage read-ahead state and hit rate */
+static esp_err_t msc_get_handler(httpd_req_t *req)
+{
+    bot_cache_stats_t st;
+    bot_cache_get_stats(&st);
+
+    uint32_t reads = st.hits + st.misses;
+    char buf[384];
+    int len = snprintf(buf, sizeof(buf),
+        "active: %s\n"
+        "capacity: %lu blocks of %lu bytes\n"
+        "window: LBA %lu + %lu\n"
+        "reads: %lu, hits: %lu (%lu%%), misses: %lu\n"
+        "served_bytes: %llu\n"
+        "prefetches: %lu, sectors: %lu, errors: %lu\n"
+        "invalidations: %lu\n",
+        st.active ? "yes" : "no",
+        st.block_size ? st.last_lba + 1 : 0, st.block_size,
+        st.window_lba, st.window_count,
+        reads, st.hits, reads ? st.hits * 100 / reads : 0, st.misses,
+        st.bytes_served,
+        st.prefetches, st.prefetch_sectors, st.prefetch_errors,
+        st.invalidations);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, buf, len);
+}
+#endif // CONFIG_ENABLE_BOT_CACHE
+
+#ifdef CONFIG_ENABLE_URB_LEDGER
+/* HTTP GET handler for /ledger endpoint: URB lifecycle findings and live URBs */
+static esp_err_t ledger_get_handler(httpd_req_t *req)
+{
+    char *buf = mem_alloc(MEM_USE_HTTP, 4096);
+    if (buf == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    int len = urb_ledger_format(buf, 4096);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    esp_err_t err = httpd_resp_send(req, buf, len);
+    mem_free(MEM_USE_HTTP, buf);
+    return err;
+}
+#endif // CONFIG_ENABLE_URB_LEDGER
+
+/* HTTP GET handler for /budget endpoint: URBs in flight, admission stalls, stuck URBs and the session arena */
+static esp_err_t budget_get_handler(httpd_req_t *req)
+{
+    urb_budget_stats_t st;
+    urb_budget_get_stats(&st);
+
+    char buf[768];
+    int len = snprintf(buf, sizeof(buf),
+        "in_flight: %lu URBs (max %d), %lu bytes (max %d)\n"
+        "peak: %lu URBs, %lu bytes\n"
+        "free_heap: %lu (reserve %d)\n"
+        "admitted: %lu\n"
+        "stalls: %lu, stalled_ms: %llu, timeouts: %lu\n"
+        "rejected: %lu\n",
+        st.urbs, CONFIG_URB_BUDGET_MAX_URBS, st.bytes, CONFIG_URB_BUDGET_MAX_BYTES,
+        st.peak_urbs, st.peak_bytes,
+        (uint32_t)esp_get_free_heap_size(), CONFIG_URB_BUDGET_HEAP_RESERVE,
+        st.admitted,
+        st.stalls, st.stall_us / 1000, st.timeouts,
+        st.rejected);
+#ifdef CONFIG_ENABLE_URB_WATCHDOG
+    urb_watchdog_stats_t wd;
+    urb_watchdog_get_stats(&wd);
+    len += snprintf(buf + len, sizeof(buf) - len,
+        "watched: %lu, untracked: %lu\n"
+        "stuck: %lu now, %lu total\n"
+        "expired: %lu\n",
+        wd.armed, wd.untracked,
+        wd.stuck, wd.stuck_total,
+        wd.expired);
+#endif
+    session_arena_stats_t ar;
+    session_arena_get_stats(&ar);
+    len += snprintf(buf + len, sizeof(buf) - len,
+        "arena: %lu/%lu slots in use, peak %lu, exhausted %lu\n"
+        "sessions_ended: %lu, arena_resets: %lu\n"
+        "teardown: %lu endpoints cancelled, %lu queued URBs dropped\n",
+        ar.in_use, ar.slots, ar.peak, ar.exhausted,
+        ar.generation, ar.resets,
+        ar.cancelled, ar.dropped);
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, buf, len);
+}
+
+/* HTTP GET handler for /mem endpoint: heap per memory type, bytes held per use and pressure tiers */
+static esp_err_t mem_get_handler(httpd_req_t *req)
+{
+    static const struct {
+        const char *name;
+        uint32_t caps;
+    } kinds[] = {
+        { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+        { "dma", MALLOC_CAP_DMA },
+        { "spiram", MALLOC_CAP_SPIRAM },
+    };
+    char line[160];
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_sendstr_chunk(req, "# heap       total       free  low_water    largest\n");
+    for (int k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        snprintf(line, sizeof(line), "%-8s %9u  %9u  %9u  %9u\n", kinds[k].name,
+                 heap_caps_get_total_size(kinds[k].caps), heap_caps_get_free_size(kinds[k].caps),
+                 heap_caps_get_minimum_free_size(kinds[k].caps), heap_caps_get_largest_free_block(kinds[k].caps));
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    httpd_resp_sendstr_chunk(req, "# use      placed    internal     spiram       peak   allocs  fallbacks  failures\n");
+    for (int u = 0; u < MEM_USE_COUNT; u++) {
+        mem_use_stats_t st;
+        mem_get_stats(u, &st);
+        snprintf(line, sizeof(line), "%-8s %-8s %9lu  %9lu  %9lu  %7lu  %9lu  %8lu\n",
+                 mem_use_name(u), mem_use_in_spiram(u) ? "spiram" : "internal",
+                 st.internal, st.spiram, st.peak, st.allocs, st.fallbacks, st.failures);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+#ifdef CONFIG_ENABLE_MEM_PRESSURE
+    mem_pressure_stats_t ps;
+    mem_pressure_get_stats(&ps);
+    snprintf(line, sizeof(line),
+             "# pressure\ntier: %s, free_heap: %lu, min_free_heap: %lu, urb_limit: %lu, changes: %lu\n",
+             mem_pressure_tier_name(ps.tier), ps.free_heap, ps.min_free_heap, mem_pressure_max_urbs(), ps.changes);
+    httpd_resp_sendstr_chunk(req, line);
+    for (int t = 0; t < MEM_PRESSURE_TIER_COUNT; t++) {
+        snprintf(line, sizeof(line), "%-8s entered: %lu, time_ms: %llu\n",
+                 mem_pressure_tier_name(t), ps.entered[t], ps.time_us[t] / 1000);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    snprintf(line, sizeof(line), "dropped: %lu log records, %lu captures, %lu downloads\n",
+             ps.dropped[MEM_PRESSURE_DROP_LOG], ps.dropped[MEM_PRESSURE_DROP_CAPTURE],
+             ps.dropped[MEM_PRESSURE_DROP_HTTP]);
+    httpd_resp_sendstr_chunk(req, line);
+#endif
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* HTTP GET handler for /boot endpoint: when each boot milestone was reached */
+static esp_err_t boot_get_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    char line[96];
+    httpd_resp_sendstr_chunk(req, "# milestone        us since app start   delta from previous line\n");
+    int64_t prev = 0;
+    for (int ev = 0; ev < BOOT_EV_COUNT; ev++) {
+        int64_t t = boot_timeline_get(ev);
+        if (t < 0) {
+            snprintf(line, sizeof(line), "%-18s pending\n", boot_timeline_name(ev));
+        } else {
+            snprintf(line, sizeof(line), "%-18s %18lld   %+lld\n",
+                     boot_timeline_name(ev), t, t - prev);
+            prev = t;
+        }
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 /* URI handlers */
 static const httpd_uri_t root_uri = {
     .uri       = "/",
@@ -107,6 +1098,163 @@ static const httpd_uri_t restart_uri = {
     .user_ctx  = NULL
 };
 
+#ifdef CONFIG_ENABLE_LOG_QUERY
+static const httpd_uri_t logs_query_uri = {
+    .uri       = "/logs/query",
+    .method    = HTTP_GET,
+    .handler   = logs_query_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_LOG_STREAM
+static const httpd_uri_t logs_stream_uri = {
+    .uri       = "/logs/stream",
+    .method    = HTTP_GET,
+    .handler   = logs_stream_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_URB_STATS
+static const httpd_uri_t latency_uri = {
+    .uri       = "/stats/latency",
+    .method    = HTTP_GET,
+    .handler   = latency_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t latency_reset_uri = {
+    .uri       = "/stats/latency/reset",
+    .method    = HTTP_GET,
+    .handler   = latency_reset_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_USBIP_CAPTURE
+static const httpd_uri_t capture_start_uri = {
+    .uri       = "/capture/start",
+    .method    = HTTP_GET,
+    .handler   = capture_start_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t capture_stop_uri = {
+    .uri       = "/capture/stop",
+    .method    = HTTP_GET,
+    .handler   = capture_stop_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t capture_pcapng_uri = {
+    .uri       = "/capture.pcapng",
+    .method    = HTTP_GET,
+    .handler   = capture_pcapng_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_USBMON
+static const httpd_uri_t usbmon_pcapng_uri = {
+    .uri       = "/usbmon.pcapng",
+    .method    = HTTP_GET,
+    .handler   = usbmon_pcapng_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t usbmon_clear_uri = {
+    .uri       = "/usbmon/clear",
+    .method    = HTTP_GET,
+    .handler   = usbmon_clear_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_PROFILER
+static const httpd_uri_t profile_uri = {
+    .uri       = "/profile",
+    .method    = HTTP_GET,
+    .handler   = profile_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_FLIGHT_REC
+static const httpd_uri_t crash_uri = {
+    .uri       = "/crash",
+    .method    = HTTP_GET,
+    .handler   = crash_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_WIFI_MANAGER
+static const httpd_uri_t wifi_uri = {
+    .uri       = "/wifi",
+    .method    = HTTP_GET,
+    .handler   = wifi_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_WIFI_PS_CONTROL
+static const httpd_uri_t power_uri = {
+    .uri       = "/power",
+    .method    = HTTP_GET,
+    .handler   = power_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+static const httpd_uri_t session_uri = {
+    .uri       = "/session",
+    .method    = HTTP_GET,
+    .handler   = session_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_BOT_CACHE
+static const httpd_uri_t msc_uri = {
+    .uri       = "/msc",
+    .method    = HTTP_GET,
+    .handler   = msc_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+#ifdef CONFIG_ENABLE_URB_LEDGER
+static const httpd_uri_t ledger_uri = {
+    .uri       = "/ledger",
+    .method    = HTTP_GET,
+    .handler   = ledger_get_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+static const httpd_uri_t boot_uri = {
+    .uri       = "/boot",
+    .method    = HTTP_GET,
+    .handler   = boot_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t budget_uri = {
+    .uri       = "/budget",
+    .method    = HTTP_GET,
+    .handler   = budget_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t mem_uri = {
+    .uri       = "/mem",
+    .method    = HTTP_GET,
+    .handler   = mem_get_handler,
+    .user_ctx  = NULL
+};
+
 esp_err_t http_server_init(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -115,7 +1263,7 @@ esp_err_t http_server_init(void)
     config.lru_purge_enable = true;
     
     // Increase limits to handle larger requests
-    config.max_uri_handlers = 8;
+    config.max_uri_handlers = 24;
     config.max_resp_headers = 8;
     config.backlog_conn = 5;
     config.stack_size = 8192;
@@ -132,6 +1280,53 @@ esp_err_t http_server_init(void)
         httpd_register_uri_handler(server, &logs_uri);
         httpd_register_uri_handler(server, &clear_uri);
         httpd_register_uri_handler(server, &restart_uri);
+        httpd_register_uri_handler(server, &boot_uri);
+        httpd_register_uri_handler(server, &budget_uri);
+        httpd_register_uri_handler(server, &mem_uri);
+#ifdef CONFIG_ENABLE_LOG_QUERY
+        httpd_register_uri_handler(server, &logs_query_uri);
+#endif
+#ifdef CONFIG_ENABLE_LOG_STREAM
+        httpd_register_uri_handler(server, &logs_stream_uri);
+#endif
+#ifdef CONFIG_ENABLE_URB_STATS
+        httpd_register_uri_handler(server, &latency_uri);
+        httpd_register_uri_handler(server, &latency_reset_uri);
+#endif
+#ifdef CONFIG_ENABLE_USBIP_CAPTURE
+        httpd_register_uri_handler(server, &capture_start_uri);
+        httpd_register_uri_handler(server, &capture_stop_uri);
+        httpd_register_uri_handler(server, &capture_pcapng_uri);
+#endif
+#ifdef CONFIG_ENABLE_USBMON
+        httpd_register_uri_handler(server, &usbmon_pcapng_uri);
+        httpd_register_uri_handler(server, &usbmon_clear_uri);
+#endif
+#ifdef CONFIG_ENABLE_PROFILER
+        httpd_register_uri_handler(server, &profile_uri);
+#endif
+#ifdef CONFIG_ENABLE_FLIGHT_REC
+        httpd_register_uri_handler(server, &crash_uri);
+#endif
+#ifdef CONFIG_ENABLE_WIFI_MANAGER
+        httpd_register_uri_handler(server, &wifi_uri);
+#endif
+#ifdef CONFIG_ENABLE_WIFI_PS_CONTROL
+        httpd_register_uri_handler(server, &power_uri);
+#endif
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+        httpd_register_uri_handler(server, &session_uri);
+#endif
+#ifdef CONFIG_ENABLE_BOT_CACHE
+        httpd_register_uri_handler(server, &msc_uri);
+#endif
+#ifdef CONFIG_ENABLE_URB_LEDGER
+        httpd_register_uri_handler(server, &ledger_uri);
+#endif
+        
+#ifdef CONFIG_ENABLE_LOG_STREAM
+        log_stream_init();
+#endif
         
         ESP_LOGI(TAG, "HTTP server started successfully");
         log_write("[HTTP] HTTP server started on port 8080");
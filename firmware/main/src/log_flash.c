@@ -0,0 +1,503 @@
+#include "log_flash.h"
+#include "esp_partition.h"
+#include "esp_rom_sys.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define SECTOR_SIZE     4096
+#define SECTOR_MAGIC    0x53474F4C  // "LOGS"
+#define RECORD_MAGIC    0x5A4C
+#define ERASED_WORD     0xFFFFFFFF
+#define ALIGN4(x)       (((x) + 3) & ~3u)
+#define MAX_PINS        4           // Concurrent log_flash_foreach() walks
+
+static const char *TAG = "LOG_FLASH";
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t base;  // Logical offset of the first payload byte in this sector
+    uint32_t crc;   // CRC32 of the three fields above
+} sector_hdr_t;
+
+typedef struct
+{
+    uint16_t magic;
+    uint16_t len;   // Payload bytes, record occupies ALIGN4(sizeof(hdr) + len)
+    uint32_t crc;   // CRC32 of the payload
+} record_hdr_t;
+
+#define MAX_PAYLOAD (SECTOR_SIZE - sizeof(sector_hdr_t) - sizeof(record_hdr_t))
+
+static const esp_partition_t *part = NULL;
+static const uint8_t *map = NULL;
+static esp_partition_mmap_handle_t map_handle;
+static uint32_t num_sectors = 0;
+
+// Writer state, protected by the caller's log_mutex; head_sector and
+// tail_sector only change with erase_mutex held as well, so readers can
+// look at them under erase_mutex alone
+static uint32_t head_sector = 0;
+static uint32_t head_pos = 0;   // Write position inside the head sector
+static uint32_t head_seq = 0;
+static uint32_t tail_sector = 0;
+static volatile uint32_t log_start = 0;
+static volatile uint32_t log_end = 0;
+
+// Erase-ahead state, protected by erase_mutex
+static SemaphoreHandle_t erase_mutex = NULL;
+static TaskHandle_t erase_task = NULL;
+static int32_t erased_sector = -1;
+static volatile int32_t erase_request = -1;
+
+// Sectors a reader is handing out pointers into; never erased while listed.
+// Protected by erase_mutex
+static int32_t pinned[MAX_PINS];
+
+static inline const sector_hdr_t *sector_hdr(uint32_t sector)
+{
+    return (const sector_hdr_t *)(map + sector * SECTOR_SIZE);
+}
+
+static inline uint32_t hdr_crc(const sector_hdr_t *hdr)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)hdr, offsetof(sector_hdr_t, crc));
+}
+
+static bool sector_valid(uint32_t sector)
+{
+    const sector_hdr_t *hdr = sector_hdr(sector);
+    return hdr->magic == SECTOR_MAGIC && hdr->crc == hdr_crc(hdr);
+}
+
+static bool sector_erased(uint32_t sector)
+{
+    const uint32_t *words = (const uint32_t *)sector_hdr(sector);
+    for (size_t i = 0; i < SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if (words[i] != ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline uint32_t next_sector(uint32_t sector)
+{
+    return (sector + 1) % num_sectors;
+}
+
+/* Walks the records of a sector, returns the offset of the first free slot */
+static uint32_t sector_scan_end(uint32_t sector, uint32_t *payload_bytes)
+{
+    const uint8_t *base = (const uint8_t *)sector_hdr(sector);
+    uint32_t pos = sizeof(sector_hdr_t);
+    uint32_t bytes = 0;
+
+    while (pos + sizeof(record_hdr_t) <= SECTOR_SIZE) {
+        const record_hdr_t *rec = (const record_hdr_t *)(base + pos);
+        if (rec->magic == 0xFFFF) {
+            break;
+        }
+        if (rec->magic != RECORD_MAGIC || rec->len > MAX_PAYLOAD) {
+            // Garbage from an interrupted write, treat the rest of the sector as used
+            pos = SECTOR_SIZE;
+            break;
+        }
+        bytes += rec->len;
+        pos += ALIGN4(sizeof(record_hdr_t) + rec->len);
+    }
+
+    if (payload_bytes) {
+        *payload_bytes = bytes;
+    }
+    return pos;
+}
+
+static esp_err_t erase_sector(uint32_t sector)
+{
+    return esp_partition_erase_range(part, sector * SECTOR_SIZE, SECTOR_SIZE);
+}
+
+/* Caller holds erase_mutex */
+static bool sector_pinned(uint32_t sector)
+{
+    for (int i = 0; i < MAX_PINS; i++) {
+        if (pinned[i] == (int32_t)sector) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Between tail and head in ring order; caller holds erase_mutex */
+static bool sector_live(uint32_t sector)
+{
+    uint32_t pos = (sector + num_sectors - tail_sector) % num_sectors;
+    return pos <= (head_sector + num_sectors - tail_sector) % num_sectors;
+}
+
+/* Returns the pin slot, or -1 if the sector no longer holds log data; caller holds erase_mutex */
+static int pin_sector(uint32_t sector)
+{
+    if (!sector_live(sector) || !sector_valid(sector)) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_PINS; i++) {
+        if (pinned[i] < 0) {
+            pinned[i] = sector;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Keeps the sector after the head erased so appends rarely wait for flash */
+static void log_flash_erase_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        int32_t target = erase_request;
+        if (target < 0) {
+            continue;
+        }
+
+        xSemaphoreTake(erase_mutex, portMAX_DELAY);
+        // A pinned sector is left alone; advance_sector() erases it once released
+        if (!sector_pinned(target)) {
+            if (erased_sector != target && !sector_erased(target)) {
+                erase_sector(target);
+            }
+            erased_sector = target;
+        }
+        erase_request = -1;
+        xSemaphoreGive(erase_mutex);
+    }
+}
+
+static void request_erase_ahead(void)
+{
+    erase_request = next_sector(head_sector);
+    if (erase_task != NULL) {
+        xTaskNotifyGive(erase_task);
+    }
+}
+
+static esp_err_t start_sector(uint32_t sector, uint32_t seq, uint32_t base)
+{
+    sector_hdr_t hdr = {
+        .magic = SECTOR_MAGIC,
+        .seq = seq,
+        .base = base,
+    };
+    hdr.crc = hdr_crc(&hdr);
+
+    esp_err_t err = esp_partition_write(part, sector * SECTOR_SIZE, &hdr, sizeof(hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+    head_sector = sector;
+    head_seq = seq;
+    head_pos = sizeof(sector_hdr_t);
+    return ESP_OK;
+}
+
+/* Moves the head into the next sector, which is normally already erased */
+static esp_err_t advance_sector(void)
+{
+    xSemaphoreTake(erase_mutex, portMAX_DELAY);
+    uint32_t next = next_sector(head_sector);
+
+    // A reader is still sending the oldest sector; drop records until it lets go
+    if (sector_pinned(next)) {
+        xSemaphoreGive(erase_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The erase-ahead sector is never a data sector, but after a wrap it may
+    // still be the oldest one if the background erase has not run yet
+    if (next == tail_sector) {
+        tail_sector = next_sector(next);
+        if (sector_valid(tail_sector)) {
+            log_start = sector_hdr(tail_sector)->base;
+        }
+    }
+
+    if (erased_sector != (int32_t)next && !sector_erased(next)) {
+        erase_sector(next);
+    }
+    erased_sector = -1;
+
+    esp_err_t err = start_sector(next, head_seq + 1, log_end);
+    if (err != ESP_OK) {
+        xSemaphoreGive(erase_mutex);
+        return err;
+    }
+
+    // Free the sector after the new head; it holds the oldest data once full
+    uint32_t ahead = next_sector(head_sector);
+    if (ahead == tail_sector) {
+        tail_sector = next_sector(ahead);
+        if (tail_sector != head_sector && sector_valid(tail_sector)) {
+            log_start = sector_hdr(tail_sector)->base;
+        } else {
+            tail_sector = head_sector;
+            log_start = sector_hdr(head_sector)->base;
+        }
+    }
+    xSemaphoreGive(erase_mutex);
+    request_erase_ahead();
+    return ESP_OK;
+}
+
+esp_err_t log_flash_append(const char *data, size_t len)
+{
+    if (map == NULL || len == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > MAX_PAYLOAD) {
+        len = MAX_PAYLOAD;
+    }
+
+    uint32_t rec_size = ALIGN4(sizeof(record_hdr_t) + len);
+    if (head_pos + rec_size > SECTOR_SIZE) {
+        esp_err_t err = advance_sector();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    record_hdr_t rec = {
+        .magic = RECORD_MAGIC,
+        .len = len,
+        .crc = esp_rom_crc32_le(0, (const uint8_t *)data, len),
+    };
+
+    uint32_t addr = head_sector * SECTOR_SIZE + head_pos;
+    esp_err_t err = esp_partition_write(part, addr, &rec, sizeof(rec));
+    if (err == ESP_OK) {
+        err = esp_partition_write(part, addr + sizeof(rec), data, len);
+    }
+
+    // Even a failed write may have programmed bits, never reuse the slot
+    head_pos += rec_size;
+    if (err == ESP_OK) {
+        log_end += len;
+    }
+    return err;
+}
+
+size_t log_flash_start(void)
+{
+    return log_start;
+}
+
+size_t log_flash_end(void)
+{
+    return log_end;
+}
+
+esp_err_t log_flash_foreach(size_t start, size_t end, log_chunk_cb_t cb, void *ctx)
+{
+    if (map == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (end > log_end) {
+        end = log_end;
+    }
+
+    // Sector bases increase from tail to head, find the last one at or before start
+    xSemaphoreTake(erase_mutex, portMAX_DELAY);
+    uint32_t sector = tail_sector;
+    for (uint32_t s = tail_sector, n = 0; n < num_sectors; s = next_sector(s), n++) {
+        if (!sector_valid(s) || sector_hdr(s)->base > start) {
+            break;
+        }
+        sector = s;
+        if (s == head_sector) {
+            break;
+        }
+    }
+    // The callback may block on the network; the pin keeps the sector from
+    // being erased under the pointers it was given
+    int pin = pin_sector(sector);
+    xSemaphoreGive(erase_mutex);
+
+    esp_err_t err = ESP_OK;
+    for (uint32_t n = 0; pin >= 0 && n < num_sectors; n++) {
+        const uint8_t *base = (const uint8_t *)sector_hdr(sector);
+        uint32_t offset = sector_hdr(sector)->base;
+        uint32_t pos = sizeof(sector_hdr_t);
+
+        while (offset < end && pos + sizeof(record_hdr_t) <= SECTOR_SIZE) {
+            const record_hdr_t *rec = (const record_hdr_t *)(base + pos);
+            if (rec->magic != RECORD_MAGIC || rec->len > MAX_PAYLOAD) {
+                break;
+            }
+            const char *payload = (const char *)(rec + 1);
+            uint32_t rec_end = offset + rec->len;
+
+            if (rec_end > start && esp_rom_crc32_le(0, (const uint8_t *)payload, rec->len) == rec->crc) {
+                uint32_t from = (start > offset) ? start - offset : 0;
+                uint32_t to = (end < rec_end) ? end - offset : rec->len;
+                err = cb(payload + from, to - from, ctx);
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+            offset = rec_end;
+            pos += ALIGN4(sizeof(record_hdr_t) + rec->len);
+        }
+
+        xSemaphoreTake(erase_mutex, portMAX_DELAY);
+        pinned[pin] = -1;
+        pin = -1;
+        if (err == ESP_OK && offset < end && sector != head_sector) {
+            sector = next_sector(sector);
+            pin = pin_sector(sector);
+        }
+        xSemaphoreGive(erase_mutex);
+    }
+    return err;
+}
+
+typedef struct
+{
+    char *dst;
+    size_t copied;
+} copy_ctx_t;
+
+static esp_err_t copy_cb(const char *data, size_t len, void *ctx)
+{
+    copy_ctx_t *c = (copy_ctx_t *)ctx;
+    memcpy(c->dst + c->copied, data, len);
+    c->copied += len;
+    return ESP_OK;
+}
+
+size_t log_flash_read(size_t offset, char *buffer, size_t len)
+{
+    copy_ctx_t ctx = { .dst = buffer, .copied = 0 };
+    if (offset < log_start) {
+        offset = log_start;
+    }
+    log_flash_foreach(offset, offset + len, copy_cb, &ctx);
+    return ctx.copied;
+}
+
+esp_err_t log_flash_clear(void)
+{
+    xSemaphoreTake(erase_mutex, portMAX_DELAY);
+    for (int i = 0; i < MAX_PINS; i++) {
+        if (pinned[i] >= 0) {
+            xSemaphoreGive(erase_mutex);
+            ESP_LOGW(TAG, "Clear refused, the log is being read");
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    esp_err_t err = esp_partition_erase_range(part, 0, num_sectors * SECTOR_SIZE);
+    erased_sector = -1;
+    if (err == ESP_OK) {
+        log_start = 0;
+        log_end = 0;
+        tail_sector = 0;
+        err = start_sector(0, 1, 0);
+        if (err == ESP_OK) {
+            erased_sector = 1;
+        }
+    }
+    xSemaphoreGive(erase_mutex);
+    return err;
+}
+
+/* Finds the newest sector and the write position inside it */
+static esp_err_t locate_head(void)
+{
+    bool found = false;
+    for (uint32_t s = 0; s < num_sectors; s++) {
+        if (!sector_valid(s)) {
+            continue;
+        }
+        uint32_t seq = sector_hdr(s)->seq;
+        if (!found || (int32_t)(seq - head_seq) > 0) {
+            head_sector = s;
+            head_seq = seq;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        ESP_LOGI(TAG, "No log found, formatting partition");
+        return log_flash_clear();
+    }
+
+    uint32_t payload = 0;
+    head_pos = sector_scan_end(head_sector, &payload);
+    log_end = sector_hdr(head_sector)->base + payload;
+
+    // Oldest data is the first valid sector after the head
+    tail_sector = head_sector;
+    for (uint32_t s = next_sector(head_sector); s != head_sector; s = next_sector(s)) {
+        if (sector_valid(s)) {
+            tail_sector = s;
+            break;
+        }
+    }
+    log_start = sector_hdr(tail_sector)->base;
+    return ESP_OK;
+}
+
+esp_err_t log_flash_init(void)
+{
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                    CONFIG_LOG_PARTITION_LABEL);
+    if (part == NULL) {
+        ESP_LOGE(TAG, "Partition '%s' not found", CONFIG_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    num_sectors = part->size / SECTOR_SIZE;
+    if (num_sectors < 3) {
+        ESP_LOGE(TAG, "Partition '%s' too small", CONFIG_LOG_PARTITION_LABEL);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = esp_partition_mmap(part, 0, num_sectors * SECTOR_SIZE, ESP_PARTITION_MMAP_DATA,
+                                       (const void **)&map, &map_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map log partition (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    erase_mutex = xSemaphoreCreateMutex();
+    if (erase_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < MAX_PINS; i++) {
+        pinned[i] = -1;
+    }
+
+    err = locate_head();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (xTaskCreate(log_flash_erase_task, "log_erase", 2048, NULL, 1, &erase_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create erase task");
+        return ESP_FAIL;
+    }
+
+    // The previous run may have been reset before erasing ahead
+    if (next_sector(head_sector) == tail_sector && tail_sector != head_sector) {
+        tail_sector = next_sector(tail_sector);
+        log_start = sector_valid(tail_sector) ? sector_hdr(tail_sector)->base : sector_hdr(head_sector)->base;
+    }
+    request_erase_ahead();
+
+    ESP_LOGI(TAG, "Log partition: %lu sectors, head %lu (seq %lu), %lu bytes stored",
+             num_sectors, head_sector, head_seq, log_end - log_start);
+    return ESP_OK;
+}
@@ -1,10 +1,21 @@
 #include "log_handler.h"
+#include "log_stream.h"
+#include "log_flash.h"
+#include "log_index.h"
+#include "mem_pressure.h"
 #include "esp_system.h"
 #include "esp_spiffs.h"
 #include <sys/stat.h>
 #include <inttypes.h>
 
+#ifndef CONFIG_LOG_BACKEND_PARTITION
 static FILE *log_file = NULL;
+static FILE *read_file = NULL;  // Separate handle used by log_read(), opened lazily
+static size_t file_end = 0;     // Size of LOG_FILE_PATH, tracked to avoid stat() per record
+#endif
+static bool log_ready = false;
+static char early_buf[LOG_EARLY_BUF_SIZE];  // Records written before log_handler_start() finished
+static size_t early_len = 0;
 static uint32_t boot_count = 0;
 static SemaphoreHandle_t log_mutex = NULL;
 static const char *TAG = "LOG_HANDLER";
@@ -27,6 +38,38 @@ static const char* get_reset_reason_string(esp_reset_reason_t reason)
     }
 }
 
+/* Offset of the oldest stored byte */
+static size_t backend_start(void)
+{
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    return log_flash_start();
+#else
+    return 0;
+#endif
+}
+
+/* Offset one past the newest stored byte; caller holds log_mutex or is log_handler_start() */
+static size_t backend_end(void)
+{
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    return log_flash_end();
+#else
+    return file_end;
+#endif
+}
+
+/* Appends raw bytes to the active storage backend; caller holds log_mutex */
+static void backend_write(const char *data, size_t len)
+{
+    log_index_add(backend_end(), data, len);
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    log_flash_append(data, len);
+#else
+    file_end += fwrite(data, 1, len, log_file);
+    fflush(log_file);
+#endif
+}
+
 esp_err_t log_handler_init(void)
 {
     log_mutex = xSemaphoreCreateMutex();
@@ -34,7 +77,23 @@ esp_err_t log_handler_init(void)
         ESP_LOGE(TAG, "Failed to create log mutex");
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
+
+esp_err_t log_handler_start(void)
+{
+    if (log_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
     
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    esp_err_t ret = log_flash_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize log partition (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+    
+#else
     // Initialize SPIFFS
     esp_vfs_spiffs_conf_t conf = {
         .base_path = "/spiffs",
@@ -55,11 +114,6 @@ esp_err_t log_handler_init(void)
         ESP_LOGI(TAG, "SPIFFS: %d KB total, %d KB used", total / 1024, used / 1024);
     }
     
-    // Get reset reason and boot count
-    esp_reset_reason_t reset_reason = esp_reset_reason();
-    const char* reset_reason_str = get_reset_reason_string(reset_reason);
-    boot_count++;
-    
     // Open log file in append mode
     log_file = fopen(LOG_FILE_PATH, "a");
     if (log_file == NULL) {
@@ -84,8 +138,16 @@ esp_err_t log_handler_init(void)
                 return ESP_FAIL;
             }
             ESP_LOGI(TAG, "Rotated log file (was %ld KB)", st.st_size / 1024);
+        } else {
+            file_end = st.st_size;
         }
     }
+#endif
+    
+    // Get reset reason and boot count
+    esp_reset_reason_t reset_reason = esp_reset_reason();
+    const char* reset_reason_str = get_reset_reason_string(reset_reason);
+    boot_count++;
     
     // Write boot header
     char header[256];
@@ -96,10 +158,18 @@ esp_err_t log_handler_init(void)
         "===============================\n",
         (int)boot_count, reset_reason_str, esp_get_free_heap_size());
     
+    // Other tasks are already logging into early_buf; flush it behind the header
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    log_index_init(backend_start(), backend_end());
     if (len > 0) {
-        fwrite(header, 1, len, log_file);
-        fflush(log_file);
+        backend_write(header, len);
     }
+    if (early_len > 0) {
+        backend_write(early_buf, early_len);
+        early_len = 0;
+    }
+    log_ready = true;
+    xSemaphoreGive(log_mutex);
     
     ESP_LOGI(TAG, "Log handler initialized (boot #%d, reason: %s)", 
              (int)boot_count, reset_reason_str);
@@ -107,21 +177,31 @@ esp_err_t log_handler_init(void)
     return ESP_OK;
 }
 
-void log_write(const char *format, ...)
+/* Under memory pressure only log_write_err() records are kept */
+static bool log_suppressed(bool important)
+{
+    if (important || mem_pressure_tier() < MEM_PRESSURE_QUIET) {
+        return false;
+    }
+    mem_pressure_note_drop(MEM_PRESSURE_DROP_LOG);
+    return true;
+}
+
+static void log_vwrite(bool important, const char *format, va_list args)
 {
-    if (log_mutex == NULL || log_file == NULL) {
+    if (log_mutex == NULL || log_suppressed(important)) {
         return;
     }
     
     char temp_buffer[512];
-    va_list args;
-    va_start(args, format);
     int len = vsnprintf(temp_buffer, sizeof(temp_buffer), format, args);
-    va_end(args);
     
     if (len <= 0) {
         return;
     }
+    if (len >= sizeof(temp_buffer)) {
+        len = sizeof(temp_buffer) - 1;  // Output was truncated
+    }
     
     // Ensure newline at the end
     if (temp_buffer[len - 1] != '\n') {
@@ -131,46 +211,111 @@ void log_write(const char *format, ...)
     }
     
     if (xSemaphoreTake(log_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        fwrite(temp_buffer, 1, len, log_file);
-        fflush(log_file);
+        if (log_ready) {
+            log_stream_push(temp_buffer, len);
+            backend_write(temp_buffer, len);
+        } else if (early_len + len <= sizeof(early_buf)) {
+            // Storage is still mounting; log_handler_start() flushes this
+            memcpy(&early_buf[early_len], temp_buffer, len);
+            early_len += len;
+        }
         xSemaphoreGive(log_mutex);
     }
 }
 
+void log_write(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_vwrite(false, format, args);
+    va_end(args);
+}
+
+void log_write_err(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_vwrite(true, format, args);
+    va_end(args);
+}
+
 
 size_t log_get_buffer(char *buffer, size_t buffer_size)
 {
-    if (buffer == NULL || buffer_size == 0 || log_mutex == NULL || log_file == NULL) {
+    if (buffer == NULL || buffer_size == 0) {
         return 0;
     }
     
+    size_t bytes_read = log_read(0, buffer, buffer_size - 1);
+    buffer[bytes_read] = '\0';
+    
+    return bytes_read;
+}
+
+size_t log_read(size_t offset, char *buffer, size_t len)
+{
+    if (buffer == NULL || len == 0 || log_mutex == NULL || !log_ready) {
+        return 0;
+    }
+    
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    // Reads come straight from the flash mapping and never need the mutex
+    return log_flash_read(offset, buffer, len);
+#else
     xSemaphoreTake(log_mutex, portMAX_DELAY);
     
-    // Flush any pending writes
+    // Flush any pending writes so the read handle sees them
     fflush(log_file);
     
-    // Reopen file in read mode to properly read contents
-    FILE *read_file = fopen(LOG_FILE_PATH, "r");
     if (read_file == NULL) {
-        xSemaphoreGive(log_mutex);
-        return 0;
+        read_file = fopen(LOG_FILE_PATH, "r");
     }
     
-    // Get file size
-    fseek(read_file, 0, SEEK_END);
-    long file_size = ftell(read_file);
-    fseek(read_file, 0, SEEK_SET);
-    
-    // Read file contents
-    size_t read_size = (file_size < buffer_size - 1) ? file_size : buffer_size - 1;
-    size_t bytes_read = fread(buffer, 1, read_size, read_file);
-    buffer[bytes_read] = '\0';
-    
-    fclose(read_file);
+    size_t bytes_read = 0;
+    if (read_file != NULL && fseek(read_file, offset, SEEK_SET) == 0) {
+        bytes_read = fread(buffer, 1, len, read_file);
+        clearerr(read_file);  // Clear EOF so the handle can be reused after more writes
+    }
     
     xSemaphoreGive(log_mutex);
     
     return bytes_read;
+#endif
+}
+
+esp_err_t log_foreach_chunk(size_t start, size_t end, log_chunk_cb_t cb, void *ctx)
+{
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    if (!log_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Zero copy: the callback gets pointers into memory-mapped flash
+    return log_flash_foreach(start, end, cb, ctx);
+#else
+    char chunk[LOG_CHUNK_SIZE];
+    size_t offset = start;
+    
+    while (offset < end) {
+        size_t want = end - offset;
+        if (want > sizeof(chunk)) {
+            want = sizeof(chunk);
+        }
+        
+        // log_read() takes and releases the mutex, so writers interleave between chunks
+        size_t got = log_read(offset, chunk, want);
+        if (got == 0) {
+            break;
+        }
+        
+        esp_err_t err = cb(chunk, got, ctx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += got;
+    }
+    
+    return ESP_OK;
+#endif
 }
 
 const char* log_get_buffer_ptr(void)
@@ -180,10 +325,14 @@ const char* log_get_buffer_ptr(void)
 
 size_t log_get_size(void)
 {
-    if (log_mutex == NULL || log_file == NULL) {
+    if (log_mutex == NULL || !log_ready) {
         return 0;
     }
     
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    return log_flash_end();
+#else
+
     xSemaphoreTake(log_mutex, portMAX_DELAY);
     
     // Flush to ensure file is up to date
@@ -199,21 +348,37 @@ size_t log_get_size(void)
     xSemaphoreGive(log_mutex);
     
     return file_size;
+#endif
+}
+
+size_t log_get_start_offset(void)
+{
+    return log_ready ? backend_start() : 0;
 }
 
 void log_clear(void)
 {
-    if (log_mutex == NULL || log_file == NULL) {
+    if (log_mutex == NULL || !log_ready) {
         return;
     }
     
     xSemaphoreTake(log_mutex, portMAX_DELAY);
     
+#ifdef CONFIG_LOG_BACKEND_PARTITION
+    log_flash_clear();
+#else
     fclose(log_file);
+    if (read_file != NULL) {
+        fclose(read_file);
+        read_file = NULL;
+    }
     remove(LOG_FILE_PATH);
     remove(LOG_FILE_PATH ".old");
     
     log_file = fopen(LOG_FILE_PATH, "a");
+    file_end = 0;
+#endif
+    log_index_init(0, 0);
     boot_count = 0;
     
     xSemaphoreGive(log_mutex);
@@ -0,0 +1,120 @@
+#include "log_index.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include <string.h>
+
+#define NUM_SEGMENTS CONFIG_LOG_INDEX_SEGMENTS
+
+static log_segment_t segments[NUM_SEGMENTS];
+static uint32_t first_seq = 0;   // Oldest segment still held
+static uint32_t next_seq = 0;    // Segment currently being filled is next_seq - 1
+static bool open_segment = false;
+static portMUX_TYPE index_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint64_t log_index_tag_bit(const char *tag, size_t len)
+{
+    // FNV-1a folded to one of 64 bloom bits
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)tag[i];
+        hash *= 16777619u;
+    }
+    return 1ULL << (hash & 63);
+}
+
+static uint64_t record_tag_bit(const char *data, size_t len)
+{
+    if (len < 2 || data[0] != '[') {
+        return log_index_tag_bit("", 0);
+    }
+    const char *close = memchr(data + 1, ']', len - 1);
+    if (close == NULL) {
+        return log_index_tag_bit("", 0);
+    }
+    return log_index_tag_bit(data + 1, close - data - 1);
+}
+
+static void push_segment(const log_segment_t *seg)
+{
+    portENTER_CRITICAL(&index_lock);
+    segments[next_seq % NUM_SEGMENTS] = *seg;
+    next_seq++;
+    if (next_seq - first_seq > NUM_SEGMENTS) {
+        first_seq = next_seq - NUM_SEGMENTS;
+    }
+    portEXIT_CRITICAL(&index_lock);
+}
+
+void log_index_init(size_t existing_start, size_t existing_end)
+{
+    portENTER_CRITICAL(&index_lock);
+    first_seq = 0;
+    next_seq = 0;
+    open_segment = false;
+    portEXIT_CRITICAL(&index_lock);
+
+    if (existing_end > existing_start) {
+        // Records from earlier boots: no usable time or tags, match any tag at time 0
+        log_segment_t seg = {
+            .start = existing_start,
+            .end = existing_end,
+            .t_first = 0,
+            .t_last = 0,
+            .tag_mask = ~0ULL,
+        };
+        push_segment(&seg);
+    }
+}
+
+void log_index_add(size_t offset, const char *data, size_t len)
+{
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    uint64_t bit = record_tag_bit(data, len);
+
+    portENTER_CRITICAL(&index_lock);
+    log_segment_t *cur = open_segment ? &segments[(next_seq - 1) % NUM_SEGMENTS] : NULL;
+    bool fits = cur != NULL &&
+                cur->end == offset &&
+                offset + len - cur->start <= CONFIG_LOG_INDEX_SEGMENT_BYTES &&
+                now_ms - cur->t_first <= CONFIG_LOG_INDEX_WINDOW_MS;
+    if (fits) {
+        cur->end = offset + len;
+        cur->t_last = now_ms;
+        cur->tag_mask |= bit;
+    }
+    portEXIT_CRITICAL(&index_lock);
+
+    if (!fits) {
+        log_segment_t seg = {
+            .start = offset,
+            .end = offset + len,
+            .t_first = now_ms,
+            .t_last = now_ms,
+            .tag_mask = bit,
+        };
+        push_segment(&seg);
+        open_segment = true;
+    }
+}
+
+bool log_index_range(uint32_t *first, uint32_t *last)
+{
+    portENTER_CRITICAL(&index_lock);
+    bool any = next_seq != first_seq;
+    *first = first_seq;
+    *last = next_seq - 1;
+    portEXIT_CRITICAL(&index_lock);
+    return any;
+}
+
+bool log_index_get(uint32_t seq, log_segment_t *out)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&index_lock);
+    if ((int32_t)(seq - first_seq) >= 0 && (int32_t)(next_seq - seq) > 0) {
+        *out = segments[seq % NUM_SEGMENTS];
+        ok = true;
+    }
+    portEXIT_CRITICAL(&index_lock);
+    return ok;
+}
@@ -0,0 +1,255 @@
+#include "log_stream.h"
+#include "log_handler.h"
+#include "mem_policy.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_idf_version.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define RING_SIZE CONFIG_LOG_STREAM_RING_SIZE
+#define MAX_VIEWERS CONFIG_LOG_STREAM_MAX_VIEWERS
+#define KEEPALIVE_MS 15000
+
+static const char *TAG = "LOG_STREAM";
+
+typedef struct
+{
+    httpd_req_t *req;      // Async copy of the request, NULL when the slot is free
+    uint32_t cursor;       // Absolute ring position of the next byte to send
+    TickType_t last_send;
+} log_viewer_t;
+
+static char *ring = NULL;          // Allocated by log_stream_init(); records before that are not kept
+static uint32_t ring_head = 0;     // Total bytes ever written; position = head % RING_SIZE
+static uint32_t ring_reserve = 0;  // Head the writer is currently moving to
+
+static log_viewer_t viewers[MAX_VIEWERS];
+static portMUX_TYPE viewers_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t stream_task = NULL;
+static volatile int num_viewers = 0;
+
+// Only touched by the stream task
+static char copy_buf[512];
+static char out_buf[1024];
+
+void log_stream_push(const char *data, size_t len)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (len > RING_SIZE) {
+        data += len - RING_SIZE;
+        len = RING_SIZE;
+    }
+
+    uint32_t head = ring_head;
+    uint32_t pos = head % RING_SIZE;
+
+    // Announce the overwrite before touching the bytes so readers can detect it
+    __atomic_store_n(&ring_reserve, head + len, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    size_t first = RING_SIZE - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&ring[pos], data, first);
+    memcpy(&ring[0], data + first, len - first);
+
+    // Publish the bytes only after they are in place
+    __atomic_store_n(&ring_head, head + len, __ATOMIC_RELEASE);
+
+    if (num_viewers > 0 && stream_task != NULL) {
+        xTaskNotifyGive(stream_task);
+    }
+}
+
+/* Copies ring bytes starting at `cursor`; returns 0 if they were overwritten meanwhile */
+static size_t ring_copy(uint32_t cursor, uint32_t head, char *dst, size_t max)
+{
+    size_t len = head - cursor;
+    if (len > max) {
+        len = max;
+    }
+
+    uint32_t pos = cursor % RING_SIZE;
+    size_t first = RING_SIZE - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, &ring[pos], first);
+    memcpy(dst + first, &ring[0], len - first);
+
+    // The writer never waits for us, so validate the copy after the fact
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t now = __atomic_load_n(&ring_reserve, __ATOMIC_RELAXED);
+    if (now - cursor > RING_SIZE) {
+        return 0;
+    }
+    return len;
+}
+
+static void viewer_drop(int idx)
+{
+    httpd_req_t *req = viewers[idx].req;
+
+    portENTER_CRITICAL(&viewers_lock);
+    viewers[idx].req = NULL;
+    num_viewers--;
+    portEXIT_CRITICAL(&viewers_lock);
+
+    httpd_req_async_handler_complete(req);
+    log_write("[STREAM] Viewer %d disconnected", idx);
+}
+
+/* Sends everything the viewer has not seen yet, one SSE event per log line */
+static esp_err_t viewer_service(log_viewer_t *v)
+{
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+    while (v->cursor != head) {
+        if (head - v->cursor > RING_SIZE) {
+            uint32_t skipped = head - RING_SIZE - v->cursor;
+            v->cursor = head - RING_SIZE;
+            int n = snprintf(out_buf, sizeof(out_buf), "event: skip\ndata: %lu\n\n", skipped);
+            if (httpd_resp_send_chunk(v->req, out_buf, n) != ESP_OK) {
+                return ESP_FAIL;
+            }
+        }
+
+        size_t len = ring_copy(v->cursor, head, copy_buf, sizeof(copy_buf));
+        if (len == 0) {
+            // Lapped by the writer while copying, the skip is reported on the next pass
+            head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        // Only emit complete lines unless a single line fills the whole copy
+        size_t usable = len;
+        while (usable > 0 && copy_buf[usable - 1] != '\n') {
+            usable--;
+        }
+        if (usable == 0) {
+            if (len < sizeof(copy_buf)) {
+                break;
+            }
+            usable = len;
+        }
+
+        size_t out_len = 0;
+        size_t line_start = 0;
+        for (size_t i = 0; i < usable; i++) {
+            if (copy_buf[i] != '\n' && i != usable - 1) {
+                continue;
+            }
+            size_t line_len = i - line_start + (copy_buf[i] != '\n');
+            if (out_len + line_len + 8 > sizeof(out_buf)) {
+                if (httpd_resp_send_chunk(v->req, out_buf, out_len) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+                out_len = 0;
+            }
+            memcpy(&out_buf[out_len], "data: ", 6);
+            memcpy(&out_buf[out_len + 6], &copy_buf[line_start], line_len);
+            out_len += 6 + line_len;
+            out_buf[out_len++] = '\n';
+            out_buf[out_len++] = '\n';
+            line_start = i + 1;
+        }
+        if (out_len > 0 && httpd_resp_send_chunk(v->req, out_buf, out_len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+
+        v->cursor += usable;
+        v->last_send = xTaskGetTickCount();
+    }
+
+    if (xTaskGetTickCount() - v->last_send > pdMS_TO_TICKS(KEEPALIVE_MS)) {
+        // SSE comment, lets us notice viewers that went away silently
+        if (httpd_resp_send_chunk(v->req, ": ping\n\n", 8) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        v->last_send = xTaskGetTickCount();
+    }
+    return ESP_OK;
+}
+
+static void log_stream_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(KEEPALIVE_MS));
+
+        for (int i = 0; i < MAX_VIEWERS; i++) {
+            if (viewers[i].req == NULL) {
+                continue;
+            }
+            if (viewer_service(&viewers[i]) != ESP_OK) {
+                viewer_drop(i);
+            }
+        }
+    }
+}
+
+esp_err_t log_stream_attach(httpd_req_t *req)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    int slot = -1;
+    for (int i = 0; i < MAX_VIEWERS; i++) {
+        if (viewers[i].req == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        log_write("[STREAM] Rejecting viewer, all %d slots in use", MAX_VIEWERS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    httpd_req_t *async_req = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &async_req);
+    if (err != ESP_OK) {
+        log_write_err("[STREAM] ERROR: Failed to detach request: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Start with whatever history is still in the ring
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    viewers[slot].cursor = (head > RING_SIZE) ? head - RING_SIZE : 0;
+    viewers[slot].last_send = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&viewers_lock);
+    viewers[slot].req = async_req;
+    num_viewers++;
+    portEXIT_CRITICAL(&viewers_lock);
+
+    log_write("[STREAM] Viewer %d attached", slot);
+    xTaskNotifyGive(stream_task);
+    return ESP_OK;
+#else
+    (void)req;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t log_stream_init(void)
+{
+    memset(viewers, 0, sizeof(viewers));
+    ring = mem_alloc(MEM_USE_LOG, RING_SIZE);
+    if (ring == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d byte log stream ring", RING_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t ret = xTaskCreate(log_stream_task, "log_stream", 3072, NULL, 1, &stream_task);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log stream task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
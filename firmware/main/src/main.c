@@ -2,50 +2,95 @@
 #include "log_handler.h"
 #include "http_server.h"
 #include "tcp_connect.h"
+#include "urb_stats.h"
+#include "usbip_capture.h"
+#include "usbmon.h"
+#include "flight_rec.h"
+#include "boot_timeline.h"
+#include "wifi_ps.h"
+#include "urb_budget.h"
+#include "urb_watchdog.h"
+#include "session_arena.h"
+#include "mem_pressure.h"
 #include "esp_system.h"
 #include "sdkconfig.h"
 #include <inttypes.h>
 
+/* Mounts log storage off the critical boot path (SPIFFS may format on first boot) */
+static void boot_storage_task(void *arg)
+{
+    log_handler_start();
+    boot_timeline_mark(BOOT_EV_STORAGE_READY);
+    log_write("[MAIN] Log storage ready (Boot #%" PRIu32 ")", log_get_boot_count());
+    flight_rec_log_crash();
+    vTaskDelete(NULL);
+}
+
+/* Brings up the TCP/IP stack and blocks until Wi-Fi has an IP address */
+static void boot_net_task(void *arg)
+{
+    tcp_server_init();
+    vTaskDelete(NULL);
+}
+
 int app_main(void)
 {
-    // Initialize the log handler first
+    // Cheap: records are held in RAM until storage is mounted
     log_handler_init();
+    boot_timeline_init();
+    
+    // Save what was going on before a crash before anything records new events
+    flight_rec_init();
     
-    uint32_t boot = log_get_boot_count();
     log_write("[MAIN] ========================================");
-    log_write("[MAIN] ESP32 USB Repeater Starting (Boot #%" PRIu32 ")", boot);
+    log_write("[MAIN] ESP32 USB Repeater Starting");
     log_write("[MAIN] ========================================");
     
-    // Initialize network/TCP stack
-    log_write("[MAIN] Initializing network...");
-    tcp_server_init();
+    // Latency histograms must be ready before the first URB is stamped
+    urb_stats_init();
+    urb_budget_init();
+    session_arena_init();
+    urb_watchdog_init();
+    mem_pressure_init();
+    usbip_capture_init();
+    usbmon_init();
+    wifi_ps_init();
     
-    // Initialize USB/IP server BEFORE starting TCP server (must create event loop first!)
+    // Log storage, Wi-Fi and the USB host come up concurrently; later stages
+    // wait for the boot_timeline bits they depend on
+    log_write("[MAIN] Starting log storage and network in parallel...");
+    xTaskCreate(boot_storage_task, "boot_storage", 4096, NULL, 4, NULL);
+    xTaskCreate(boot_net_task, "boot_net", 4096, NULL, 5, NULL);
+    
+    // Installs the USB host library and enumerates the device in its own tasks
     log_write("[MAIN] Initializing USB/IP server...");
     usbip_server_init();
     
-    // Start TCP server on port 3240 for USB/IP (large stack for network operations)
+    // Start TCP server on port 3240 for USB/IP (stack sized by the device profile);
+    // it waits for Wi-Fi itself
     log_write("[MAIN] Free heap before TCP server: %d bytes", esp_get_free_heap_size());
     log_write("[MAIN] Starting TCP server on port 3240...");
     TaskHandle_t tcp_task_handle;
-    BaseType_t ret = xTaskCreate(tcp_server_start, "tcp_server", 12288, NULL, 5, &tcp_task_handle);
+    BaseType_t ret = xTaskCreate(tcp_server_start, "tcp_server", CONFIG_USBIP_TCP_TASK_STACK_SIZE, NULL, 5, &tcp_task_handle);
     if (ret != pdPASS) {
-        log_write("[MAIN] ERROR: Failed to create TCP server task!");
+        log_write_err("[MAIN] ERROR: Failed to create TCP server task!");
     } else {
         log_write("[MAIN] TCP server task created successfully");
     }
     
 #ifdef CONFIG_ENABLE_HTTP_SERVER
-    // Start HTTP server for log access
+    // The HTTP server only needs the TCP/IP stack, not an IP address
+    boot_timeline_wait(BOOT_BIT(BOOT_EV_NET_UP), portMAX_DELAY);
     log_write("[MAIN] Starting HTTP server on port 8080...");
-    http_server_init();
+    if (http_server_init() == ESP_OK) {
+        boot_timeline_mark(BOOT_EV_HTTP_READY);
+    }
 #endif
     
     log_write("[MAIN] All systems initialized successfully");
-    log_write("[MAIN] USB/IP server listening on port 3240");
 #ifdef CONFIG_ENABLE_HTTP_SERVER
-    log_write("[MAIN] HTTP log server listening on port 8080");
+    log_write("[MAIN] HTTP log server listening on port 8080, boot timeline at /boot");
 #endif
     
     return 0;
-}
\ No newline at end of file
+}
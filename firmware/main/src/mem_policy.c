@@ -0,0 +1,119 @@
+#include "mem_policy.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+
+#define INTERNAL_CAPS   (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define SPIRAM_CAPS     (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+
+static const char *use_names[MEM_USE_COUNT] = {
+    "log", "capture", "cache", "http"
+};
+
+static const bool use_spiram[MEM_USE_COUNT] = {
+#ifdef CONFIG_MEM_LOG_SPIRAM
+    [MEM_USE_LOG] = true,
+#endif
+#ifdef CONFIG_MEM_CAPTURE_SPIRAM
+    [MEM_USE_CAPTURE] = true,
+#endif
+#ifdef CONFIG_MEM_CACHE_SPIRAM
+    [MEM_USE_CACHE] = true,
+#endif
+#ifdef CONFIG_MEM_HTTP_SPIRAM
+    [MEM_USE_HTTP] = true,
+#endif
+};
+
+static mem_use_stats_t stats[MEM_USE_COUNT];
+static portMUX_TYPE mem_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void account(mem_use_t use, void *ptr, bool fallback)
+{
+    mem_use_stats_t *st = &stats[use];
+
+    portENTER_CRITICAL(&mem_lock);
+    if (ptr == NULL) {
+        st->failures++;
+    } else {
+        size_t size = heap_caps_get_allocated_size(ptr);
+        if (esp_ptr_external_ram(ptr)) {
+            st->spiram += size;
+        } else {
+            st->internal += size;
+        }
+        if (st->internal + st->spiram > st->peak) {
+            st->peak = st->internal + st->spiram;
+        }
+        st->allocs++;
+        st->fallbacks += fallback;
+    }
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+void *mem_alloc(mem_use_t use, size_t size)
+{
+    void *ptr = NULL;
+    bool fallback = false;
+
+    if (use_spiram[use]) {
+        ptr = heap_caps_malloc(size, SPIRAM_CAPS);
+        fallback = ptr == NULL;
+    }
+    if (ptr == NULL) {
+        ptr = heap_caps_malloc(size, INTERNAL_CAPS);
+    }
+    account(use, ptr, fallback && ptr != NULL);
+    return ptr;
+}
+
+void *mem_calloc(mem_use_t use, size_t n, size_t size)
+{
+    void *ptr = NULL;
+    bool fallback = false;
+
+    if (use_spiram[use]) {
+        ptr = heap_caps_calloc(n, size, SPIRAM_CAPS);
+        fallback = ptr == NULL;
+    }
+    if (ptr == NULL) {
+        ptr = heap_caps_calloc(n, size, INTERNAL_CAPS);
+    }
+    account(use, ptr, fallback && ptr != NULL);
+    return ptr;
+}
+
+void mem_free(mem_use_t use, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    size_t size = heap_caps_get_allocated_size(ptr);
+    bool external = esp_ptr_external_ram(ptr);
+    heap_caps_free(ptr);
+
+    portENTER_CRITICAL(&mem_lock);
+    if (external) {
+        stats[use].spiram -= size;
+    } else {
+        stats[use].internal -= size;
+    }
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+bool mem_use_in_spiram(mem_use_t use)
+{
+    return use_spiram[use];
+}
+
+const char *mem_use_name(mem_use_t use)
+{
+    return use < MEM_USE_COUNT ? use_names[use] : "?";
+}
+
+void mem_get_stats(mem_use_t use, mem_use_stats_t *out)
+{
+    portENTER_CRITICAL(&mem_lock);
+    *out = stats[use];
+    portEXIT_CRITICAL(&mem_lock);
+}
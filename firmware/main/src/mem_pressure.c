@@ -0,0 +1,119 @@
+#include "mem_pressure.h"
+#include "log_handler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#define POLL_MS         CONFIG_MEM_PRESSURE_POLL_MS
+#define HYSTERESIS      CONFIG_MEM_PRESSURE_HYSTERESIS_BYTES
+
+/* Free heap below which each tier is entered; index 0 is never entered this way */
+static const uint32_t enter_below[MEM_PRESSURE_TIER_COUNT] = {
+    0,
+    CONFIG_MEM_PRESSURE_QUIET_BYTES,
+    CONFIG_MEM_PRESSURE_SHED_BYTES,
+    CONFIG_MEM_PRESSURE_CRITICAL_BYTES,
+};
+
+static const char *tier_names[MEM_PRESSURE_TIER_COUNT] = {
+    "normal", "quiet", "shed", "critical"
+};
+
+static volatile mem_pressure_tier_t tier = MEM_PRESSURE_NORMAL;
+static int64_t tier_since_us = 0;
+static mem_pressure_stats_t stats;
+static portMUX_TYPE pressure_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Highest tier whose threshold free heap is under; tiers at or below the
+ * current one keep holding until heap clears threshold plus hysteresis */
+static mem_pressure_tier_t tier_for(uint32_t heap, mem_pressure_tier_t current)
+{
+    mem_pressure_tier_t t = MEM_PRESSURE_NORMAL;
+    for (int i = MEM_PRESSURE_QUIET; i < MEM_PRESSURE_TIER_COUNT; i++) {
+        uint32_t limit = enter_below[i] + (i <= current ? HYSTERESIS : 0);
+        if (heap < limit) {
+            t = i;
+        }
+    }
+    return t;
+}
+
+static void mem_pressure_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+
+        uint32_t heap = esp_get_free_heap_size();
+        mem_pressure_tier_t old = tier;
+        mem_pressure_tier_t now = tier_for(heap, old);
+        int64_t t = esp_timer_get_time();
+
+        portENTER_CRITICAL(&pressure_lock);
+        stats.free_heap = heap;
+        if (heap < stats.min_free_heap) {
+            stats.min_free_heap = heap;
+        }
+        if (now != old) {
+            stats.time_us[old] += t - tier_since_us;
+            tier_since_us = t;
+            stats.entered[now]++;
+            stats.changes++;
+            stats.tier = now;
+            tier = now;
+        }
+        portEXIT_CRITICAL(&pressure_lock);
+
+        if (now != old) {
+            // Kept even while log records are being shed
+            log_write_err("[PRESSURE] %s -> %s, free heap %lu bytes", tier_names[old], tier_names[now], heap);
+        }
+    }
+}
+
+esp_err_t mem_pressure_init(void)
+{
+    stats.free_heap = esp_get_free_heap_size();
+    stats.min_free_heap = stats.free_heap;
+    tier_since_us = esp_timer_get_time();
+    if (xTaskCreate(mem_pressure_task, "mem_pressure", 2560, NULL, 6, NULL) != pdPASS) {
+        log_write_err("[PRESSURE] ERROR: Failed to create monitor task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+mem_pressure_tier_t mem_pressure_tier(void)
+{
+    return tier;
+}
+
+uint32_t mem_pressure_max_urbs(void)
+{
+    if (tier >= MEM_PRESSURE_CRITICAL && CONFIG_MEM_PRESSURE_CRITICAL_URBS < CONFIG_URB_BUDGET_MAX_URBS) {
+        return CONFIG_MEM_PRESSURE_CRITICAL_URBS;
+    }
+    return CONFIG_URB_BUDGET_MAX_URBS;
+}
+
+void mem_pressure_note_drop(mem_pressure_drop_t what)
+{
+    portENTER_CRITICAL(&pressure_lock);
+    stats.dropped[what]++;
+    portEXIT_CRITICAL(&pressure_lock);
+}
+
+const char *mem_pressure_tier_name(mem_pressure_tier_t t)
+{
+    return t < MEM_PRESSURE_TIER_COUNT ? tier_names[t] : "?";
+}
+
+void mem_pressure_get_stats(mem_pressure_stats_t *out)
+{
+    int64_t t = esp_timer_get_time();
+
+    portENTER_CRITICAL(&pressure_lock);
+    *out = stats;
+    out->time_us[stats.tier] += t - tier_since_us;
+    portEXIT_CRITICAL(&pressure_lock);
+}
@@ -0,0 +1,122 @@
+#include "pcapng.h"
+#include <string.h>
+
+#define BLOCK_SHB   0x0A0D0D0A
+#define BLOCK_IDB   0x00000001
+#define BLOCK_EPB   0x00000006
+
+#define OPT_END         0
+#define OPT_IF_NAME     2
+
+#define PAD4(n)     (((n) + 3) & ~3u)
+
+static void put(pcapng_writer_t *w, const void *data, size_t len)
+{
+    const uint8_t *src = (const uint8_t *)data;
+
+    while (len > 0 && w->err == ESP_OK) {
+        size_t n = sizeof(w->buf) - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[w->len], src, n);
+        w->len += n;
+        src += n;
+        len -= n;
+
+        if (w->len == sizeof(w->buf)) {
+            w->err = w->write(w->buf, w->len, w->ctx);
+            w->len = 0;
+        }
+    }
+}
+
+static void put_u16(pcapng_writer_t *w, uint16_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void put_u32(pcapng_writer_t *w, uint32_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void put_pad(pcapng_writer_t *w, size_t len)
+{
+    static const uint8_t zero[3] = { 0 };
+    put(w, zero, PAD4(len) - len);
+}
+
+void pcapng_begin(pcapng_writer_t *w, pcapng_write_fn write, void *ctx)
+{
+    w->write = write;
+    w->ctx = ctx;
+    w->err = ESP_OK;
+    w->len = 0;
+
+    // Blocks are written in host byte order; readers use the magic to tell
+    const uint32_t block_len = 28;
+    put_u32(w, BLOCK_SHB);
+    put_u32(w, block_len);
+    put_u32(w, 0x1A2B3C4D);
+    put_u16(w, 1);
+    put_u16(w, 0);
+    put_u32(w, 0xFFFFFFFF);     // Section length unknown
+    put_u32(w, 0xFFFFFFFF);
+    put_u32(w, block_len);
+}
+
+void pcapng_add_interface(pcapng_writer_t *w, uint16_t linktype, uint32_t snaplen, const char *name)
+{
+    size_t name_len = name ? strlen(name) : 0;
+    uint32_t opt_len = name_len ? 4 + PAD4(name_len) + 4 : 0;
+    uint32_t block_len = 20 + opt_len;
+
+    put_u32(w, BLOCK_IDB);
+    put_u32(w, block_len);
+    put_u16(w, linktype);
+    put_u16(w, 0);
+    put_u32(w, snaplen);
+    if (name_len) {
+        put_u16(w, OPT_IF_NAME);
+        put_u16(w, name_len);
+        put(w, name, name_len);
+        put_pad(w, name_len);
+        put_u16(w, OPT_END);
+        put_u16(w, 0);
+    }
+    put_u32(w, block_len);
+}
+
+void pcapng_add_packet(pcapng_writer_t *w, uint32_t if_id, uint64_t ts_us,
+                       const void *hdr, size_t hdr_len,
+                       const void *data, size_t data_len, uint32_t orig_len)
+{
+    size_t cap_len = hdr_len + data_len;
+    uint32_t block_len = 32 + PAD4(cap_len);
+
+    put_u32(w, BLOCK_EPB);
+    put_u32(w, block_len);
+    put_u32(w, if_id);
+    put_u32(w, (uint32_t)(ts_us >> 32));
+    put_u32(w, (uint32_t)ts_us);
+    put_u32(w, cap_len);
+    put_u32(w, orig_len);
+    if (hdr_len) {
+        put(w, hdr, hdr_len);
+    }
+    if (data_len) {
+        put(w, data, data_len);
+    }
+    put_pad(w, cap_len);
+    put_u32(w, block_len);
+}
+
+esp_err_t pcapng_end(pcapng_writer_t *w)
+{
+    if (w->len > 0 && w->err == ESP_OK) {
+        w->err = w->write(w->buf, w->len, w->ctx);
+    }
+    w->len = 0;
+    return w->err;
+}
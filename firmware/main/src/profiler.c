@@ -0,0 +1,82 @@
+#include "profiler.h"
+#include "mem_policy.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const struct
+{
+    const char *name;
+    uint32_t caps;
+} heap_kinds[PROFILER_HEAP_KINDS] = {
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "dma",      MALLOC_CAP_DMA },
+    { "spiram",   MALLOC_CAP_SPIRAM },
+};
+
+profiler_snapshot_t *profiler_snapshot(void)
+{
+    // Leave room for tasks created between sizing and sampling
+    UBaseType_t max_tasks = uxTaskGetNumberOfTasks() + 4;
+
+    TaskStatus_t *status = mem_alloc(MEM_USE_HTTP, max_tasks * sizeof(TaskStatus_t));
+    profiler_snapshot_t *snap = mem_alloc(MEM_USE_HTTP, sizeof(profiler_snapshot_t) + max_tasks * sizeof(profiler_task_t));
+    if (status == NULL || snap == NULL) {
+        mem_free(MEM_USE_HTTP, status);
+        mem_free(MEM_USE_HTTP, snap);
+        return NULL;
+    }
+
+    uint32_t total_runtime = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, max_tasks, &total_runtime);
+
+    snap->timestamp_us = esp_timer_get_time();
+    snap->total_runtime = total_runtime;
+    snap->num_tasks = n;
+    for (UBaseType_t i = 0; i < n; i++) {
+        profiler_task_t *t = &snap->tasks[i];
+        t->handle = status[i].xHandle;
+        strlcpy(t->name, status[i].pcTaskName, sizeof(t->name));
+        t->priority = status[i].uxCurrentPriority;
+        t->state = status[i].eCurrentState;
+        t->stack_free = status[i].usStackHighWaterMark;  // StackType_t is a byte on ESP-IDF
+        t->runtime = status[i].ulRunTimeCounter;
+    }
+    mem_free(MEM_USE_HTTP, status);
+
+    for (int k = 0; k < PROFILER_HEAP_KINDS; k++) {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, heap_kinds[k].caps);
+        profiler_heap_t *h = &snap->heap[k];
+        h->name = heap_kinds[k].name;
+        h->total = heap_caps_get_total_size(heap_kinds[k].caps);
+        h->free = info.total_free_bytes;
+        h->min_free = info.minimum_free_bytes;
+        h->largest = info.largest_free_block;
+    }
+
+    return snap;
+}
+
+const profiler_task_t *profiler_find_task(const profiler_snapshot_t *snap, TaskHandle_t handle)
+{
+    for (UBaseType_t i = 0; i < snap->num_tasks; i++) {
+        if (snap->tasks[i].handle == handle) {
+            return &snap->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+const char *profiler_state_name(eTaskState state)
+{
+    switch (state) {
+        case eRunning:   return "run";
+        case eReady:     return "ready";
+        case eBlocked:   return "block";
+        case eSuspended: return "susp";
+        case eDeleted:   return "del";
+        default:         return "?";
+    }
+}
@@ -0,0 +1,163 @@
+#include "session_arena.h"
+#include "urb_ledger.h"
+#include "log_handler.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+#define NUM_SLOTS           CONFIG_URB_BUDGET_MAX_URBS  // The budget bounds URBs in flight
+#define SLOT_MAX_MPS        512     // Largest bulk packet; IN transfers are rounded up to whole packets
+#define SLOT_DATA_SIZE      ((USBIP_MAX_TRANSFER_SIZE + SLOT_MAX_MPS - 1) / SLOT_MAX_MPS * SLOT_MAX_MPS)
+#define SLOT_TRANSFER_SIZE  (sizeof(usb_setup_packet_t) + SLOT_DATA_SIZE)   // Setup packet plus the largest rounded transfer
+
+typedef struct
+{
+    usb_device_handle_t dev;
+    uint8_t ep;
+} cancel_t;
+
+static urb_slot_t slots[NUM_SLOTS];
+static uint32_t bump = 0;               // Slots below this have been handed out since the last reset
+static urb_slot_t *free_list = NULL;
+static bool reset_pending = false;
+static portMUX_TYPE arena_lock = portMUX_INITIALIZER_UNLOCKED;
+static session_arena_stats_t stats;
+
+/* Caller holds arena_lock */
+static void arena_reset(void)
+{
+    bump = 0;
+    free_list = NULL;
+    reset_pending = false;
+    stats.resets++;
+}
+
+esp_err_t session_arena_init(void)
+{
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        esp_err_t err = usb_host_transfer_alloc(SLOT_TRANSFER_SIZE, 0, &slots[i].transfer);
+        if (err != ESP_OK) {
+            log_write_err("[ARENA] ERROR: Failed to allocate transfer %d: %s", i, esp_err_to_name(err));
+            return err;
+        }
+    }
+    stats.slots = NUM_SLOTS;
+    log_write("[ARENA] %d URB slots, %u bytes", NUM_SLOTS, (unsigned)sizeof(slots));
+    return ESP_OK;
+}
+
+urb_slot_t *session_arena_alloc(void)
+{
+    urb_slot_t *slot = NULL;
+
+    portENTER_CRITICAL(&arena_lock);
+    if (free_list != NULL) {
+        slot = free_list;
+        free_list = slot->next_free;
+    } else if (bump < NUM_SLOTS && slots[bump].transfer != NULL) {
+        slot = &slots[bump++];
+    }
+    if (slot == NULL) {
+        stats.exhausted++;
+    } else {
+        slot->next_free = NULL;
+        slot->generation = stats.generation;
+        slot->on_bus = false;
+        stats.in_use++;
+        if (stats.in_use > stats.peak) {
+            stats.peak = stats.in_use;
+        }
+    }
+    portEXIT_CRITICAL(&arena_lock);
+    return slot;
+}
+
+void session_arena_free(urb_slot_t *slot)
+{
+    portENTER_CRITICAL(&arena_lock);
+    slot->on_bus = false;
+    slot->next_free = free_list;
+    free_list = slot;
+    stats.in_use--;
+    if (stats.in_use == 0 && reset_pending) {
+        arena_reset();
+    }
+    portEXIT_CRITICAL(&arena_lock);
+}
+
+bool session_arena_is_stale(const urb_slot_t *slot)
+{
+    bool stale;
+
+    portENTER_CRITICAL(&arena_lock);
+    stale = slot->generation != stats.generation;
+    if (stale) {
+        stats.dropped++;
+    }
+    portEXIT_CRITICAL(&arena_lock);
+    return stale;
+}
+
+void session_arena_set_on_bus(urb_slot_t *slot, bool on_bus)
+{
+    portENTER_CRITICAL(&arena_lock);
+    slot->on_bus = on_bus;
+    portEXIT_CRITICAL(&arena_lock);
+}
+
+void session_arena_teardown(void)
+{
+    cancel_t cancel[NUM_SLOTS];
+    int n = 0;
+
+    urb_ledger_report("Session ended");
+
+    portENTER_CRITICAL(&arena_lock);
+    stats.generation++;
+    if (stats.in_use == 0) {
+        arena_reset();
+    } else {
+        reset_pending = true;
+        // EP0 cannot be flushed; its transfers complete on their own
+        for (uint32_t i = 0; i < bump; i++) {
+            usb_transfer_t *t = slots[i].transfer;
+            if (!slots[i].on_bus || (t->bEndpointAddress & 0x0F) == 0) {
+                continue;
+            }
+            bool seen = false;
+            for (int j = 0; j < n; j++) {
+                seen |= cancel[j].ep == t->bEndpointAddress && cancel[j].dev == t->device_handle;
+            }
+            if (!seen) {
+                cancel[n].dev = t->device_handle;
+                cancel[n].ep = t->bEndpointAddress;
+                n++;
+            }
+        }
+        stats.cancelled += n;
+    }
+    uint32_t in_use = stats.in_use;
+    portEXIT_CRITICAL(&arena_lock);
+
+    if (in_use > 0) {
+        log_write("[ARENA] Session ended with %lu URB(s) outstanding, cancelling %d endpoint(s)", in_use, n);
+    }
+    for (int i = 0; i < n; i++) {
+        esp_err_t err = usb_host_endpoint_halt(cancel[i].dev, cancel[i].ep);
+        if (err == ESP_OK) {
+            err = usb_host_endpoint_flush(cancel[i].dev, cancel[i].ep);
+        }
+        if (err == ESP_OK) {
+            err = usb_host_endpoint_clear(cancel[i].dev, cancel[i].ep);
+        }
+        if (err != ESP_OK) {
+            log_write_err("[ARENA] ERROR: Failed to cancel EP 0x%02x: %s", cancel[i].ep, esp_err_to_name(err));
+        }
+    }
+}
+
+void session_arena_get_stats(session_arena_stats_t *out)
+{
+    portENTER_CRITICAL(&arena_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&arena_lock);
+}
@@ -1,6 +1,15 @@
 #include "tcp_connect.h"
 #include "log_handler.h"
 #include "usb_handler.h"
+#include "usbip_capture.h"
+#include "flight_rec.h"
+#include "boot_timeline.h"
+#include "wifi_manager.h"
+#include "wifi_ps.h"
+#include "usbip_session.h"
+#include "urb_budget.h"
+#include "session_arena.h"
+#include "urb_ledger.h"
 #include "esp_system.h"
 #include <errno.h>
 #include <string.h>
@@ -13,7 +22,7 @@
 bool device_busy = false;
 static int sock;
 static SemaphoreHandle_t sock_mutex = NULL;
-static submit recv_submit;
+static volatile bool link_lost = false;  // Connection torn down because Wi-Fi dropped
 // static ssize_t size;
 // static char rx_buffer[128];
 
@@ -23,13 +32,74 @@ int tcp_send_locked(int socket, const void *data, size_t length, int flags)
     int result = -1;
     if (sock_mutex != NULL && xSemaphoreTake(sock_mutex, portMAX_DELAY) == pdTRUE) {
         result = send(socket, data, length, flags);
+        if (result > 0) {
+            usbip_capture_frame(USBIP_CAPTURE_TX, data, result, NULL, 0);
+        }
         xSemaphoreGive(sock_mutex);
     } else {
-        log_write("[TCP] ERROR: Failed to acquire socket mutex");
+        log_write_err("[TCP] ERROR: Failed to acquire socket mutex");
     }
     return result;
 }
 
+/* Discards the OUT data of a URB that will not be submitted so the next header lines up */
+static bool drain_payload(int s, uint32_t len)
+{
+    uint8_t scratch[128];
+    while (len > 0) {
+        int n = recv(s, scratch, len < sizeof(scratch) ? len : sizeof(scratch), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            log_write_err("[TCP] ERROR: Lost the stream while discarding %lu bytes of OUT data", len);
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+/* Reads the OUT data of a URB in full; the receive timeout and short segments only mean waiting longer */
+static bool recv_payload(int s, uint8_t *buf, uint32_t len)
+{
+    while (len > 0) {
+        int n = recv(s, buf, len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            log_write_err("[TCP] ERROR: Lost the stream with %lu bytes of OUT data outstanding", len);
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+/* Wi-Fi dropped: suspend the attached session now so the reconnecting client is accepted at once */
+static void wifi_lost_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (device_busy && sock > 0) {
+        link_lost = true;
+        shutdown(sock, SHUT_RDWR);
+    }
+}
+
+/* OP_REQ_RESUME: the rest of the request follows the common header */
+static bool handle_resume(void)
+{
+    op_req_resume req;
+    if (recv(sock, &req, sizeof(req), MSG_WAITALL) != sizeof(req)) {
+        log_write_err("[TCP] ERROR: Short OP_REQ_RESUME");
+        return false;
+    }
+    return usbip_session_resume(sock, ntohl(req.session_id), ntohl(req.last_seqnum));
+}
+#endif
+
 esp_err_t tcp_server_init(void)
 {
     log_write("[TCP] Initializing NVS flash...");
@@ -40,14 +110,35 @@ esp_err_t tcp_server_init(void)
     
     log_write("[TCP] Creating event loop...");
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+    boot_timeline_mark(BOOT_EV_NET_UP);
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+    esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_lost_handler, NULL);
+#endif
     
     log_write("[TCP] Connecting to network...");
+#ifdef CONFIG_ENABLE_WIFI_MANAGER
+    ESP_ERROR_CHECK(wifi_manager_start());
+#else
     ESP_ERROR_CHECK(example_connect());
+#endif
+    boot_timeline_mark(BOOT_EV_WIFI_CONNECTED);
     
     log_write("[TCP] Network initialization complete");
     return ESP_OK;
 }
 
+void tcp_server_drop_session(void)
+{
+    // Ended first, so do_recv() tears down instead of holding the session for a
+    // resume that would land on whatever device is plugged in next
+    usbip_session_end();
+    if (device_busy && sock > 0) {
+        log_write("[TCP] Device gone, closing USB/IP session");
+        // Wakes do_recv() with EOF; it cleans up and closes the socket
+        shutdown(sock, SHUT_RDWR);
+    }
+}
+
 static void do_recv()
 {
     log_write("[TCP] *** do_recv() task started ***");
@@ -72,7 +163,7 @@ static void do_recv()
                     continue;
                 }
                 ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
-                log_write("[TCP] ERROR: recv failed, errno %d (%s)", errno, strerror(errno));
+                log_write_err("[TCP] ERROR: recv failed, errno %d (%s)", errno, strerror(errno));
                 break;
             }
             else if (len == 0)
@@ -88,12 +179,19 @@ static void do_recv()
                 log_write("[TCP] Received %d bytes, version=0x%04x, command=0x%04x", 
                          len, ntohs(dev_recv.usbip_version), ntohs(dev_recv.command_code));
                 
+#ifdef CONFIG_ENABLE_USBIP_RESUME
+                if (ntohs(dev_recv.usbip_version) == USBIP_VERSION && ntohs(dev_recv.command_code) == OP_REQ_RESUME)
+                {
+                    device_busy = handle_resume();
+                }
+                else
+#endif
                 if (ntohs(dev_recv.usbip_version) == USBIP_VERSION)
                 {
                     log_write("[TCP] Valid USB/IP command received: 0x%04x", ntohs(dev_recv.command_code));
                     
                     if (loop_handle == NULL) {
-                        log_write("[TCP] ERROR: Event loop not initialized!");
+                        log_write_err("[TCP] ERROR: Event loop not initialized!");
                         ESP_LOGE(TAG, "Event loop handle is NULL!");
                         break;
                     }
@@ -107,7 +205,7 @@ static void do_recv()
                     esp_err_t err = esp_event_post_to(loop_handle, USBIP_EVENT_BASE, ntohs(dev_recv.command_code), 
                                                        (void *)&buffer, sizeof(tcp_data), portMAX_DELAY);
                     if (err != ESP_OK) {
-                        log_write("[TCP] ERROR: Failed to post event: %s", esp_err_to_name(err));
+                        log_write_err("[TCP] ERROR: Failed to post event: %s", esp_err_to_name(err));
                     } else {
                         log_write("[TCP] Event posted successfully");
                     }
@@ -124,14 +222,14 @@ static void do_recv()
                         if (device_busy) {
                             log_write("[TCP] Import complete, device_busy set after %d ms", wait_count * 10);
                         } else {
-                            log_write("[TCP] WARNING: device_busy not set after 1 second wait!");
+                            log_write_err("[TCP] WARNING: device_busy not set after 1 second wait!");
                         }
                     }
                 }
                 else
                 {
-                    log_write("[TCP] ERROR: Invalid USB/IP version: 0x%04x (expected 0x%04x)", 
-                             ntohs(dev_recv.usbip_version), USBIP_VERSION);
+                    log_write_err("[TCP] ERROR: Invalid USB/IP version: 0x%04x (expected 0x%04x)", 
+                                 ntohs(dev_recv.usbip_version), USBIP_VERSION);
                 }
             }
         }
@@ -151,18 +249,20 @@ static void do_recv()
             int pending = 0;
             ret = ioctl(sock, FIONREAD, &pending);
             if (ret < 0) {
-                log_write("[TCP] WARNING: ioctl(FIONREAD) failed, errno=%d (%s)", errno, strerror(errno));
+                log_write_err("[TCP] WARNING: ioctl(FIONREAD) failed, errno=%d (%s)", errno, strerror(errno));
             } else {
                 log_write("[TCP] Pending bytes in socket buffer: %d", pending);
             }
             
             /* TODO : Start dealing with URB command codes */
             usbip_header_basic header;
+            bool stream_lost = false;   // A URB was cut short; the next header would be misaligned
             len = 0;
-            while (1)
+            while (!stream_lost)
             {
                 log_write("[TCP] Waiting for URB header (%d bytes)...", sizeof(usbip_header_basic));
                 len = recv(sock, &header, sizeof(usbip_header_basic), 0);
+                int64_t t_recv = URB_STATS_NOW();
 
                 if (len < 0) {
                     if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -170,17 +270,22 @@ static void do_recv()
                         log_write("[TCP] URB socket receive timeout, continuing to wait...");
                         continue;
                     }
-                    log_write("[TCP] ERROR: recv failed in URB loop, errno %d (%s)", errno, strerror(errno));
+                    log_write_err("[TCP] ERROR: recv failed in URB loop, errno %d (%s)", errno, strerror(errno));
                     break;
                 } else if (len == 0) {
+                    if (link_lost) {
+                        log_write("[TCP] Wi-Fi link lost while attached");
+                        break;
+                    }
                     log_write("[TCP] Connection closed in URB loop - client detached");
                     log_write("[TCP] Cleaning up and resetting device_busy flag...");
+                    usbip_session_end();
                     device_busy = false;
                     break; // Exit URB loop, close socket, wait for new connection
                 } else if (len > 0)
                 {
                     uint32_t cmd = ntohl(header.command);
-                    log_write("[TCP] Received URB command: 0x%08x, seqnum=%u", cmd, ntohl(header.seqnum));
+                    log_write("[TCP] Received URB command: 0x%08lx, seqnum=%lu", cmd, ntohl(header.seqnum));
                     
                     switch (cmd)
                     {
@@ -189,45 +294,97 @@ static void do_recv()
                         log_write("[TCP] USBIP_CMD_SUBMIT received, reading command data...");
                         usbip_cmd_submit cmd_submit;
                         
-                        // Read cmd_submit header (without transfer_buffer)
-                        int cmd_header_size = sizeof(usbip_cmd_submit) - 1024;
+                        // Read cmd_submit header; OUT data follows it
+                        int cmd_header_size = sizeof(usbip_cmd_submit);
                         int bytes_read = recv(sock, &cmd_submit, cmd_header_size, 0);
                         if (bytes_read != cmd_header_size) {
-                            log_write("[TCP] ERROR: Failed to read cmd_submit header, got %d bytes, expected %d", 
-                                     bytes_read, cmd_header_size);
+                            log_write_err("[TCP] ERROR: Failed to read cmd_submit header, got %d bytes, expected %d", 
+                                         bytes_read, cmd_header_size);
+                            stream_lost = true;
                             break;
                         }
                         log_write("[TCP] Read cmd_submit header (%d bytes)", bytes_read);
                         
-                        uint32_t transfer_len = ntohl(cmd_submit.transfer_buffer_length);
-                        log_write("[TCP] Transfer length=%u, direction=%u", transfer_len, ntohl(header.direction));
+                        // Decoded once here; nothing past the socket reads wire byte order
+                        usbip_submit_desc_t desc;
+                        usbip_decode_cmd_submit(&header, &cmd_submit, &desc);
+                        uint32_t transfer_len = desc.transfer_buffer_length;
+                        log_write("[TCP] Transfer length=%lu, direction=%lu", transfer_len, desc.direction);
+                        bool has_data = desc.direction == 0 && transfer_len > 0;
+                        if (has_data && transfer_len > USBIP_MAX_TRANSFER_SIZE) {
+                            log_write_err("[TCP] ERROR: Transfer length %lu exceeds buffer size %d", transfer_len, USBIP_MAX_TRANSFER_SIZE);
+                            if (!drain_payload(sock, transfer_len)) {
+                                stream_lost = true;
+                                break;
+                            }
+                            usb_handler_reject_urb(&header, sock, -USBIP_EPROTO);
+                            break;
+                        }
                         
-                        // For host-to-device (OUT), read the transfer data
-                        if (ntohl(header.direction) == 0 && transfer_len > 0) {
-                            if (transfer_len > 1024) {
-                                log_write("[TCP] ERROR: Transfer length %u exceeds buffer size 1024", transfer_len);
+                        // Over budget: stop reading the socket until URBs complete, so TCP
+                        // flow control holds the client back
+                        if (!urb_budget_acquire(transfer_len)) {
+                            log_write_err("[TCP] ERROR: No room for URB seqnum=%lu after %d ms", 
+                                         desc.seqnum, CONFIG_URB_BUDGET_WAIT_MS);
+                            if (has_data && !drain_payload(sock, transfer_len)) {
+                                stream_lost = true;
                                 break;
                             }
-                            log_write("[TCP] Reading %u bytes of transfer data...", transfer_len);
-                            bytes_read = recv(sock, &cmd_submit.transfer_buffer[0], transfer_len, 0);
-                            if (bytes_read != transfer_len) {
-                                log_write("[TCP] ERROR: Failed to read transfer data, got %d bytes, expected %u", 
-                                         bytes_read, transfer_len);
+                            usb_handler_reject_urb(&header, sock, -USBIP_ENOMEM);
+                            break;
+                        }
+                        urb_slot_t *slot = session_arena_alloc();
+                        if (slot == NULL) {
+                            log_write_err("[TCP] ERROR: No free URB slot for seqnum=%lu", desc.seqnum);
+                            urb_budget_release(transfer_len);
+                            if (has_data && !drain_payload(sock, transfer_len)) {
+                                stream_lost = true;
+                                break;
+                            }
+                            usb_handler_reject_urb(&header, sock, -USBIP_ENOMEM);
+                            break;
+                        }
+                        
+                        // Populate the slot
+                        slot->cmd = desc;
+                        slot->sock = sock;
+                        slot->budget_bytes = transfer_len;
+                        memset(&slot->ts, 0, sizeof(slot->ts));
+                        slot->ts.recv = t_recv;
+                        
+                        // For host-to-device (OUT), read the transfer data straight into the slot
+                        if (has_data) {
+                            log_write("[TCP] Reading %lu bytes of transfer data...", transfer_len);
+                            if (!recv_payload(sock, slot->wire.transfer_buffer, transfer_len)) {
+                                session_arena_free(slot);
+                                urb_budget_release(transfer_len);
+                                stream_lost = true;
                                 break;
                             }
-                            log_write("[TCP] Transfer data read successfully (%d bytes)", bytes_read);
+                            log_write("[TCP] Transfer data read successfully (%lu bytes)", transfer_len);
                         }
                         
-                        // Populate submit structure
-                        recv_submit.header = header;
-                        recv_submit.cmd_submit = cmd_submit;
-                        recv_submit.sock = sock;
+                        flight_rec_event(FLIGHT_EV_URB_RECV, desc.seqnum, desc.ep, transfer_len);
+                        wifi_ps_urb_received();
+#ifdef CONFIG_ENABLE_USBIP_CAPTURE
+                        uint8_t frame_hdr[sizeof(header) + sizeof(cmd_submit)];
+                        memcpy(frame_hdr, &header, sizeof(header));
+                        memcpy(frame_hdr + sizeof(header), &cmd_submit, sizeof(cmd_submit));
+                        usbip_capture_frame(USBIP_CAPTURE_RX, frame_hdr, sizeof(frame_hdr), slot->wire.transfer_buffer,
+                                            has_data ? transfer_len : 0);
+#endif
                         
+                        urb_ledger_alloc(desc.seqnum);
                         log_write("[TCP] Posting SUBMIT event to USB handler...");
                         esp_err_t err = esp_event_post_to(loop_handle2, USBIP_EVENT_BASE, USBIP_CMD_SUBMIT, 
-                                                          (void *)&recv_submit, sizeof(submit), portMAX_DELAY);
+                                                          (void *)&slot, sizeof(slot), portMAX_DELAY);
                         if (err != ESP_OK) {
-                            log_write("[TCP] ERROR: Failed to post SUBMIT event: %s", esp_err_to_name(err));
+                            log_write_err("[TCP] ERROR: Failed to post SUBMIT event: %s", esp_err_to_name(err));
+                            session_arena_free(slot);
+                            urb_budget_release(transfer_len);
+                            usb_handler_reject_urb(&header, sock, -USBIP_ENOMEM);
+                            urb_ledger_mark(desc.seqnum, URB_LEDGER_SEND);
+                            urb_ledger_mark(desc.seqnum, URB_LEDGER_FREE);
                         } else {
                             log_write("[TCP] SUBMIT event posted successfully");
                         }
@@ -239,7 +396,11 @@ static void do_recv()
                         log_write("[TCP] USBIP_CMD_UNLINK received");
                         usbip_cmd_unlink cmd_unlink;
                         len = recv(sock, &cmd_unlink, sizeof(usbip_cmd_unlink), 0);
-                        log_write("[TCP] Unlink request for seqnum=%u", ntohl(cmd_unlink.unlink_seqnum));
+                        if (len > 0) {
+                            usbip_capture_frame(USBIP_CAPTURE_RX, &header, sizeof(header), &cmd_unlink, len);
+                        }
+                        log_write("[TCP] Unlink request for seqnum=%lu", ntohl(cmd_unlink.unlink_seqnum));
+                        flight_rec_event(FLIGHT_EV_URB_UNLINK, ntohl(cmd_unlink.unlink_seqnum), ntohl(header.ep), 0);
                         init_unlink(ntohl(cmd_unlink.unlink_seqnum));
 
                         /* TODO: REPLY with RET_UNLINK after error check*/
@@ -260,12 +421,14 @@ static void do_recv()
                         break;
                     }
                     default:
-                        log_write("[TCP] WARNING: Unknown URB command: 0x%08x", cmd);
+                        log_write_err("[TCP] WARNING: Unknown URB command: 0x%08lx", cmd);
                         printf("SUCCESS\n");
                         break;
                     }
                 }
             }
+            // The URB loop only ends when the connection does
+            break;
         }
 
         /* Continue looping - don't break here! 
@@ -273,13 +436,20 @@ static void do_recv()
     }
     
     log_write("[TCP] Receive loop ended, cleaning up connection");
+    flight_rec_event(FLIGHT_EV_CLIENT_DISCONNECT, 0, 0, errno);
+    
+    // Still attached means the connection failed rather than the client detaching;
+    // a suspended session keeps its endpoint state for a resuming client
+    bool suspended = device_busy && usbip_session_suspend();
     
     // Mark device as not busy so no more transfers are accepted
     device_busy = false;
     
     // Reset pending transfer flags (declared in usb_handler.h)
-    ep1_transfer_pending = false;
-    ep2_transfer_pending = false;
+    if (!suspended) {
+        usb_handler_clear_pending();
+        session_arena_teardown();
+    }
     
     close(sock);
     sock = -1;  // Invalidate socket
@@ -292,11 +462,14 @@ void tcp_server_start(void *pvParameters)
 {
     ESP_LOGI(TAG, "TCP server task started");
     
+    // tcp_server_init() runs in parallel; sockets need an address to bind to
+    boot_timeline_wait(BOOT_BIT(BOOT_EV_WIFI_CONNECTED), portMAX_DELAY);
+    
     // Create mutex for socket operations
     sock_mutex = xSemaphoreCreateMutex();
     if (sock_mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create socket mutex");
-        log_write("[TCP] ERROR: Failed to create socket mutex");
+        log_write_err("[TCP] ERROR: Failed to create socket mutex");
         vTaskDelete(NULL);
         return;
     }
@@ -320,7 +493,7 @@ void tcp_server_start(void *pvParameters)
     if (listen_sock < 0)
     {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        log_write("[TCP] ERROR: Failed to create socket, errno %d", errno);
+        log_write_err("[TCP] ERROR: Failed to create socket, errno %d", errno);
         vTaskDelete(NULL);
         return;
     }
@@ -336,7 +509,7 @@ void tcp_server_start(void *pvParameters)
     {
         ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
         ESP_LOGE(TAG, "IPPROTO: %d", addr_family);
-        log_write("[TCP] ERROR: Failed to bind to port %d, errno %d", PORT, errno);
+        log_write_err("[TCP] ERROR: Failed to bind to port %d, errno %d", PORT, errno);
         goto CLEAN_UP;
     }
     ESP_LOGI(TAG, "Socket bound, port %d", PORT);
@@ -346,16 +519,16 @@ void tcp_server_start(void *pvParameters)
     if (err != 0)
     {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
-        log_write("[TCP] ERROR: Failed to listen on port %d, errno %d", PORT, errno);
+        log_write_err("[TCP] ERROR: Failed to listen on port %d, errno %d", PORT, errno);
         goto CLEAN_UP;
     }
     log_write("[TCP] TCP server listening on port %d for USB/IP connections", PORT);
+    boot_timeline_mark(BOOT_EV_TCP_LISTENING);
     
     while (1)
     {
         ESP_LOGI(TAG, "Socket listening");
         log_write("[TCP] Waiting for client connection...");
-        vTaskDelay(pdMS_TO_TICKS(5000)); // 5 second delay between log messages
 
         struct sockaddr_storage source_addr;
         socklen_t addr_len = sizeof(source_addr);
@@ -368,7 +541,7 @@ void tcp_server_start(void *pvParameters)
         if (sock < 0)
         {
             ESP_LOGE(TAG, "Accept failed: errno %d", errno);
-            log_write("[TCP] ERROR: accept() failed, errno %d", errno);
+            log_write_err("[TCP] ERROR: accept() failed, errno %d", errno);
             vTaskDelay(pdMS_TO_TICKS(1000));
             continue;
         }
@@ -376,6 +549,8 @@ void tcp_server_start(void *pvParameters)
         // Successfully accepted connection
         ESP_LOGI(TAG, "Connection accepted, sock=%d", sock);
         log_write("[TCP] Client connected successfully");
+        flight_rec_event(FLIGHT_EV_CLIENT_CONNECT, 0, 0, sock);
+        link_lost = false;
         
         // Get client address
         char client_ip[32] = "unknown";
@@ -0,0 +1,94 @@
+#include "urb_budget.h"
+#include "mem_pressure.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#define HEAP_RECHECK_MS 10      // Heap can recover without a release, e.g. lwIP freeing buffers
+
+static SemaphoreHandle_t released = NULL;
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+static urb_budget_stats_t stats;
+
+esp_err_t urb_budget_init(void)
+{
+    released = xSemaphoreCreateBinary();
+    return released != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool urb_budget_acquire(uint32_t bytes)
+{
+    int64_t start = 0;
+
+    while (1) {
+        size_t heap = esp_get_free_heap_size();
+        uint32_t max_urbs = mem_pressure_max_urbs();
+        bool admit;
+
+        portENTER_CRITICAL(&budget_lock);
+        admit = stats.urbs == 0 ||
+                (stats.urbs < max_urbs &&
+                 stats.bytes + bytes <= CONFIG_URB_BUDGET_MAX_BYTES &&
+                 heap >= CONFIG_URB_BUDGET_HEAP_RESERVE);
+        if (admit) {
+            stats.urbs++;
+            stats.bytes += bytes;
+            stats.admitted++;
+            if (stats.urbs > stats.peak_urbs) {
+                stats.peak_urbs = stats.urbs;
+            }
+            if (stats.bytes > stats.peak_bytes) {
+                stats.peak_bytes = stats.bytes;
+            }
+        }
+        portEXIT_CRITICAL(&budget_lock);
+
+        int64_t now = esp_timer_get_time();
+        if (start == 0 && !admit) {
+            start = now;
+            portENTER_CRITICAL(&budget_lock);
+            stats.stalls++;
+            portEXIT_CRITICAL(&budget_lock);
+        }
+        bool timed_out = !admit && now - start >= CONFIG_URB_BUDGET_WAIT_MS * 1000LL;
+        if (start != 0 && (admit || timed_out)) {
+            portENTER_CRITICAL(&budget_lock);
+            stats.stall_us += now - start;
+            stats.timeouts += timed_out;
+            portEXIT_CRITICAL(&budget_lock);
+        }
+        if (admit) {
+            return true;
+        }
+        if (timed_out) {
+            return false;
+        }
+        xSemaphoreTake(released, pdMS_TO_TICKS(HEAP_RECHECK_MS));
+    }
+}
+
+void urb_budget_release(uint32_t bytes)
+{
+    portENTER_CRITICAL(&budget_lock);
+    if (stats.urbs > 0) {
+        stats.urbs--;
+    }
+    stats.bytes = (stats.bytes > bytes) ? stats.bytes - bytes : 0;
+    portEXIT_CRITICAL(&budget_lock);
+    xSemaphoreGive(released);
+}
+
+void urb_budget_note_rejected(void)
+{
+    portENTER_CRITICAL(&budget_lock);
+    stats.rejected++;
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+void urb_budget_get_stats(urb_budget_stats_t *out)
+{
+    portENTER_CRITICAL(&budget_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&budget_lock);
+}
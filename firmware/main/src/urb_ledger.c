@@ -0,0 +1,209 @@
+#include "urb_ledger.h"
+#include "log_handler.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_ENTRIES     CONFIG_URB_LEDGER_SIZE
+#define NUM_RECENT      16      // Findings kept for GET /ledger
+
+typedef struct
+{
+    uint32_t seqnum;
+    uint32_t t_alloc_ms;
+    uint32_t t_last_ms;
+    uint8_t stages;             // urb_ledger_stage_t bits seen so far
+} entry_t;
+
+typedef struct
+{
+    uint32_t seqnum;
+    uint8_t finding;
+    uint8_t stages;
+} recent_t;
+
+static const char *finding_names[URB_LEDGER_FINDING_COUNT] = {
+    "double free", "freed unanswered", "never completed", "never answered", "unknown seqnum", "duplicate seqnum"
+};
+
+static entry_t table[NUM_ENTRIES];
+static recent_t recent[NUM_RECENT];
+static uint32_t recent_head = 0;
+static uint32_t counts[URB_LEDGER_FINDING_COUNT];
+static uint32_t tracked = 0;
+static portMUX_TYPE ledger_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool is_live(const entry_t *e)
+{
+    return (e->stages & URB_LEDGER_ALLOC) && !(e->stages & URB_LEDGER_FREE);
+}
+
+/* Caller holds ledger_lock */
+static void note(uint32_t seqnum, urb_ledger_finding_t finding, uint8_t stages)
+{
+    counts[finding]++;
+    recent_t *r = &recent[recent_head++ % NUM_RECENT];
+    r->seqnum = seqnum;
+    r->finding = finding;
+    r->stages = stages;
+}
+
+static void log_finding(uint32_t seqnum, urb_ledger_finding_t finding, uint8_t stages)
+{
+    log_write("[LEDGER] seqnum=%lu %s (stages 0x%02x)", seqnum, finding_names[finding], stages);
+}
+
+void urb_ledger_alloc(uint32_t seqnum)
+{
+    entry_t *live = NULL;
+    entry_t *spare = NULL;
+    uint32_t now = now_ms();
+
+    portENTER_CRITICAL(&ledger_lock);
+    // Linear probe from the seqnum's home entry; finished entries are overwritten
+    for (int i = 0; i < NUM_ENTRIES && live == NULL; i++) {
+        entry_t *e = &table[(seqnum + i) % NUM_ENTRIES];
+        if (is_live(e)) {
+            live = e->seqnum == seqnum ? e : NULL;
+        } else if (spare == NULL) {
+            spare = e;
+        }
+    }
+    entry_t *e = live != NULL ? live : spare;
+    uint8_t old = live != NULL ? live->stages : 0;
+    if (live != NULL) {
+        note(seqnum, URB_LEDGER_DUPLICATE, old);
+    } else if (e == NULL) {
+        note(seqnum, URB_LEDGER_UNKNOWN, 0);
+    }
+    if (e != NULL) {
+        e->seqnum = seqnum;
+        e->stages = URB_LEDGER_ALLOC;
+        e->t_alloc_ms = now;
+        e->t_last_ms = now;
+        tracked++;
+    }
+    portEXIT_CRITICAL(&ledger_lock);
+
+    if (live != NULL) {
+        log_finding(seqnum, URB_LEDGER_DUPLICATE, old);
+    } else if (e == NULL) {
+        log_write("[LEDGER] Table full, seqnum=%lu not tracked", seqnum);
+    }
+}
+
+void urb_ledger_mark(uint32_t seqnum, urb_ledger_stage_t stage)
+{
+    entry_t *live = NULL;
+    entry_t *done = NULL;
+    int finding = -1;
+
+    portENTER_CRITICAL(&ledger_lock);
+    for (int i = 0; i < NUM_ENTRIES && live == NULL; i++) {
+        entry_t *e = &table[(seqnum + i) % NUM_ENTRIES];
+        if (e->stages == 0 || e->seqnum != seqnum) {
+            continue;
+        }
+        if (is_live(e)) {
+            live = e;
+        } else if (done == NULL) {
+            done = e;
+        }
+    }
+    uint8_t stages = live != NULL ? live->stages : (done != NULL ? done->stages : 0);
+    if (live != NULL) {
+        if (stage == URB_LEDGER_FREE && !(stages & (URB_LEDGER_SEND | URB_LEDGER_DROP))) {
+            finding = URB_LEDGER_UNANSWERED;
+        }
+        live->stages |= stage;
+        live->t_last_ms = now_ms();
+    } else {
+        finding = (stage == URB_LEDGER_FREE && done != NULL) ? URB_LEDGER_DOUBLE_FREE : URB_LEDGER_UNKNOWN;
+    }
+    if (finding >= 0) {
+        note(seqnum, finding, stages);
+    }
+    portEXIT_CRITICAL(&ledger_lock);
+
+    if (finding >= 0) {
+        log_finding(seqnum, finding, stages | stage);
+    }
+}
+
+void urb_ledger_report(const char *why)
+{
+    int outstanding = 0;
+
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        int finding = -1;
+        entry_t e;
+
+        portENTER_CRITICAL(&ledger_lock);
+        e = table[i];
+        if (is_live(&e) && !(e.stages & (URB_LEDGER_SEND | URB_LEDGER_DROP))) {
+            bool on_bus = (e.stages & URB_LEDGER_SUBMIT) && !(e.stages & URB_LEDGER_COMPLETE);
+            finding = on_bus ? URB_LEDGER_INCOMPLETE : URB_LEDGER_UNSENT;
+            note(e.seqnum, finding, e.stages);
+            // Reported once; freeing it later is expected
+            table[i].stages |= URB_LEDGER_DROP;
+        }
+        portEXIT_CRITICAL(&ledger_lock);
+
+        if (finding >= 0) {
+            log_write("[LEDGER] %s: seqnum=%lu %s, %lu ms since allocated (stages 0x%02x)",
+                      why, e.seqnum, finding_names[finding], now_ms() - e.t_alloc_ms, e.stages);
+            outstanding++;
+        }
+    }
+    log_write("[LEDGER] %s: %d URB(s) unanswered", why, outstanding);
+}
+
+int urb_ledger_format(char *buf, int size)
+{
+    // Snapshot first; formatting inside the critical section would hold off interrupts
+    static entry_t snap[NUM_ENTRIES];
+    recent_t snap_recent[NUM_RECENT];
+    uint32_t snap_counts[URB_LEDGER_FINDING_COUNT];
+    uint32_t head, total;
+    uint32_t now = now_ms();
+    int len = 0;
+
+    portENTER_CRITICAL(&ledger_lock);
+    memcpy(snap, table, sizeof(snap));
+    memcpy(snap_recent, recent, sizeof(snap_recent));
+    memcpy(snap_counts, counts, sizeof(snap_counts));
+    head = recent_head;
+    total = tracked;
+    portEXIT_CRITICAL(&ledger_lock);
+
+    len += snprintf(buf + len, size - len, "tracked: %lu\n", total);
+    for (int f = 0; f < URB_LEDGER_FINDING_COUNT && len < size; f++) {
+        len += snprintf(buf + len, size - len, "%s: %lu\n", finding_names[f], snap_counts[f]);
+    }
+    if (len < size) {
+        len += snprintf(buf + len, size - len, "# recent findings\n");
+    }
+    uint32_t n = head < NUM_RECENT ? head : NUM_RECENT;
+    for (uint32_t i = 0; i < n && len < size; i++) {
+        const recent_t *r = &snap_recent[(head - n + i) % NUM_RECENT];
+        len += snprintf(buf + len, size - len, "seqnum=%lu %s stages=0x%02x\n",
+                        r->seqnum, finding_names[r->finding], r->stages);
+    }
+    if (len < size) {
+        len += snprintf(buf + len, size - len, "# live URBs\n");
+    }
+    for (int i = 0; i < NUM_ENTRIES && len < size; i++) {
+        const entry_t *e = &snap[i];
+        if (is_live(e)) {
+            len += snprintf(buf + len, size - len, "seqnum=%lu stages=0x%02x age=%lu ms idle=%lu ms\n",
+                            e->seqnum, e->stages, now - e->t_alloc_ms, now - e->t_last_ms);
+        }
+    }
+    return len < size ? len : size - 1;
+}
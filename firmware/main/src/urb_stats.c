@@ -0,0 +1,80 @@
+#include "urb_stats.h"
+#include "log_handler.h"
+#include <string.h>
+
+static urb_stats_hist_t stats[URB_STATS_NUM_EP_TYPES][URB_STAGE_COUNT];
+
+static const char *stage_names[URB_STAGE_COUNT] = {
+    "recv->dispatch",
+    "dispatch->complete",
+    "complete->sent",
+    "recv->sent",
+};
+
+static const char *type_names[URB_STATS_NUM_EP_TYPES] = {
+    "CTRL",
+    "ISOC",
+    "BULK",
+    "INTR",
+};
+
+static inline void hist_add(urb_stats_hist_t *h, int64_t start, int64_t end)
+{
+    int64_t delta = end - start;
+    if (start == 0 || end == 0 || delta < 0) {
+        return;
+    }
+    uint32_t us = delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta;
+    uint32_t bucket = 31 - __builtin_clz(us | 1);
+    if (bucket >= URB_STATS_NUM_BUCKETS) {
+        bucket = URB_STATS_NUM_BUCKETS - 1;
+    }
+
+    h->buckets[bucket]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+}
+
+esp_err_t urb_stats_init(void)
+{
+    urb_stats_reset();
+    log_write("[STATS] URB latency histograms ready");
+    return ESP_OK;
+}
+
+void urb_stats_record(uint8_t xfer_type, const urb_timestamps *ts)
+{
+    if (xfer_type >= URB_STATS_NUM_EP_TYPES || ts->recv == 0) {
+        return;
+    }
+
+    urb_stats_hist_t *h = stats[xfer_type];
+    hist_add(&h[URB_STAGE_DISPATCH], ts->recv, ts->dispatch);
+    hist_add(&h[URB_STAGE_DEVICE], ts->dispatch, ts->complete);
+    hist_add(&h[URB_STAGE_SEND], ts->complete, ts->sent);
+    hist_add(&h[URB_STAGE_TOTAL], ts->recv, ts->sent);
+}
+
+void urb_stats_snapshot(urb_stats_snapshot_t *out)
+{
+    // Counters are only bumped from the USB client task; a torn read costs at most one sample
+    memcpy(out->hist, stats, sizeof(stats));
+}
+
+void urb_stats_reset(void)
+{
+    memset(stats, 0, sizeof(stats));
+}
+
+const char *urb_stats_stage_name(urb_stage_t stage)
+{
+    return (stage < URB_STAGE_COUNT) ? stage_names[stage] : "?";
+}
+
+const char *urb_stats_type_name(uint8_t xfer_type)
+{
+    return (xfer_type < URB_STATS_NUM_EP_TYPES) ? type_names[xfer_type] : "?";
+}
@@ -0,0 +1,197 @@
+#include "urb_watchdog.h"
+#include "log_handler.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define WHEEL_SLOTS     64
+#define WHEEL_TICK_MS   100     // Deadline resolution
+#define NUM_WATCHES     CONFIG_URB_BUDGET_MAX_URBS  // The budget bounds transfers in flight
+
+typedef enum
+{
+    WATCH_FREE = 0,
+    WATCH_ARMED,        // On the wheel
+    WATCH_FLUSHING,     // Expired; the endpoint is being flushed
+    WATCH_STUCK         // Expired and could not be flushed
+} watch_state_t;
+
+typedef struct watch_t
+{
+    struct watch_t *next;
+    usb_transfer_t *transfer;
+    uint32_t seqnum;
+    uint32_t rounds;            // Full turns of the wheel left
+    uint8_t slot;
+    uint8_t state;
+} watch_t;
+
+static watch_t watches[NUM_WATCHES];
+static watch_t *wheel[WHEEL_SLOTS];
+static uint32_t cur_slot = 0;
+static portMUX_TYPE wheel_lock = portMUX_INITIALIZER_UNLOCKED;
+static urb_watchdog_stats_t stats;
+
+static uint32_t deadline_ms(uint8_t xfer_type, bool in, uint32_t interval)
+{
+    uint32_t ms = CONFIG_URB_WATCHDOG_CEILING_MS;
+    if (xfer_type == USB_TRANSFER_TYPE_CTRL || !in) {
+        ms = CONFIG_URB_WATCHDOG_TRANSFER_MS + interval;
+    }
+    return ms < CONFIG_URB_WATCHDOG_CEILING_MS ? ms : CONFIG_URB_WATCHDOG_CEILING_MS;
+}
+
+/* Caller holds wheel_lock */
+static void unlink_watch(watch_t *w)
+{
+    watch_t **pp = &wheel[w->slot];
+    while (*pp != NULL && *pp != w) {
+        pp = &(*pp)->next;
+    }
+    if (*pp == w) {
+        *pp = w->next;
+    }
+    w->next = NULL;
+}
+
+typedef struct
+{
+    usb_device_handle_t dev;
+    uint32_t seqnum;
+    uint8_t ep;
+} expired_t;
+
+/* Halt, flush and clear the endpoint; the transfer completes as cancelled */
+static void expire(const expired_t *x)
+{
+    log_write("[WDOG] URB seqnum=%lu on EP 0x%02x passed its deadline%s",
+              x->seqnum, x->ep, (x->ep & 0x0F) ? ", flushing" : "; EP0 cannot be flushed");
+    if ((x->ep & 0x0F) == 0) {
+        return;
+    }
+
+    esp_err_t err = usb_host_endpoint_halt(x->dev, x->ep);
+    if (err == ESP_OK) {
+        err = usb_host_endpoint_flush(x->dev, x->ep);
+    }
+    if (err == ESP_OK) {
+        err = usb_host_endpoint_clear(x->dev, x->ep);
+    }
+    if (err != ESP_OK) {
+        log_write_err("[WDOG] ERROR: Failed to flush EP 0x%02x: %s", x->ep, esp_err_to_name(err));
+    }
+}
+
+static void urb_watchdog_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    expired_t expired[NUM_WATCHES];
+
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(WHEEL_TICK_MS));
+
+        // Copy out what is needed: the transfer may complete and be freed once the lock is dropped
+        int n = 0;
+        portENTER_CRITICAL(&wheel_lock);
+        cur_slot = (cur_slot + 1) % WHEEL_SLOTS;
+        watch_t **pp = &wheel[cur_slot];
+        while (*pp != NULL) {
+            watch_t *w = *pp;
+            if (w->rounds > 0) {
+                w->rounds--;
+                pp = &w->next;
+                continue;
+            }
+            *pp = w->next;
+            w->next = NULL;
+            expired[n].dev = w->transfer->device_handle;
+            expired[n].seqnum = w->seqnum;
+            expired[n].ep = w->transfer->bEndpointAddress;
+            // The entry stays allocated until the transfer completes
+            w->state = (expired[n].ep & 0x0F) ? WATCH_FLUSHING : WATCH_STUCK;
+            n++;
+            stats.stuck++;
+            stats.stuck_total++;
+        }
+        portEXIT_CRITICAL(&wheel_lock);
+
+        for (int i = 0; i < n; i++) {
+            expire(&expired[i]);
+        }
+    }
+}
+
+esp_err_t urb_watchdog_init(void)
+{
+    if (xTaskCreate(urb_watchdog_task, "urb_wdog", 3072, NULL, 4, NULL) != pdPASS) {
+        log_write_err("[WDOG] ERROR: Failed to create watchdog task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void urb_watchdog_arm(usb_transfer_t *transfer, uint32_t seqnum, uint8_t xfer_type, uint32_t interval)
+{
+    bool in = (transfer->bEndpointAddress & 0x80) != 0;
+    uint32_t ticks = (deadline_ms(xfer_type, in, interval) + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    portENTER_CRITICAL(&wheel_lock);
+    watch_t *w = NULL;
+    for (int i = 0; i < NUM_WATCHES; i++) {
+        if (watches[i].state == WATCH_FREE) {
+            w = &watches[i];
+            break;
+        }
+    }
+    if (w == NULL) {
+        stats.untracked++;
+    } else {
+        w->transfer = transfer;
+        w->seqnum = seqnum;
+        w->rounds = (ticks - 1) / WHEEL_SLOTS;
+        w->slot = (cur_slot + (ticks - 1) % WHEEL_SLOTS + 1) % WHEEL_SLOTS;
+        w->state = WATCH_ARMED;
+        w->next = wheel[w->slot];
+        wheel[w->slot] = w;
+        stats.armed++;
+    }
+    portEXIT_CRITICAL(&wheel_lock);
+}
+
+bool urb_watchdog_disarm(usb_transfer_t *transfer)
+{
+    bool flushed = false;
+
+    portENTER_CRITICAL(&wheel_lock);
+    for (int i = 0; i < NUM_WATCHES; i++) {
+        watch_t *w = &watches[i];
+        if (w->state == WATCH_FREE || w->transfer != transfer) {
+            continue;
+        }
+        if (w->state == WATCH_ARMED) {
+            unlink_watch(w);
+        } else {
+            stats.stuck--;
+            if (w->state == WATCH_FLUSHING && transfer->status == USB_TRANSFER_STATUS_CANCELED) {
+                stats.expired++;
+                flushed = true;
+            }
+        }
+        w->state = WATCH_FREE;
+        w->transfer = NULL;
+        stats.armed--;
+        break;
+    }
+    portEXIT_CRITICAL(&wheel_lock);
+    return flushed;
+}
+
+void urb_watchdog_get_stats(urb_watchdog_stats_t *out)
+{
+    portENTER_CRITICAL(&wheel_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&wheel_lock);
+}
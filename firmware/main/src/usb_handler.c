@@ -1,5 +1,17 @@
 #include "usb_handler.h"
 #include "log_handler.h"
+#include "usbmon.h"
+#include "flight_rec.h"
+#include "boot_timeline.h"
+#include "wifi_ps.h"
+#include "tcp_connect.h"
+#include "usbip_session.h"
+#include "bot_cache.h"
+#include "urb_budget.h"
+#include "urb_watchdog.h"
+#include "session_arena.h"
+#include "urb_ledger.h"
+#include "esp_timer.h"
 
 #define CLIENT_NUM_EVENT_MSG 15
 
@@ -9,7 +21,6 @@
 #define ACTION_GET_CONFIG_DESC 0x08
 #define ACTION_GET_STR_DESC 0x10
 #define ACTION_CLOSE_DEV 0x20
-#define ACTION_EXIT 0x40
 
 #define TAG "USB_HANDLER"
 
@@ -22,16 +33,14 @@ static const usb_config_desc_t *config_desc;
 static const usb_intf_desc_t *interface_desc;
 
 static class_driver_t driver_obj;
-static uint32_t mps[10];
+static uint32_t claimed_intf_mask;  // Interfaces to release before closing the device
+static uint8_t pending_dev_addr;    // NEW_DEV that arrived while the old device was still closing
+static int64_t new_dev_time_us;     // When the current device was plugged in
 static int skt;
 
 // Number Of Interfaces
 int num_of_interfaces;
 
-// Track pending interrupt transfers to prevent memory exhaustion
-bool ep1_transfer_pending = false;
-bool ep2_transfer_pending = false;
-
 esp_event_loop_handle_t loop_handle2 = NULL;
 
 usb_device_info_t *get_dev_info()
@@ -60,7 +69,9 @@ static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *
     {
     case USB_HOST_CLIENT_EVENT_NEW_DEV:
         log_write("[USB] New USB device detected at address %d", event_msg->new_dev.address);
+        flight_rec_event(FLIGHT_EV_DEV_CONNECT, 0, 0, event_msg->new_dev.address);
         ESP_LOGI(TAG, "New device detected at address %d", event_msg->new_dev.address);
+        new_dev_time_us = esp_timer_get_time();
         if (driver_obj->dev_addr == 0)
         {
             driver_obj->dev_addr = event_msg->new_dev.address;
@@ -68,15 +79,28 @@ static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *
             driver_obj->actions |= ACTION_OPEN_DEV;
             log_write("[USB] Setting ACTION_OPEN_DEV flag");
         }
+        else
+        {
+            // Replugged before the old device finished closing; opened by action_close_dev()
+            pending_dev_addr = event_msg->new_dev.address;
+        }
         break;
     case USB_HOST_CLIENT_EVENT_DEV_GONE:
         log_write("[USB] USB device disconnected");
+        flight_rec_event(FLIGHT_EV_DEV_GONE, 0, 0, 0);
         ESP_LOGI(TAG, "Device disconnected");
+        // The client's URBs can no longer complete; let it detach right away
+        tcp_server_drop_session();
         if (driver_obj->dev_hdl != NULL)
         {
             // Cancel any other actions and close the device next
             driver_obj->actions = ACTION_CLOSE_DEV;
         }
+        else
+        {
+            // Enumeration never got as far as opening it
+            driver_obj->dev_addr = 0;
+        }
         break;
     default:
         log_write("[USB] Unknown USB event: %d", event_msg->event);
@@ -93,7 +117,7 @@ static void action_open_dev(class_driver_t *driver_obj)
     
     esp_err_t err = usb_host_device_open(driver_obj->client_hdl, driver_obj->dev_addr, &driver_obj->dev_hdl);
     if (err != ESP_OK) {
-        log_write("[USB] ERROR: Failed to open device: %s", esp_err_to_name(err));
+        log_write_err("[USB] ERROR: Failed to open device: %s", esp_err_to_name(err));
         ESP_LOGE(TAG, "Failed to open device: %s", esp_err_to_name(err));
         driver_obj->actions &= ~ACTION_OPEN_DEV;
         return;
@@ -113,7 +137,7 @@ static void action_get_info(class_driver_t *driver_obj)
     
     esp_err_t err = usb_host_device_info(driver_obj->dev_hdl, &dev_info);
     if (err != ESP_OK) {
-        log_write("[USB] ERROR: Failed to get device info: %s", esp_err_to_name(err));
+        log_write_err("[USB] ERROR: Failed to get device info: %s", esp_err_to_name(err));
         ESP_LOGE(TAG, "Failed to get device info: %s", esp_err_to_name(err));
         driver_obj->actions &= ~ACTION_GET_DEV_INFO;
         return;
@@ -136,7 +160,7 @@ static void action_get_dev_desc(class_driver_t *driver_obj)
     
     esp_err_t err = usb_host_get_device_descriptor(driver_obj->dev_hdl, &dev_desc);
     if (err != ESP_OK) {
-        log_write("[USB] ERROR: Failed to get device descriptor: %s", esp_err_to_name(err));
+        log_write_err("[USB] ERROR: Failed to get device descriptor: %s", esp_err_to_name(err));
         ESP_LOGE(TAG, "Failed to get device descriptor: %s", esp_err_to_name(err));
         driver_obj->actions &= ~ACTION_GET_DEV_DESC;
         return;
@@ -149,6 +173,126 @@ static void action_get_dev_desc(class_driver_t *driver_obj)
     driver_obj->actions |= ACTION_GET_CONFIG_DESC;
 }
 
+/* Index into the dispatch table: direction bit above the endpoint number */
+#define ROUTE_INDEX(in, ep_num) ((((in) & 1) << 4) | ((ep_num) & 0x0F))
+#define ROUTE_OF(address)       ROUTE_INDEX((address) >> 7, (address))
+
+typedef struct ep_route_t ep_route_t;
+
+/* Fills the slot's transfer for a URB of len bytes */
+typedef esp_err_t (*ep_prep_fn)(const ep_route_t *route, urb_slot_t *slot, uint32_t len);
+
+/* What is needed to serve a URB on one endpoint, worked out when the configuration is parsed */
+struct ep_route_t
+{
+    ep_prep_fn prep;            // NULL: no such endpoint in the active configuration
+    esp_err_t (*submit)(usb_transfer_t *transfer);
+    usb_transfer_cb_t callback;
+    uint16_t mps;
+    uint8_t address;            // bEndpointAddress
+    uint8_t xfer_type;          // usb_transfer_type_t
+    uint8_t interval;           // bInterval, added to the watchdog deadline
+    volatile bool pending;      // A transfer is on the bus; one at a time per non-control endpoint
+};
+
+static ep_route_t routes[32];   // Indexed by ROUTE_INDEX()
+
+static void transfer_cb_ctrl(usb_transfer_t *transfer);
+static void transfer_cb(usb_transfer_t *transfer);
+
+static esp_err_t submit_control(usb_transfer_t *transfer)
+{
+    return usb_host_transfer_submit_control(driver_obj.client_hdl, transfer);
+}
+
+static esp_err_t prep_ctrl_in(const ep_route_t *route, urb_slot_t *slot, uint32_t len)
+{
+    usb_transfer_t *transfer = slot->transfer;
+    memcpy(transfer->data_buffer, &slot->cmd.setup, sizeof(usb_setup_packet_t));
+    transfer->num_bytes = sizeof(usb_setup_packet_t) + len;
+    return ESP_OK;
+}
+
+/* The data stage follows the setup packet in the same buffer */
+static esp_err_t prep_ctrl_out(const ep_route_t *route, urb_slot_t *slot, uint32_t len)
+{
+    usb_transfer_t *transfer = slot->transfer;
+    memcpy(transfer->data_buffer, &slot->cmd.setup, sizeof(usb_setup_packet_t));
+    memcpy(transfer->data_buffer + sizeof(usb_setup_packet_t), slot->wire.transfer_buffer, len);
+    transfer->num_bytes = sizeof(usb_setup_packet_t) + len;
+    return ESP_OK;
+}
+
+/* Bulk and interrupt IN: the host library wants a whole number of packets */
+static esp_err_t prep_data_in(const ep_route_t *route, urb_slot_t *slot, uint32_t len)
+{
+    int num_bytes = usb_round_up_to_mps(len, route->mps);
+    // The slot is sized for packets of up to 512 bytes; an odd MPS can round past it
+    if (num_bytes > slot->transfer->data_buffer_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    slot->transfer->num_bytes = num_bytes;
+    return ESP_OK;
+}
+
+static esp_err_t prep_data_out(const ep_route_t *route, urb_slot_t *slot, uint32_t len)
+{
+    usb_transfer_t *transfer = slot->transfer;
+    memcpy(transfer->data_buffer, slot->wire.transfer_buffer, len);
+    transfer->num_bytes = len;
+    return ESP_OK;
+}
+
+#ifndef CONFIG_USB_PROFILE_HID
+/* The reader does not take USB/IP iso packet descriptors off the socket */
+static esp_err_t prep_iso(const ep_route_t *route, urb_slot_t *slot, uint32_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+static void add_route(uint8_t address, uint8_t xfer_type, uint16_t mps, uint8_t interval)
+{
+    bool in = (address & 0x80) != 0;
+    ep_route_t *route = &routes[ROUTE_OF(address)];
+
+    route->address = address;
+    route->xfer_type = xfer_type;
+    route->mps = mps;
+    route->interval = interval;
+    route->pending = false;
+    route->submit = usb_host_transfer_submit;
+    route->callback = transfer_cb;
+    switch (xfer_type) {
+    case USB_TRANSFER_TYPE_CTRL:
+        route->prep = in ? prep_ctrl_in : prep_ctrl_out;
+        route->submit = submit_control;
+        route->callback = transfer_cb_ctrl;
+        break;
+#ifdef CONFIG_USB_PROFILE_HID
+    case USB_TRANSFER_TYPE_BULK:
+    case USB_TRANSFER_TYPE_ISOCHRONOUS:
+        // Not built for this profile; URBs for the endpoint are rejected
+        route->prep = NULL;
+        break;
+#else
+    case USB_TRANSFER_TYPE_ISOCHRONOUS:
+        route->prep = prep_iso;
+        break;
+#endif
+    default:
+        route->prep = in ? prep_data_in : prep_data_out;
+        break;
+    }
+}
+
+void usb_handler_clear_pending(void)
+{
+    for (int i = 0; i < 32; i++) {
+        routes[i].pending = false;
+    }
+}
+
 static void action_get_config_desc(class_driver_t *driver_obj)
 {
     assert(driver_obj->dev_hdl != NULL);
@@ -157,7 +301,7 @@ static void action_get_config_desc(class_driver_t *driver_obj)
     
     esp_err_t err = usb_host_get_active_config_descriptor(driver_obj->dev_hdl, &config_desc);
     if (err != ESP_OK) {
-        log_write("[USB] ERROR: Failed to get config descriptor: %s", esp_err_to_name(err));
+        log_write_err("[USB] ERROR: Failed to get config descriptor: %s", esp_err_to_name(err));
         ESP_LOGE(TAG, "Failed to get config descriptor: %s", esp_err_to_name(err));
         driver_obj->actions &= ~ACTION_GET_CONFIG_DESC;
         return;
@@ -166,6 +310,10 @@ static void action_get_config_desc(class_driver_t *driver_obj)
     num_of_interfaces = config_desc->bNumInterfaces;
     log_write("[USB] Config descriptor: %d interface(s)", num_of_interfaces);
     
+    memset(routes, 0, sizeof(routes));
+    add_route(0x00, USB_TRANSFER_TYPE_CTRL, dev_desc->bMaxPacketSize0, 0);
+    add_route(0x80, USB_TRANSFER_TYPE_CTRL, dev_desc->bMaxPacketSize0, 0);
+    
     const usb_ep_desc_t *ep;
     int offset = 0;
     for (int i = 0; i < num_of_interfaces; i++)
@@ -173,31 +321,38 @@ static void action_get_config_desc(class_driver_t *driver_obj)
         log_write("[USB] Claiming interface %d", i);
         int err = usb_host_interface_claim(driver_obj->client_hdl, driver_obj->dev_hdl, i, 0);
         if (err != ESP_OK) {
-            log_write("[USB] ERROR: Failed to claim interface %d: %s", i, esp_err_to_name(err));
+            log_write_err("[USB] ERROR: Failed to claim interface %d: %s", i, esp_err_to_name(err));
             continue;
         }
+        claimed_intf_mask |= 1U << i;
         log_write("[USB] Interface %d claimed successfully", i);
         
         log_write("[USB] Parsing interface descriptor");
         const usb_intf_desc_t *intf = usb_parse_interface_descriptor(config_desc, i, 0, &offset);
         if (intf == NULL) {
-            log_write("[USB] ERROR: Failed to parse interface descriptor");
+            log_write_err("[USB] ERROR: Failed to parse interface descriptor");
             continue;
         }
         log_write("[USB] Interface parsed, num endpoints: %d", intf->bNumEndpoints);
         
-        log_write("[USB] Parsing endpoint descriptor");
-        ep = usb_parse_endpoint_descriptor_by_index(intf, 0, config_desc->wTotalLength, &offset);
-        if (ep == NULL) {
-            log_write("[USB] ERROR: Failed to parse endpoint descriptor");
-            mps[i] = 0;
-        } else {
-            mps[i] = ep->wMaxPacketSize;
-            log_write("[USB] Endpoint 0 max packet size: %d", mps[i]);
+        int intf_offset = offset;
+        for (int j = 0; j < intf->bNumEndpoints; j++) {
+            offset = intf_offset;
+            ep = usb_parse_endpoint_descriptor_by_index(intf, j, config_desc->wTotalLength, &offset);
+            if (ep == NULL) {
+                log_write_err("[USB] ERROR: Failed to parse endpoint descriptor %d", j);
+                continue;
+            }
+            add_route(ep->bEndpointAddress, ep->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK,
+                      USB_EP_DESC_GET_MPS(ep), ep->bInterval);
+            log_write("[USB] Endpoint 0x%02x: type %d, max packet size %d",
+                      ep->bEndpointAddress, ep->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK, ep->wMaxPacketSize);
         }
         ESP_LOGI("", "interface claim status: %d", err);
     }
     
+    bot_cache_attach(driver_obj->dev_hdl, config_desc);
+    
     log_write("[USB] Printing config descriptor...");
     // usb_print_config_descriptor() can crash with low stack - skip for now
     // usb_print_config_descriptor(config_desc, NULL);
@@ -236,278 +391,338 @@ static void action_get_str_desc(class_driver_t *driver_obj)
     interface_desc = usb_parse_interface_descriptor(config_desc, 0, usb_parse_interface_number_of_alternate(config_desc, 0), &offset);
     
     log_write("[USB] USB device enumeration complete!");
-    log_write("[USB] Device ready: VID=0x%04x, PID=0x%04x, %d interface(s)", 
-              dev_desc->idVendor, dev_desc->idProduct, num_of_interfaces);
+    log_write("[USB] Device ready: VID=0x%04x, PID=0x%04x, %d interface(s), %lld ms after plug-in", 
+              dev_desc->idVendor, dev_desc->idProduct, num_of_interfaces,
+              (esp_timer_get_time() - new_dev_time_us) / 1000);
+    boot_timeline_mark(BOOT_EV_DEVICE_READY);
     
     driver_obj->actions &= ~ACTION_GET_STR_DESC;
 }
 
-static void aciton_close_dev(class_driver_t *driver_obj)
+/* Forgets everything learned about the device; the client and host library stay installed */
+static void reset_device_state(class_driver_t *driver_obj)
 {
-    ESP_ERROR_CHECK(usb_host_device_close(driver_obj->client_hdl, driver_obj->dev_hdl));
     driver_obj->dev_hdl = NULL;
     driver_obj->dev_addr = 0;
-    // We need to exit the event handler loop
+    memset(&dev_info, 0, sizeof(dev_info));
+    dev_desc = NULL;
+    config_desc = NULL;
+    interface_desc = NULL;
+    memset(routes, 0, sizeof(routes));
+    num_of_interfaces = 0;
+    bot_cache_detach();
+}
+
+static void action_close_dev(class_driver_t *driver_obj)
+{
+    // Releasing fails while URBs are still in flight; they come back with
+    // USB_TRANSFER_STATUS_NO_DEVICE through the client events handled here
+    for (int i = 0; i < 32; i++) {
+        if ((claimed_intf_mask & (1U << i)) &&
+            usb_host_interface_release(driver_obj->client_hdl, driver_obj->dev_hdl, i) == ESP_OK) {
+            claimed_intf_mask &= ~(1U << i);
+        }
+    }
+    if (claimed_intf_mask != 0 || usb_host_device_close(driver_obj->client_hdl, driver_obj->dev_hdl) != ESP_OK) {
+        usb_host_client_handle_events(driver_obj->client_hdl, pdMS_TO_TICKS(10));
+        return;     // Retried on the next pass of the action loop
+    }
+
+    reset_device_state(driver_obj);
     driver_obj->actions &= ~ACTION_CLOSE_DEV;
-    driver_obj->actions |= ACTION_EXIT;
+    log_write("[USB] Device closed, waiting for the next one");
+
+    if (pending_dev_addr != 0) {
+        driver_obj->dev_addr = pending_dev_addr;
+        pending_dev_addr = 0;
+        driver_obj->actions |= ACTION_OPEN_DEV;
+    }
+}
+
+/* Returns a URB's slot to the session arena, then its charge to the budget */
+static void finish_urb(urb_slot_t *slot)
+{
+    uint32_t bytes = slot->budget_bytes;
+    urb_ledger_mark(slot->cmd.seqnum, URB_LEDGER_FREE);
+    // Slot first: a URB admitted on the released budget must find one free
+    session_arena_free(slot);
+    urb_budget_release(bytes);
+}
+
+/* Encodes the slot's RET_SUBMIT in front of data_len bytes of IN data and sends it */
+static int send_ret(urb_slot_t *slot, uint32_t data_len)
+{
+    usbip_ret_desc_t *res = &slot->res;
+    usbip_encode_ret_submit(res, &slot->wire);
+    int len = usbip_session_send_ret(skt, &slot->wire, USBIP_RET_SUBMIT_HEADER_SIZE + data_len, res->seqnum);
+    flight_rec_event(FLIGHT_EV_URB_SENT, res->seqnum, res->ep, len);
+    if (len > 0) {
+        urb_ledger_mark(res->seqnum, URB_LEDGER_SEND);
+    }
+    return len;
+}
+
+/* Bookkeeping for a RET_SUBMIT that made it onto the socket */
+static void note_sent(urb_slot_t *slot)
+{
+    slot->ts.sent = URB_STATS_NOW();
+    urb_stats_record(slot->xfer_type, &slot->ts);
+    wifi_ps_urb_sent();
+}
+
+/* Maps a transfer's outcome to a RET_SUBMIT status */
+static int32_t usbip_status_of(const usb_transfer_t *transfer)
+{
+    switch (transfer->status) {
+    case USB_TRANSFER_STATUS_COMPLETED:
+        return 0;
+    case USB_TRANSFER_STATUS_STALL:
+        return -USBIP_EPIPE;
+    default:
+        return -USBIP_EPROTO;
+    }
 }
 
 static void transfer_cb_ctrl(usb_transfer_t *transfer)
 {
+    urb_watchdog_disarm(transfer);
     log_write("[USB_CB] Control transfer callback: status=%d, bytes=%d", transfer->status, transfer->actual_num_bytes);
     ESP_LOGI(TAG, "--------------------------");
     ESP_LOGI(TAG, "Transfer status %d, actual number of bytes transferred %d\n", transfer->status, transfer->actual_num_bytes);
-    usbip_ret_submit *ret = (usbip_ret_submit *)transfer->context;
-    
-    // Map ESP32 USB transfer status to USB/IP status codes
-    // 0 = success, 4 = stall, others = errors
-    int32_t usbip_status = 0;
+    urb_slot_t *slot = (urb_slot_t *)transfer->context;
+    usbip_ret_desc_t *res = &slot->res;
+    urb_ledger_mark(res->seqnum, URB_LEDGER_COMPLETE);
+    slot->ts.complete = URB_STATS_NOW();
+    usbmon_record(USBMON_COMPLETE, transfer, res->seqnum, slot->xfer_type, driver_obj.dev_addr);
+    flight_rec_event(FLIGHT_EV_URB_COMPLETE, res->seqnum, transfer->bEndpointAddress & 0x0F, transfer->status);
+
+    res->status = usbip_status_of(transfer);
     if (transfer->status == USB_TRANSFER_STATUS_STALL) {
-        usbip_status = -32;  // -EPIPE in Linux
         log_write("[USB_CB] Transfer STALLED");
-    } else if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
-        usbip_status = -71;  // -EPROTO in Linux
+    } else if (res->status != 0) {
         log_write("[USB_CB] Transfer failed with status %d", transfer->status);
     }
-    ret->status = htonl(usbip_status);
-    
-    // Calculate actual data length (excluding 8-byte setup packet)
-    // For error cases (status != 0) or when actual_num_bytes < 8, set to 0
-    int32_t data_len = 0;
-    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED && transfer->actual_num_bytes >= 8) {
-        data_len = transfer->actual_num_bytes - 8;
-        memcpy(&ret->transfer_buffer[0], transfer->data_buffer + 8, data_len);
+
+    // Data stage length, excluding the 8-byte setup packet; 0 on error
+    uint32_t data_len = 0;
+    if (res->status == 0 && transfer->actual_num_bytes >= sizeof(usb_setup_packet_t)) {
+        data_len = transfer->actual_num_bytes - sizeof(usb_setup_packet_t);
     }
-    ret->actual_length = htonl(data_len);
+    res->actual_length = data_len;
 
+    bool in = slot->cmd.direction != 0;
     int len = 0;
-    
-    // Log the response header fields for debugging
-    log_write("[USB_CB] Response header: cmd=0x%08x, seqnum=%u, devid=0x%08x, dir=0x%08x, ep=0x%08x",
-             ntohl(ret->base.command), ntohl(ret->base.seqnum), ntohl(ret->base.devid),
-             ntohl(ret->base.direction), ntohl(ret->base.ep));
-    log_write("[USB_CB] Response body: status=%d, actual_len=%u",
-             (int32_t)ntohl(ret->status), ntohl(ret->actual_length));
-    
+    log_write("[USB_CB] Response: seqnum=%lu, ep=%lu, dir=%s, status=%ld, actual_len=%lu",
+              res->seqnum, res->ep, in ? "IN" : "OUT", res->status, res->actual_length);
+
     // Check if socket is still valid before sending
     if (skt < 0) {
         log_write("[USB_CB] Socket closed, cannot send control response");
-    }
-    else if (ntohl(ret->base.direction) == 0)
-    {
-        // Host-to-device: no data in response
-        len = tcp_send_locked(skt, ret, sizeof(usbip_ret_submit) - 1024, 0);
-        if (len < 0) {
-            log_write("[USB_CB] ERROR: Failed to send control response (host-to-device)");
+    } else {
+        // Only device-to-host responses carry data
+        if (in) {
+            memcpy(slot->wire.transfer_buffer, transfer->data_buffer + sizeof(usb_setup_packet_t), data_len);
         } else {
-            log_write("[USB_CB] Sent control response (host-to-device): %d bytes", len);
+            data_len = 0;
         }
-    }
-    else
-    {
-        // Device-to-host: include data in response
-        int send_size = sizeof(usbip_ret_submit) - 1024 + ntohl(ret->actual_length);
-        len = tcp_send_locked(skt, ret, send_size, 0);
+        int send_size = USBIP_RET_SUBMIT_HEADER_SIZE + data_len;
+        len = send_ret(slot, data_len);
         if (len < 0) {
-            log_write("[USB_CB] ERROR: Failed to send control response (device-to-host), errno=%d (%s)", 
-                     errno, strerror(errno));
+            log_write_err("[USB_CB] ERROR: Failed to send control response, errno=%d (%s)", errno, strerror(errno));
         } else if (len != send_size) {
-            log_write("[USB_CB] WARNING: Partial send! Expected %d bytes, sent %d bytes", send_size, len);
+            log_write_err("[USB_CB] WARNING: Partial send! Expected %d bytes, sent %d bytes", send_size, len);
         } else {
-            log_write("[USB_CB] Sent control response (device-to-host): %d bytes", len);
+            log_write("[USB_CB] Sent control response: %d bytes", len);
         }
     }
+    if (len > 0) {
+        note_sent(slot);
+    }
     ESP_LOGI(TAG, "Submitted ret_submit header for transfer_ctrl_submit %d", len);
     ESP_LOGI(TAG, "--------------------------");
-    
-    // Free allocated memory
-    usb_host_transfer_free(transfer);
-    free(ret);  // CRITICAL: Free the malloc'd ret_submit structure
-    log_write("[USB_CB] Freed ret_submit and transfer structures");
+    finish_urb(slot);
+    log_write("[USB_CB] Returned URB slot to the session arena");
 }
 
 static void transfer_cb(usb_transfer_t *transfer)
 {
-    uint8_t ep = transfer->bEndpointAddress & 0x7F;  // Extract endpoint number
+    int64_t t_complete = URB_STATS_NOW();
     log_write("[USB_CB] Transfer callback: status=%d, bytes=%d, EP=0x%02x", 
               transfer->status, transfer->actual_num_bytes, transfer->bEndpointAddress);
     
-    // Clear pending flag for this endpoint
-    if (ep == 1) {
-        ep1_transfer_pending = false;
-        log_write("[USB_CB] EP1 transfer complete, clearing pending flag");
-    }
-    if (ep == 2) {
-        ep2_transfer_pending = false;
-        log_write("[USB_CB] EP2 transfer complete, clearing pending flag");
-    }
+    // The endpoint can take the next URB
+    routes[ROUTE_OF(transfer->bEndpointAddress)].pending = false;
+    bot_cache_complete(transfer);
     
     ESP_LOGI(TAG, "--------------------------");
     ESP_LOGI(TAG, "Transfer status %d, actual number of bytes transferred %d", transfer->status, transfer->actual_num_bytes);
-    usbip_ret_submit *ret = (usbip_ret_submit *)transfer->context;
+    urb_slot_t *slot = (urb_slot_t *)transfer->context;
+    usbip_ret_desc_t *res = &slot->res;
+    urb_ledger_mark(res->seqnum, URB_LEDGER_COMPLETE);
+
+    // IN transfers were rounded up to MPS; never hand back more than was asked for
+    uint32_t actual = transfer->actual_num_bytes;
+    res->status = usbip_status_of(transfer);
+    res->actual_length = actual < slot->cmd.transfer_buffer_length ? actual : slot->cmd.transfer_buffer_length;
+    if (urb_watchdog_disarm(transfer)) {
+        res->status = -USBIP_ETIMEDOUT;
+        res->actual_length = 0;
+    }
+    slot->ts.complete = t_complete;
+    usbmon_record(USBMON_COMPLETE, transfer, res->seqnum, slot->xfer_type, driver_obj.dev_addr);
+    flight_rec_event(FLIGHT_EV_URB_COMPLETE, res->seqnum, transfer->bEndpointAddress & 0x0F, transfer->status);
     int len = 0;
     
     // Check if socket is still valid before sending
     if (skt < 0) {
         log_write("[USB_CB] Socket closed, cannot send transfer response");
     }
-    else if (ret->base.direction != 0)
+    else if (slot->cmd.direction != 0)
     {
-        memcpy(&ret->transfer_buffer[0], transfer->data_buffer, ntohl(ret->actual_length));
-        ret->base.direction = 0;
-        ret->actual_length = ret->actual_length;
-        // usb_host_endpoint_halt(transfer->device_handle, transfer->bEndpointAddress);
-        // usb_host_endpoint_flush(transfer->device_handle, transfer->bEndpointAddress);
-        // usb_host_endpoint_clear(transfer->device_handle, transfer->bEndpointAddress);
-        len = tcp_send_locked(skt, ret, sizeof(usbip_ret_submit) - 1024 + ntohl(ret->actual_length), 0);
+        memcpy(slot->wire.transfer_buffer, transfer->data_buffer, res->actual_length);
+        len = send_ret(slot, res->actual_length);
         if (len < 0) {
-            log_write("[USB_CB] ERROR: Failed to send transfer response (device-to-host)");
+            log_write_err("[USB_CB] ERROR: Failed to send transfer response (device-to-host)");
         } else {
             log_write("[USB_CB] Sent transfer response (device-to-host): %d bytes", len);
         }
     }
     else
     {
-        ret->base.direction = 0;
-        len = tcp_send_locked(skt, ret, sizeof(usbip_ret_submit) - 1024, 0);
+        len = send_ret(slot, 0);
         if (len < 0) {
-            log_write("[USB_CB] ERROR: Failed to send transfer response (host-to-device)");
+            log_write_err("[USB_CB] ERROR: Failed to send transfer response (host-to-device)");
         } else {
             log_write("[USB_CB] Sent transfer response (host-to-device): %d bytes", len);
         }
     }
+    if (len > 0) {
+        note_sent(slot);
+    }
     ESP_LOGI(TAG, "Submitted ret_submit header for transfer_submit %d", len);
     ESP_LOGI(TAG, "--------------------------");
-    
-    // Free allocated memory
-    usb_host_transfer_free(transfer);
-    free(ret);  // CRITICAL: Free the malloc'd ret_submit structure
-    log_write("[USB_CB] Freed ret_submit and transfer structures");
+    finish_urb(slot);
+    log_write("[USB_CB] Returned URB slot to the session arena");
+}
+
+/* Sends a RET_SUBMIT that was answered without a USB transfer, then frees its slot */
+static void send_local_ret(urb_slot_t *slot)
+{
+    slot->ts.complete = URB_STATS_NOW();
+    uint32_t data_len = slot->cmd.direction != 0 ? slot->res.actual_length : 0;
+    if (send_ret(slot, data_len) > 0) {
+        note_sent(slot);
+    } else {
+        log_write_err("[USB_XFER] ERROR: Failed to send locally answered response");
+    }
+    finish_urb(slot);
+}
+
+/* Answers an admitted URB that cannot be served, instead of leaving the client to time out */
+static void reject_urb(urb_slot_t *slot, int32_t status)
+{
+    slot->res.status = status;
+    slot->res.actual_length = 0;
+    send_ret(slot, 0);
+    urb_budget_note_rejected();
+    log_write("[USB_XFER] Rejected seqnum=%lu with status %ld", slot->res.seqnum, status);
+    finish_urb(slot);
+}
+
+void usb_handler_reject_urb(const usbip_header_basic *header, int sock, int32_t status)
+{
+    usbip_ret_desc_t res = {
+        .seqnum = ntohl(header->seqnum),
+        .devid = ntohl(header->devid),
+        .ep = ntohl(header->ep),
+        .status = status,
+    };
+    usbip_ret_submit wire;
+    usbip_encode_ret_submit(&res, &wire);
+    int len = usbip_session_send_ret(sock, &wire, USBIP_RET_SUBMIT_HEADER_SIZE, res.seqnum);
+    flight_rec_event(FLIGHT_EV_URB_SENT, res.seqnum, res.ep, len);
+    urb_budget_note_rejected();
+    log_write("[USB_XFER] Rejected seqnum=%lu with status %ld", res.seqnum, status);
 }
 
 static void _usb_ip_event_handler_2(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    int64_t t_dispatch = URB_STATS_NOW();
     log_write("[USB_XFER] Processing USB transfer request");
-    submit *recv_submit = (submit *)event_data;
+    urb_slot_t *slot = *(urb_slot_t **)event_data;
+    const usbip_submit_desc_t *cmd = &slot->cmd;
     
-    log_write("[USB_XFER] Allocating ret_submit structure");
-    usbip_ret_submit *ret_submit = (usbip_ret_submit *)malloc(sizeof(usbip_ret_submit));
-    if (ret_submit == NULL) {
-        log_write("[USB_XFER] ERROR: Failed to allocate ret_submit");
+    if (session_arena_is_stale(slot)) {
+        // Queued before its session was torn down; nobody is waiting for the answer
+        log_write("[USB_XFER] Dropping seqnum=%lu from an ended session", cmd->seqnum);
+        finish_urb(slot);
         return;
     }
-    
-    ret_submit->base.command = htonl(USBIP_RET_SUBMIT);
-    ret_submit->base.seqnum = recv_submit->header.seqnum; // Preserve seqnum from request
-    ret_submit->base.devid = recv_submit->header.devid;   // Preserve devid from request
-    ret_submit->base.direction = recv_submit->header.direction; // Preserve direction from request
-    ret_submit->base.ep = recv_submit->header.ep;         // Preserve endpoint from request
-
-    ret_submit->status = htonl(0x00000000);  // Will be updated by callback based on transfer status
-    ret_submit->start_frame = htonl(0x00000000);
-    ret_submit->number_of_packets = htonl(0x00000000);
-    ret_submit->error_count = htonl(0x00000000);
-    ret_submit->actual_length = recv_submit->cmd_submit.transfer_buffer_length; //(ntohl(recv_submit->header.direction) == 1) ? recv_submit->cmd_submit.transfer_buffer_length : 0;
-
-    memset(ret_submit->padding, 0, sizeof(ret_submit->padding));
-
-    skt = recv_submit->sock;
-    log_write("[USB_XFER] Allocating USB transfer buffer (1000 bytes)");
-    usb_transfer_t *transfer = NULL;
-    esp_err_t err = usb_host_transfer_alloc(1000, 0, &transfer);
-    
-    if (err != ESP_OK || transfer == NULL) {
-        log_write("[USB_XFER] ERROR: Failed to allocate transfer: %s", esp_err_to_name(err));
-        free(ret_submit);
-        return;
-    }
-    log_write("[USB_XFER] Transfer buffer allocated successfully");
+    skt = slot->sock;
+    usbip_ret_desc_init(cmd, &slot->res);
 
-    ESP_LOGI(TAG, "--------------------------");
-    printf("Seqnum: %ld\n", ntohl(ret_submit->base.seqnum));
-    ESP_LOGI("Host_Allocation", "Error Value %x", err);
+    uint32_t seqnum = cmd->seqnum;
+    uint32_t ep = cmd->ep & 0x0F;
+    uint32_t len = cmd->transfer_buffer_length;
+    ep_route_t *route = &routes[ROUTE_INDEX(cmd->direction, ep)];
 
-    transfer->context = (void *)ret_submit;
+    slot->ts.dispatch = t_dispatch;
+    slot->xfer_type = route->xfer_type;
+    log_write("[USB_XFER] seqnum=%lu EP=0x%02x, length=%lu", seqnum, route->address, len);
 
-    ESP_LOGI("Transfer Buffer", "Length: %lx", ntohl(recv_submit->cmd_submit.transfer_buffer_length));
-    transfer->flags = ntohl(recv_submit->cmd_submit.transfer_flags);
+    if (driver_obj.dev_hdl == NULL) {
+        log_write_err("[USB_XFER] ERROR: No device");
+        reject_urb(slot, -USBIP_ENODEV);
+        return;
+    }
+    if (bot_cache_submit(cmd, slot->wire.transfer_buffer, &slot->res)) {
+        send_local_ret(slot);
+        return;
+    }
+    if (route->prep == NULL) {
+        log_write_err("[USB_XFER] ERROR: EP%lu is not in the active configuration", ep);
+        reject_urb(slot, -USBIP_EPROTO);
+        return;
+    }
+    if (len > USBIP_MAX_TRANSFER_SIZE) {
+        log_write_err("[USB_XFER] ERROR: Length %lu exceeds the %d-byte transfer buffer", len, USBIP_MAX_TRANSFER_SIZE);
+        reject_urb(slot, -USBIP_EPROTO);
+        return;
+    }
+    if (route->pending) {
+        log_write_err("[USB_XFER] WARNING: EP 0x%02x transfer already pending, rejecting", route->address);
+        reject_urb(slot, -USBIP_EBUSY);
+        return;
+    }
 
-    transfer->device_handle = driver_obj.dev_hdl;
-    
-    uint32_t ep = ntohl(recv_submit->header.ep);
-    log_write("[USB_XFER] EP=%u, direction=%u, length=%u", 
-              ep, ntohl(recv_submit->header.direction), ntohl(recv_submit->cmd_submit.transfer_buffer_length));
-    
-    if (ep == 0)
-    {
-        log_write("[USB_XFER] Control transfer on EP0");
-        memcpy(transfer->data_buffer, (void *)&recv_submit->cmd_submit.setup, 8);
-        printf(" %x,", *transfer->data_buffer);
-        printf(" %x,", *(transfer->data_buffer + 1));
-        printf(" %x,", *(transfer->data_buffer + 2));
-        printf(" %x,", *(transfer->data_buffer + 3));
-        printf(" %x,", *(transfer->data_buffer + 4));
-        printf(" %x,", *(transfer->data_buffer + 5));
-        printf(" %x,", *(transfer->data_buffer + 6));
-        printf(" %x\n", *(transfer->data_buffer + 7));
-        transfer->callback = transfer_cb_ctrl;
-        transfer->bEndpointAddress = (ep | (ntohl(recv_submit->header.direction) << 7));
-        transfer->num_bytes = ntohl(recv_submit->cmd_submit.transfer_buffer_length) + sizeof(usb_setup_packet_t);
-        log_write("[USB_XFER] Submitting control transfer, %d bytes", transfer->num_bytes);
-        err = usb_host_transfer_submit_control(driver_obj.client_hdl, transfer);
-        log_write("[USB_XFER] Control transfer result: %s", esp_err_to_name(err));
-        ESP_LOGI("Control Transfer Submit", "Error Value %x", err);
+    usb_transfer_t *transfer = slot->transfer;
+    esp_err_t err = route->prep(route, slot, len);
+    if (err != ESP_OK) {
+        log_write_err("[USB_XFER] ERROR: EP 0x%02x: %s", route->address, esp_err_to_name(err));
+        reject_urb(slot, -USBIP_EPROTO);
+        return;
     }
-    else
-    {
-        log_write("[USB_XFER] Interrupt/bulk transfer on EP%u", ep);
-        
-        // Check if there's already a pending transfer on this endpoint
-        if (ep == 1 && ep1_transfer_pending) {
-            log_write("[USB_XFER] WARNING: EP1 transfer already pending, skipping");
-            usb_host_transfer_free(transfer);
-            free(ret_submit);
-            return;
-        }
-        if (ep == 2 && ep2_transfer_pending) {
-            log_write("[USB_XFER] WARNING: EP2 transfer already pending, skipping");
-            usb_host_transfer_free(transfer);
-            free(ret_submit);
-            return;
-        }
-        
-        transfer->callback = transfer_cb;
-        transfer->bEndpointAddress = (ep | (ntohl(recv_submit->header.direction) << 7)); // ep->bEndpointAddress;
-        log_write("[USB_XFER] Endpoint address: 0x%02x", transfer->bEndpointAddress);
-        ESP_LOGI("Transfer Submit", "Endpoint: %d", transfer->bEndpointAddress);
-        if (ntohl(recv_submit->header.direction) != 0)
-        {
-            // memset(transfer->data_buffer, 0x00, ep->wMaxPacketSize);
-            transfer->num_bytes = usb_round_up_to_mps(ntohl(recv_submit->cmd_submit.transfer_buffer_length), mps[ntohl(recv_submit->header.ep) - 1]); // ep->wMaxPacketSize
-        }
-        else
-        {
-            transfer->num_bytes = ntohl(recv_submit->cmd_submit.transfer_buffer_length);
-            memcpy(transfer->data_buffer, &recv_submit->cmd_submit.transfer_buffer[0], transfer->num_bytes);
-        }
-        if (recv_submit->cmd_submit.start_frame != 0)
-        {
-            ret_submit->start_frame = recv_submit->cmd_submit.start_frame;
-        }
-        log_write("[USB_XFER] Submitting transfer, %d bytes", transfer->num_bytes);
-        err = usb_host_transfer_submit(transfer);
-        log_write("[USB_XFER] Transfer result: %s", esp_err_to_name(err));
-        
-        if (err == ESP_OK) {
-            // Mark endpoint as having pending transfer
-            if (ep == 1) ep1_transfer_pending = true;
-            if (ep == 2) ep2_transfer_pending = true;
-        }
-        
-        ESP_LOGI("Transfer Submit", "Error Value %x", err);
+    transfer->context = (void *)slot;
+    transfer->device_handle = driver_obj.dev_hdl;
+    transfer->bEndpointAddress = route->address;
+    transfer->callback = route->callback;
+    transfer->flags = (cmd->transfer_flags & USBIP_URB_ZERO_PACKET) ? USB_TRANSFER_FLAG_ZERO_PACK : 0;
+
+    // Armed and marked first: the transfer may complete and be freed before submit returns
+    usbmon_record(USBMON_SUBMIT, transfer, seqnum, route->xfer_type, driver_obj.dev_addr);
+    urb_watchdog_arm(transfer, seqnum, route->xfer_type, route->interval);
+    session_arena_set_on_bus(slot, true);
+    urb_ledger_mark(seqnum, URB_LEDGER_SUBMIT);
+    route->pending = route->xfer_type != USB_TRANSFER_TYPE_CTRL;
+    err = route->submit(transfer);
+    flight_rec_event(FLIGHT_EV_URB_SUBMIT, seqnum, ep, err);
+    if (err != ESP_OK) {
+        log_write_err("[USB_XFER] ERROR: Submit on EP 0x%02x failed: %s", route->address, esp_err_to_name(err));
+        route->pending = false;
+        urb_watchdog_disarm(transfer);
+        usbmon_record(USBMON_ERROR, transfer, seqnum, route->xfer_type, driver_obj.dev_addr);
+        reject_urb(slot, -USBIP_EPROTO);
     }
-    ESP_LOGI(TAG, "--------------------------");
-    log_write("[USB_XFER] Transfer processing complete, free heap: %d", esp_get_free_heap_size());
 }
 
 void init_unlink(uint32_t seqnum)
@@ -522,104 +737,82 @@ void usb_class_driver_task(void *arg)
     /* Stores all the information with regards to the USB */
     log_write("[USB] USB class driver task started");
 
+    memset(&driver_obj, 0, sizeof(class_driver_t));
+
+    // Wait until daemon task has installed USB Host Library
+    log_write("[USB] Waiting for USB Host Library to be installed...");
+    xSemaphoreTake(signaling_sem, portMAX_DELAY);
+    log_write("[USB] USB Host Library ready, registering client");
+
+    // The client and the URB event loop live for the whole run; unplugging
+    // only closes the device (see action_close_dev)
+    ESP_LOGI(TAG, "Registering Client");
+    usb_host_client_config_t client_config = {
+        .is_synchronous = false, // Synchronous clients currently not supported. Set this to false
+        .max_num_event_msg = CLIENT_NUM_EVENT_MSG,
+        .async = {
+            .client_event_callback = client_event_cb,
+            .callback_arg = (void *)&driver_obj,
+        },
+    };
+    ESP_ERROR_CHECK(usb_host_client_register(&client_config, &driver_obj.client_hdl));
+
+    // Every queued event is an admitted URB's slot, so the budget bounds the queue
+    esp_event_loop_args_t loop_args = {
+        .queue_size = CONFIG_URB_BUDGET_MAX_URBS,
+        .task_name = "usbip_events",
+        .task_priority = 21,
+        .task_stack_size = 4 * 1024,
+        .task_core_id = 0};
+
+    esp_event_loop_create(&loop_args, &loop_handle2);
+
+    esp_event_handler_register_with(loop_handle2, USBIP_EVENT_BASE, USBIP_CMD_SUBMIT, _usb_ip_event_handler_2, NULL);
+
+    log_write("[USB] USB client ready, waiting for device events...");
     while (1)
     {
-        memset(&driver_obj, 0, sizeof(class_driver_t));
-
-        // Wait until daemon task has installed USB Host Library
-        log_write("[USB] Waiting for USB Host Library to be installed...");
-        xSemaphoreTake(signaling_sem, portMAX_DELAY);
-        log_write("[USB] USB Host Library ready, registering client");
-
-        ESP_LOGI(TAG, "Registering Client");
-        usb_host_client_config_t client_config = {
-            .is_synchronous = false, // Synchronous clients currently not supported. Set this to false
-            .max_num_event_msg = CLIENT_NUM_EVENT_MSG,
-            .async = {
-                .client_event_callback = client_event_cb,
-                .callback_arg = (void *)&driver_obj,
-            },
-        };
-        ESP_ERROR_CHECK(usb_host_client_register(&client_config, &driver_obj.client_hdl));
-
-        esp_event_loop_args_t loop_args = {
-            .queue_size = 100,
-            .task_name = "usbip_events",
-            .task_priority = 21,
-            .task_stack_size = 4 * 1024,
-            .task_core_id = 0};
-
-        esp_event_loop_create(&loop_args, &loop_handle2);
-
-        esp_event_handler_register_with(loop_handle2, USBIP_EVENT_BASE, USBIP_CMD_SUBMIT, _usb_ip_event_handler_2, NULL);
-
-        log_write("[USB] USB client ready, waiting for device events...");
-        while (1)
+        if (driver_obj.actions == 0)
         {
-            if (driver_obj.actions == 0)
-            {
-                usb_host_client_handle_events(driver_obj.client_hdl, portMAX_DELAY);
-            }
-            else
-            {
-                log_write("[USB] Processing device actions: 0x%02x", driver_obj.actions);
-                if (driver_obj.actions & ACTION_OPEN_DEV)
-                {
-                    action_open_dev(&driver_obj);
-                }
-                if (driver_obj.actions & ACTION_GET_DEV_INFO)
-                {
-                    action_get_info(&driver_obj);
-                }
-                if (driver_obj.actions & ACTION_GET_DEV_DESC)
-                {
-                    action_get_dev_desc(&driver_obj);
-                }
-                if (driver_obj.actions & ACTION_GET_CONFIG_DESC)
-                {
-                    action_get_config_desc(&driver_obj);
-                }
-                if (driver_obj.actions & ACTION_GET_STR_DESC)
-                {
-                    action_get_str_desc(&driver_obj);
-                }
-                
-                log_write("[USB] Actions after processing: 0x%02x", driver_obj.actions);
-                
-                if (driver_obj.actions & ACTION_CLOSE_DEV)
-                {
-                    log_write("[USB] Closing device");
-                    aciton_close_dev(&driver_obj);
-                }
-                if (driver_obj.actions & ACTION_EXIT)
-                {
-                    log_write("[USB] Exit action requested");
-                    /* TODO : Unbind the tcp socket and close the socket to prevent any error on client pc */
-                    /* TODO : Delete the TCP SERVER TASK and free up the resource */
-                    device_busy = false;
-                    break;
-                }
-
-                /* Starting the TCP server on Device Detection - ONLY IF NOT ALREADY RUNNING */
-                // NOTE: TCP server is now started in main.c, so we don't need to start it here
-                // This was causing crashes because it tried to create duplicate tasks
-                log_write("[USB] Device enumeration done, device is ready for USB/IP connections");
-                // xTaskCreatePinnedToCore(tcp_server_start, "TCP Server Start", 4096, NULL, 4, tcp_server_task, 1);
-                vTaskDelay(10);
-            }
+            usb_host_client_handle_events(driver_obj.client_hdl, portMAX_DELAY);
+            continue;
         }
 
-        ESP_LOGI(TAG, "Deregistering Client");
-        ESP_ERROR_CHECK(usb_host_client_deregister(driver_obj.client_hdl));
-        xSemaphoreGive(signaling_sem);
-        vTaskDelay(10);
+        log_write("[USB] Processing device actions: 0x%02x", driver_obj.actions);
+        if (driver_obj.actions & ACTION_OPEN_DEV)
+        {
+            action_open_dev(&driver_obj);
+        }
+        if (driver_obj.actions & ACTION_GET_DEV_INFO)
+        {
+            action_get_info(&driver_obj);
+        }
+        if (driver_obj.actions & ACTION_GET_DEV_DESC)
+        {
+            action_get_dev_desc(&driver_obj);
+        }
+        if (driver_obj.actions & ACTION_GET_CONFIG_DESC)
+        {
+            action_get_config_desc(&driver_obj);
+        }
+        if (driver_obj.actions & ACTION_GET_STR_DESC)
+        {
+            action_get_str_desc(&driver_obj);
+        }
+        
+        log_write("[USB] Actions after processing: 0x%02x", driver_obj.actions);
+        
+        if (driver_obj.actions & ACTION_CLOSE_DEV)
+        {
+            action_close_dev(&driver_obj);
+        }
     }
 }
 
 void usb_host_lib_daemon_task(void *arg)
 {
     SemaphoreHandle_t signaling_sem = (SemaphoreHandle_t)arg;
-    /* This will keep on looking for USB Devices */
+    /* Installed once; devices come and go without reinstalling the library */
     log_write("[USB] USB Host daemon task started");
     while (1)
     {
@@ -630,51 +823,29 @@ void usb_host_lib_daemon_task(void *arg)
             .intr_flags = ESP_INTR_FLAG_LEVEL1,
         };
         esp_err_t err = usb_host_install(&host_config);
-        if (err != ESP_OK) {
-            log_write("[USB] ERROR: Failed to install USB Host Library: %s", esp_err_to_name(err));
-            ESP_LOGE(TAG, "Failed to install USB Host: %s", esp_err_to_name(err));
-            vTaskDelay(pdMS_TO_TICKS(5000));
-            continue;
+        if (err == ESP_OK) {
+            break;
         }
-        log_write("[USB] USB Host Library installed successfully");
-        log_write("[USB] USB PHY initialized on GPIO19 (D-) and GPIO20 (D+)");
-
-        // Signal to the class driver task that the host library is installed
-        xSemaphoreGive(signaling_sem);
-        vTaskDelay(10); // Short delay to let client task spin up
+        log_write_err("[USB] ERROR: Failed to install USB Host Library: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to install USB Host: %s", esp_err_to_name(err));
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
+    log_write("[USB] USB Host Library installed successfully");
+    boot_timeline_mark(BOOT_EV_USB_HOST_READY);
+    log_write("[USB] USB PHY initialized on GPIO19 (D-) and GPIO20 (D+)");
 
-        bool has_clients = true;
-        bool has_devices = true;
+    // Signal to the class driver task that the host library is installed
+    xSemaphoreGive(signaling_sem);
 
-        log_write("[USB] Entering USB host event loop, waiting for devices...");
-        /* This loop will continue till the USB Device is connected */
-        while (has_clients || has_devices)
+    log_write("[USB] Entering USB host event loop, waiting for devices...");
+    while (1)
+    {
+        uint32_t event_flags;
+        ESP_ERROR_CHECK(usb_host_lib_handle_events(portMAX_DELAY, &event_flags));
+        
+        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE)
         {
-            uint32_t event_flags;
-            ESP_ERROR_CHECK(usb_host_lib_handle_events(portMAX_DELAY, &event_flags));
-            
-            if (event_flags != 0) {
-                log_write("[USB] USB host event: flags=0x%08x", event_flags);
-            }
-            
-            if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS)
-            {
-                log_write("[USB] No more USB clients");
-                has_clients = false;
-            }
-            if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE)
-            {
-                log_write("[USB] All USB devices freed");
-                has_devices = false;
-            }
+            log_write("[USB] All USB devices freed");
         }
-        /* After USB Device is disconnected we need to free the resources */
-        ESP_LOGI(TAG, "No more clients and devices");
-
-        // Uninstall the USB Host Library
-        ESP_ERROR_CHECK(usb_host_uninstall());
-
-        xSemaphoreTake(signaling_sem, portMAX_DELAY);
-        vTaskDelay(10);
     }
-}
\ No newline at end of file
+}
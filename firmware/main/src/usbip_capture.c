@@ -0,0 +1,334 @@
+#include "usbip_capture.h"
+#include "usbip_server.h"
+#include "log_handler.h"
+#include "mem_policy.h"
+#include "mem_pressure.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define RING_SIZE   CONFIG_USBIP_CAPTURE_RING_SIZE
+#define REC_SIZE(cap_len)   (sizeof(cap_rec_t) + (((cap_len) + 3) & ~3u))
+
+/* Synthetic link layer: 192.0.2.1 (client) <-> 192.0.2.2:3240 (this device) */
+#define SYNTH_HDR_LEN   54
+#define CLIENT_PORT     50000
+#define SERVER_PORT     3240
+
+typedef struct
+{
+    int64_t ts_us;
+    uint32_t orig_len;
+    uint16_t cap_len;       // Bytes stored after this header
+    uint8_t dir;
+    uint8_t reserved;
+} cap_rec_t;
+
+static const char *TAG = "USBIP_CAPTURE";
+
+static uint8_t *ring = NULL;
+static uint32_t head = 0;           // Monotonic write offset
+static uint32_t tail = 0;           // Monotonic offset of the oldest record
+static SemaphoreHandle_t cap_mutex = NULL;
+static volatile bool active = false;
+static uint32_t generation = 0;     // Bumped by every start so exports notice the reset
+static usbip_capture_filter_t filter;
+static uint32_t captured = 0;
+static uint32_t overwritten = 0;
+static uint32_t dropped = 0;
+
+static void ring_put(uint32_t pos, const void *data, size_t len)
+{
+    uint32_t off = pos % RING_SIZE;
+    size_t first = RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&ring[off], data, first);
+    memcpy(ring, (const uint8_t *)data + first, len - first);
+}
+
+static void ring_get(uint32_t pos, void *data, size_t len)
+{
+    uint32_t off = pos % RING_SIZE;
+    size_t first = RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(data, &ring[off], first);
+    memcpy((uint8_t *)data + first, ring, len - first);
+}
+
+/* Applies the endpoint/seqnum/command filter to the PDU header */
+static bool capture_match(const uint8_t *pdu, size_t len)
+{
+    uint16_t version;
+    if (len < sizeof(version)) {
+        return false;
+    }
+    memcpy(&version, pdu, sizeof(version));
+    if (ntohs(version) == USBIP_VERSION) {
+        return (filter.cmd_mask & USBIP_CAPTURE_CMD_OP) != 0;
+    }
+
+    usbip_header_basic hdr;
+    if (len < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, pdu, sizeof(hdr));
+
+    uint32_t cmd = ntohl(hdr.command);
+    uint32_t ep = ntohl(hdr.ep);
+    uint32_t seq = ntohl(hdr.seqnum);
+    if (cmd > USBIP_RET_UNLINK || !(filter.cmd_mask & USBIP_CAPTURE_CMD(cmd))) {
+        return false;
+    }
+    if (ep > 15 || !(filter.ep_mask & (1u << ep))) {
+        return false;
+    }
+    return seq >= filter.seq_min && seq <= filter.seq_max;
+}
+
+esp_err_t usbip_capture_init(void)
+{
+    ring = mem_alloc(MEM_USE_CAPTURE, RING_SIZE);
+    cap_mutex = xSemaphoreCreateMutex();
+    if (ring == NULL || cap_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d byte capture ring", RING_SIZE);
+        mem_free(MEM_USE_CAPTURE, ring);
+        ring = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    usbip_capture_default_filter(&filter);
+    return ESP_OK;
+}
+
+void usbip_capture_default_filter(usbip_capture_filter_t *f)
+{
+    f->ep_mask = 0xFFFF;
+    f->cmd_mask = USBIP_CAPTURE_CMD_ALL;
+    f->seq_min = 0;
+    f->seq_max = UINT32_MAX;
+    f->snaplen = CONFIG_USBIP_CAPTURE_SNAPLEN;
+}
+
+void usbip_capture_start(const usbip_capture_filter_t *f)
+{
+    if (ring == NULL) {
+        return;
+    }
+    xSemaphoreTake(cap_mutex, portMAX_DELAY);
+    filter = *f;
+    if (filter.snaplen == 0 || filter.snaplen > USBIP_CAPTURE_MAX_SNAPLEN) {
+        filter.snaplen = USBIP_CAPTURE_MAX_SNAPLEN;
+    }
+    head = tail = 0;
+    generation++;
+    captured = overwritten = dropped = 0;
+    active = true;
+    xSemaphoreGive(cap_mutex);
+
+    log_write("[CAPTURE] Started: ep_mask=0x%04x cmd_mask=0x%02x seq=%lu-%lu snaplen=%u",
+              filter.ep_mask, filter.cmd_mask, filter.seq_min, filter.seq_max, filter.snaplen);
+}
+
+void usbip_capture_stop(void)
+{
+    active = false;
+    log_write("[CAPTURE] Stopped: %lu captured, %lu overwritten, %lu dropped",
+              captured, overwritten, dropped);
+}
+
+void usbip_capture_frame(usbip_capture_dir_t dir, const void *hdr, size_t hdr_len,
+                         const void *body, size_t body_len)
+{
+    if (!active || !capture_match((const uint8_t *)hdr, hdr_len)) {
+        return;
+    }
+    if (mem_pressure_tier() >= MEM_PRESSURE_QUIET) {
+        mem_pressure_note_drop(MEM_PRESSURE_DROP_CAPTURE);
+        return;
+    }
+
+    cap_rec_t rec;
+    rec.ts_us = esp_timer_get_time();
+    rec.orig_len = hdr_len + body_len;
+    rec.cap_len = rec.orig_len < filter.snaplen ? rec.orig_len : filter.snaplen;
+    rec.dir = dir;
+    rec.reserved = 0;
+
+    size_t n1 = hdr_len < rec.cap_len ? hdr_len : rec.cap_len;
+    size_t n2 = rec.cap_len - n1;
+    uint32_t need = REC_SIZE(rec.cap_len);
+
+    // The sender and the receive task both land here; never stall either for long
+    if (xSemaphoreTake(cap_mutex, pdMS_TO_TICKS(2)) != pdTRUE) {
+        dropped++;
+        return;
+    }
+
+    while (RING_SIZE - (head - tail) < need) {
+        cap_rec_t old;
+        ring_get(tail, &old, sizeof(old));
+        tail += REC_SIZE(old.cap_len);
+        overwritten++;
+    }
+    ring_put(head, &rec, sizeof(rec));
+    ring_put(head + sizeof(rec), hdr, n1);
+    if (n2 > 0) {
+        ring_put(head + sizeof(rec) + n1, body, n2);
+    }
+    head += need;
+    captured++;
+
+    xSemaphoreGive(cap_mutex);
+}
+
+static uint16_t ip_checksum(const uint8_t *data, size_t len)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+/* Ethernet + IPv4 + TCP headers for one PDU; TCP sequence numbers count captured PDU bytes */
+static void build_headers(uint8_t *h, uint8_t dir, uint32_t orig_len, const uint32_t *seq, uint16_t ip_id)
+{
+    static const uint8_t mac_client[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const uint8_t mac_device[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+    const uint8_t ip_client[4] = { 192, 0, 2, 1 };
+    const uint8_t ip_device[4] = { 192, 0, 2, 2 };
+    bool rx = (dir == USBIP_CAPTURE_RX);
+
+    memset(h, 0, SYNTH_HDR_LEN);
+
+    // Ethernet
+    memcpy(&h[0], rx ? mac_device : mac_client, 6);
+    memcpy(&h[6], rx ? mac_client : mac_device, 6);
+    h[12] = 0x08;
+    h[13] = 0x00;
+
+    // IPv4
+    uint8_t *ip = &h[14];
+    uint32_t ip_len = 40 + orig_len;
+    if (ip_len > 0xFFFF) {
+        ip_len = 0xFFFF;
+    }
+    ip[0] = 0x45;
+    ip[2] = ip_len >> 8;
+    ip[3] = ip_len & 0xFF;
+    ip[4] = ip_id >> 8;
+    ip[5] = ip_id & 0xFF;
+    ip[6] = 0x40;               // Don't fragment
+    ip[8] = 64;
+    ip[9] = 6;                  // TCP
+    memcpy(&ip[12], rx ? ip_client : ip_device, 4);
+    memcpy(&ip[16], rx ? ip_device : ip_client, 4);
+    uint16_t csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum & 0xFF;
+
+    // TCP, checksum left zero (Wireshark does not verify it by default)
+    uint8_t *tcp = &h[34];
+    uint16_t sport = rx ? CLIENT_PORT : SERVER_PORT;
+    uint16_t dport = rx ? SERVER_PORT : CLIENT_PORT;
+    uint32_t s = seq[dir];
+    uint32_t a = seq[!dir];
+    tcp[0] = sport >> 8;
+    tcp[1] = sport & 0xFF;
+    tcp[2] = dport >> 8;
+    tcp[3] = dport & 0xFF;
+    tcp[4] = s >> 24;
+    tcp[5] = s >> 16;
+    tcp[6] = s >> 8;
+    tcp[7] = s;
+    tcp[8] = a >> 24;
+    tcp[9] = a >> 16;
+    tcp[10] = a >> 8;
+    tcp[11] = a;
+    tcp[12] = 5 << 4;           // Header length in words
+    tcp[13] = 0x18;             // PSH | ACK
+    tcp[14] = 0xFF;
+    tcp[15] = 0xFF;
+}
+
+esp_err_t usbip_capture_export(pcapng_write_fn write, void *ctx)
+{
+    if (ring == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pcapng_writer_t *w = mem_alloc(MEM_USE_CAPTURE, sizeof(pcapng_writer_t));
+    uint8_t *pdu = mem_alloc(MEM_USE_CAPTURE, USBIP_CAPTURE_MAX_SNAPLEN);
+    if (w == NULL || pdu == NULL) {
+        mem_free(MEM_USE_CAPTURE, w);
+        mem_free(MEM_USE_CAPTURE, pdu);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pcapng_begin(w, write, ctx);
+    pcapng_add_interface(w, PCAPNG_LINKTYPE_ETHERNET, SYNTH_HDR_LEN + filter.snaplen, "usbip");
+
+    xSemaphoreTake(cap_mutex, portMAX_DELAY);
+    uint32_t pos = tail;
+    uint32_t end = head;
+    uint32_t gen = generation;
+    xSemaphoreGive(cap_mutex);
+
+    uint32_t seq[2] = { 1, 1 };
+    uint16_t ip_id = 0;
+    uint8_t hdr[SYNTH_HDR_LEN];
+
+    // Copy one record at a time so capturing continues while the file is sent
+    while (w->err == ESP_OK) {
+        cap_rec_t rec;
+
+        xSemaphoreTake(cap_mutex, portMAX_DELAY);
+        if ((int32_t)(pos - tail) < 0) {
+            pos = tail;         // Overwritten while we were sending
+        }
+        if (gen != generation || (int32_t)(end - pos) <= 0) {
+            xSemaphoreGive(cap_mutex);
+            break;
+        }
+        ring_get(pos, &rec, sizeof(rec));
+        ring_get(pos + sizeof(rec), pdu, rec.cap_len);
+        pos += REC_SIZE(rec.cap_len);
+        xSemaphoreGive(cap_mutex);
+
+        build_headers(hdr, rec.dir, rec.orig_len, seq, ip_id++);
+        pcapng_add_packet(w, 0, rec.ts_us, hdr, sizeof(hdr), pdu, rec.cap_len,
+                          SYNTH_HDR_LEN + rec.orig_len);
+        seq[rec.dir] += rec.orig_len;
+    }
+
+    esp_err_t err = pcapng_end(w);
+    mem_free(MEM_USE_CAPTURE, pdu);
+    mem_free(MEM_USE_CAPTURE, w);
+    return err;
+}
+
+void usbip_capture_get_status(usbip_capture_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    status->size = RING_SIZE;
+    if (ring == NULL) {
+        return;
+    }
+    xSemaphoreTake(cap_mutex, portMAX_DELAY);
+    status->active = active;
+    status->captured = captured;
+    status->overwritten = overwritten;
+    status->dropped = dropped;
+    status->used = head - tail;
+    xSemaphoreGive(cap_mutex);
+}
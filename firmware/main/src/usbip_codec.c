@@ -0,0 +1,44 @@
+#include "usbip_codec.h"
+#include <string.h>
+#include <arpa/inet.h>
+
+void usbip_decode_cmd_submit(const usbip_header_basic *header, const usbip_cmd_submit *cmd, usbip_submit_desc_t *out)
+{
+    out->seqnum = ntohl(header->seqnum);
+    out->devid = ntohl(header->devid);
+    out->direction = ntohl(header->direction);
+    out->ep = ntohl(header->ep);
+    out->transfer_flags = ntohl(cmd->transfer_flags);
+    out->transfer_buffer_length = ntohl(cmd->transfer_buffer_length);
+    out->start_frame = (int32_t)ntohl(cmd->start_frame);
+    out->number_of_packets = (int32_t)ntohl(cmd->number_of_packets);
+    out->interval = (int32_t)ntohl(cmd->interval);
+    memcpy(&out->setup, &cmd->setup, sizeof(out->setup));
+}
+
+void usbip_ret_desc_init(const usbip_submit_desc_t *cmd, usbip_ret_desc_t *out)
+{
+    out->seqnum = cmd->seqnum;
+    out->devid = cmd->devid;
+    out->ep = cmd->ep;
+    out->status = 0;
+    out->actual_length = 0;
+    out->start_frame = cmd->start_frame;
+    out->number_of_packets = 0;
+    out->error_count = 0;
+}
+
+void usbip_encode_ret_submit(const usbip_ret_desc_t *ret, usbip_ret_submit *wire)
+{
+    wire->base.command = htonl(USBIP_RET_SUBMIT);
+    wire->base.seqnum = htonl(ret->seqnum);
+    wire->base.devid = htonl(ret->devid);
+    wire->base.direction = 0;   // Zero in every RET_SUBMIT
+    wire->base.ep = htonl(ret->ep);
+    wire->status = htonl((uint32_t)ret->status);
+    wire->actual_length = htonl(ret->actual_length);
+    wire->start_frame = htonl((uint32_t)ret->start_frame);
+    wire->number_of_packets = htonl((uint32_t)ret->number_of_packets);
+    wire->error_count = htonl((uint32_t)ret->error_count);
+    memset(wire->padding, 0, sizeof(wire->padding));
+}
@@ -1,5 +1,6 @@
 #include "usbip_server.h"
 #include "log_handler.h"
+#include "usbip_session.h"
 #include <errno.h>
 
 #define TAG "USB/IP SERVER"
@@ -112,7 +113,7 @@ static void _usb_ip_event_handler_1(void *event_handler_arg, esp_event_base_t ev
         memcpy(&dev_import, recv_data->rx_buffer, recv_data->len);
         
         /* Debug: print what we received */
-        log_write("[USBIP] Header: version=0x%04x, command=0x%04x, status=0x%08x", 
+        log_write("[USBIP] Header: version=0x%04x, command=0x%04x, status=0x%08lx", 
                  ntohs(dev_import.usbip_version), ntohs(dev_import.command_code), ntohl(dev_import.status));
         
         /* Calculate remaining bytes to read: total struct size - what we already have */
@@ -123,17 +124,17 @@ static void _usb_ip_event_handler_1(void *event_handler_arg, esp_event_base_t ev
         int bytes_read = recv(recv_data->sock, ((char*)&dev_import) + recv_data->len, remaining_bytes, 0);
         
         if (bytes_read < 0) {
-            log_write("[USBIP] ERROR: recv() failed with errno=%d (%s)", errno, strerror(errno));
+            log_write_err("[USBIP] ERROR: recv() failed with errno=%d (%s)", errno, strerror(errno));
             break;
         }
         
         if (bytes_read == 0) {
-            log_write("[USBIP] ERROR: Connection closed by peer while reading bus_id");
+            log_write_err("[USBIP] ERROR: Connection closed by peer while reading bus_id");
             break;
         }
         
         if (bytes_read != remaining_bytes) {
-            log_write("[USBIP] ERROR: Incomplete read (got %d bytes, expected %d)", bytes_read, remaining_bytes);
+            log_write_err("[USBIP] ERROR: Incomplete read (got %d bytes, expected %d)", bytes_read, remaining_bytes);
             break;
         }
         
@@ -141,7 +142,7 @@ static void _usb_ip_event_handler_1(void *event_handler_arg, esp_event_base_t ev
         
         op_rep_import rep_import;
 
-        if (!strcmp(BUS_ID, dev_import.bus_id))
+        if (!strcmp(BUS_ID, dev_import.bus_id) && get_dev_desc() != NULL && get_config_desc() != NULL)
         {
             ESP_LOGI(TAG, "BUS-ID matches for requested import device");
             log_write("[USBIP] BUS-ID matches for requested import device: %s", dev_import.bus_id);
@@ -178,28 +179,38 @@ static void _usb_ip_event_handler_1(void *event_handler_arg, esp_event_base_t ev
             rep_import.usbip_version = htons(USBIP_VERSION);
             rep_import.reply_code = htons(OP_REP_IMPORT);
             rep_import.status = htonl(0x00000001);
-            ESP_LOGE(TAG, "Received different BUS ID");
-            log_write("[USBIP] ERROR: Received different BUS ID: %s (expected: %s)", dev_import.bus_id, BUS_ID);
+            ESP_LOGE(TAG, "Import refused");
+            log_write_err("[USBIP] ERROR: Import of %s refused (exporting %s, device %s)", dev_import.bus_id, BUS_ID,
+                          get_dev_desc() != NULL ? "present" : "not connected");
         }
 
         int len = tcp_send_locked(recv_data->sock, &rep_import, sizeof(rep_import), 0);
         if (len < 0)
         {
             ESP_LOGE(TAG, "Error occurred during sending import response");
-            log_write("[USBIP] ERROR: Failed to send import response, errno=%d", errno);
+            log_write_err("[USBIP] ERROR: Failed to send import response, errno=%d", errno);
         }
         else if (len == 0)
         {
             ESP_LOGW(TAG, "Connection closed");
-            log_write("[USBIP] WARNING: Connection closed during import");
+            log_write_err("[USBIP] WARNING: Connection closed during import");
         }
         else if (len != sizeof(rep_import))
         {
-            log_write("[USBIP] WARNING: Partial send! Expected %d bytes, sent %d bytes", sizeof(rep_import), len);
+            log_write_err("[USBIP] WARNING: Partial send! Expected %d bytes, sent %d bytes", sizeof(rep_import), len);
+        }
+        else if (rep_import.status != 0)
+        {
+            log_write("[USBIP] Import refusal sent");
         }
         else
         {
             log_write("[USBIP] Import response sent successfully (%d bytes), setting device_busy", len);
+            uint32_t session_id = usbip_session_begin(recv_data->sock);
+            if (ntohl(dev_import.status) == USBIP_IMPORT_WANT_SESSION) {
+                op_rep_import_session rep_session = { .session_id = htonl(session_id) };
+                tcp_send_locked(recv_data->sock, &rep_session, sizeof(rep_session), 0);
+            }
             device_busy = true;
             log_write("[USBIP] Device is now busy, ready for URB commands");
         }
@@ -212,6 +223,7 @@ static void _usb_ip_event_handler_1(void *event_handler_arg, esp_event_base_t ev
 esp_err_t usbip_server_init()
 {
     SemaphoreHandle_t signaling_sem = xSemaphoreCreateBinary();
+    usbip_session_init();
 
     esp_event_loop_args_t loop_args = {
         .queue_size = 100,
@@ -0,0 +1,329 @@
+#include "usbip_session.h"
+#include "usbip_server.h"
+#include "session_arena.h"
+#include "log_handler.h"
+#include "mem_policy.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define RING_SIZE   CONFIG_USBIP_RESUME_BUFFER_SIZE
+
+/* Precedes every PDU in the replay ring */
+typedef struct
+{
+    uint32_t seqnum;
+    uint32_t len;
+} replay_rec_t;
+
+_Static_assert(RING_SIZE >= sizeof(replay_rec_t) + USBIP_RET_SUBMIT_HEADER_SIZE + USBIP_MAX_TRANSFER_SIZE,
+               "USBIP_RESUME_BUFFER_SIZE must hold one maximum-size RET_SUBMIT");
+
+static uint8_t *ring = NULL;
+static uint32_t head = 0;           // Monotonic write offset
+static uint32_t tail = 0;           // Monotonic offset of the oldest record
+static uint32_t count = 0;
+static bool evicted = false;        // A record was dropped to make room
+static uint32_t evicted_seqnum = 0; // Last record dropped, in send order
+
+static SemaphoreHandle_t session_mutex = NULL;
+static esp_timer_handle_t grace_timer = NULL;
+static usbip_session_state_t state = USBIP_SESSION_NONE;
+static uint32_t session_id = 0;
+static int session_sock = -1;
+static int64_t grace_end_us = 0;
+static uint32_t suspends = 0;
+static uint32_t resumes = 0;
+static uint32_t expired = 0;
+
+static void ring_put(uint32_t pos, const void *data, size_t len)
+{
+    uint32_t off = pos % RING_SIZE;
+    size_t first = RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&ring[off], data, first);
+    memcpy(ring, (const uint8_t *)data + first, len - first);
+}
+
+static void ring_get(uint32_t pos, void *data, size_t len)
+{
+    uint32_t off = pos % RING_SIZE;
+    size_t first = RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(data, &ring[off], first);
+    memcpy((uint8_t *)data + first, ring, len - first);
+}
+
+/* Caller holds session_mutex */
+static void ring_clear(void)
+{
+    head = tail = 0;
+    count = 0;
+    evicted = false;
+}
+
+/* Caller holds session_mutex */
+static void ring_push(uint32_t seqnum, const void *data, size_t len)
+{
+    replay_rec_t rec = { .seqnum = seqnum, .len = len };
+    uint32_t need = sizeof(rec) + len;
+    if (need > RING_SIZE) {
+        // Cannot be replayed, so a client that missed it must not resume. Everything
+        // sent before it goes too, keeping the ring a suffix of the stream.
+        ring_clear();
+        evicted = true;
+        evicted_seqnum = seqnum;
+        return;
+    }
+    while (head - tail + need > RING_SIZE) {
+        replay_rec_t old;
+        ring_get(tail, &old, sizeof(old));
+        tail += sizeof(old) + old.len;
+        count--;
+        evicted = true;
+        evicted_seqnum = old.seqnum;
+    }
+    ring_put(head, &rec, sizeof(rec));
+    ring_put(head + sizeof(rec), data, len);
+    head += need;
+    count++;
+}
+
+/*
+ * Finds where replay starts for a client whose last RET_SUBMIT was last_seqnum.
+ * Completions leave in any seqnum order across endpoints, so this goes by
+ * position in the stream rather than by comparing seqnums. Caller holds
+ * session_mutex.
+ */
+static bool ring_find_resume(uint32_t last_seqnum, uint32_t *start)
+{
+    for (uint32_t pos = tail; pos != head; ) {
+        replay_rec_t rec;
+        ring_get(pos, &rec, sizeof(rec));
+        pos += sizeof(rec) + rec.len;
+        if (rec.seqnum == last_seqnum) {
+            *start = pos;
+            return true;
+        }
+    }
+    // Not in the ring: fine if the client saw nothing the ring lacks
+    if (!evicted || evicted_seqnum == last_seqnum) {
+        *start = tail;
+        return true;
+    }
+    return false;
+}
+
+/* Back to no session; caller holds session_mutex */
+static void session_reset(void)
+{
+    esp_timer_stop(grace_timer);
+    state = USBIP_SESSION_NONE;
+    session_sock = -1;
+    ring_clear();
+}
+
+static void grace_expired(void *arg)
+{
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    if (state == USBIP_SESSION_GRACE) {
+        log_write("[SESSION] Grace window for session %08lx expired, %lu response(s) dropped",
+                  session_id, count);
+        session_reset();
+        expired++;
+        // Nobody will collect these completions any more
+        usb_handler_clear_pending();
+        session_arena_teardown();
+    }
+    xSemaphoreGive(session_mutex);
+}
+
+esp_err_t usbip_session_init(void)
+{
+    ring = mem_alloc(MEM_USE_CACHE, RING_SIZE);
+    session_mutex = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t timer_args = {
+        .callback = grace_expired,
+        .name = "session_grace",
+    };
+    if (ring == NULL || session_mutex == NULL || esp_timer_create(&timer_args, &grace_timer) != ESP_OK) {
+        log_write_err("[SESSION] ERROR: Failed to allocate %d byte replay ring", RING_SIZE);
+        mem_free(MEM_USE_CACHE, ring);
+        ring = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+uint32_t usbip_session_begin(int sock)
+{
+    if (ring == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    if (state == USBIP_SESSION_GRACE) {
+        log_write("[SESSION] Session %08lx replaced by a new import", session_id);
+        usb_handler_clear_pending();
+        session_arena_teardown();
+    }
+    session_reset();
+    do {
+        session_id = esp_random();
+    } while (session_id == 0);
+    session_sock = sock;
+    state = USBIP_SESSION_ACTIVE;
+    uint32_t id = session_id;
+    xSemaphoreGive(session_mutex);
+
+    log_write("[SESSION] Session %08lx started", id);
+    return id;
+}
+
+int usbip_session_send_ret(int sock, const void *data, size_t len, uint32_t seqnum)
+{
+    if (ring == NULL) {
+        return tcp_send_locked(sock, data, len, 0);
+    }
+
+    int ret = len;
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    if (state == USBIP_SESSION_NONE) {
+        ret = tcp_send_locked(sock, data, len, 0);
+    } else {
+        ring_push(seqnum, data, len);
+        if (state == USBIP_SESSION_ACTIVE) {
+            // The URB may predate a resume, so use the session's socket, not the one it came from
+            ret = tcp_send_locked(session_sock, data, len, 0);
+        }
+    }
+    xSemaphoreGive(session_mutex);
+    return ret;
+}
+
+bool usbip_session_suspend(void)
+{
+    if (ring == NULL) {
+        return false;
+    }
+
+    bool suspended = false;
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    if (state == USBIP_SESSION_ACTIVE) {
+        state = USBIP_SESSION_GRACE;
+        session_sock = -1;
+        grace_end_us = esp_timer_get_time() + CONFIG_USBIP_RESUME_GRACE_MS * 1000LL;
+        esp_timer_start_once(grace_timer, CONFIG_USBIP_RESUME_GRACE_MS * 1000ULL);
+        suspends++;
+        suspended = true;
+        log_write("[SESSION] Connection lost, holding session %08lx for %d ms",
+                  session_id, CONFIG_USBIP_RESUME_GRACE_MS);
+    }
+    xSemaphoreGive(session_mutex);
+    return suspended;
+}
+
+void usbip_session_end(void)
+{
+    if (ring == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    if (state == USBIP_SESSION_GRACE) {
+        log_write("[SESSION] Session %08lx ended during its grace window", session_id);
+        // Nobody is attached to collect these; an attached client's connection cleans up itself
+        usb_handler_clear_pending();
+        session_arena_teardown();
+    }
+    session_reset();
+    xSemaphoreGive(session_mutex);
+}
+
+bool usbip_session_resume(int sock, uint32_t id, uint32_t last_seqnum)
+{
+    usbip_header_common reply = {
+        .usbip_version = htons(USBIP_VERSION),
+        .command_code = htons(OP_REP_RESUME),
+        .status = htonl(1),
+    };
+
+    if (ring == NULL) {
+        tcp_send_locked(sock, &reply, sizeof(reply), 0);
+        return false;
+    }
+
+    // Held throughout so completions arriving meanwhile queue up behind the replay
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    const char *refused = NULL;
+    uint32_t start = tail;
+    if (state != USBIP_SESSION_GRACE || id != session_id) {
+        refused = "no such session";
+    } else if (!ring_find_resume(last_seqnum, &start)) {
+        refused = "responses it has not seen were dropped";
+    }
+    if (refused != NULL) {
+        xSemaphoreGive(session_mutex);
+        log_write("[SESSION] Resume of %08lx refused: %s", id, refused);
+        tcp_send_locked(sock, &reply, sizeof(reply), 0);
+        return false;
+    }
+
+    esp_timer_stop(grace_timer);
+    reply.status = htonl(0);
+    tcp_send_locked(sock, &reply, sizeof(reply), 0);
+
+    uint32_t replayed = 0;
+    uint8_t pdu[sizeof(usbip_ret_submit)];
+    for (uint32_t pos = start; pos != head; ) {
+        replay_rec_t rec;
+        ring_get(pos, &rec, sizeof(rec));
+        if (rec.len <= sizeof(pdu)) {
+            ring_get(pos + sizeof(rec), pdu, rec.len);
+            if (tcp_send_locked(sock, pdu, rec.len, 0) < 0) {
+                break;
+            }
+            replayed++;
+        }
+        pos += sizeof(rec) + rec.len;
+    }
+
+    session_sock = sock;
+    state = USBIP_SESSION_ACTIVE;
+    resumes++;
+    xSemaphoreGive(session_mutex);
+
+    log_write("[SESSION] Session %08lx resumed, %lu response(s) replayed after seqnum %lu",
+              id, replayed, last_seqnum);
+    return true;
+}
+
+void usbip_session_get_status(usbip_session_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (ring == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(session_mutex, portMAX_DELAY);
+    out->state = state;
+    out->id = session_id;
+    out->buffered = count;
+    out->buffered_bytes = head - tail;
+    if (state == USBIP_SESSION_GRACE) {
+        int64_t left = grace_end_us - esp_timer_get_time();
+        out->grace_left_ms = left > 0 ? left / 1000 : 0;
+    }
+    out->suspends = suspends;
+    out->resumes = resumes;
+    out->expired = expired;
+    xSemaphoreGive(session_mutex);
+}
@@ -0,0 +1,215 @@
+#include "usbmon.h"
+#include "mem_policy.h"
+#include "mem_pressure.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_ENTRIES    CONFIG_USBMON_RING_ENTRIES
+#define DATA_BYTES      CONFIG_USBMON_DATA_BYTES
+
+/* Linux usbmon values (include/uapi/linux/usb/ch9.h, drivers/usb/mon) */
+#define MON_ISO         0
+#define MON_INTR        1
+#define MON_CTRL        2
+#define MON_BULK        3
+
+#define LNX_EINPROGRESS 115
+#define LNX_EPIPE       32
+#define LNX_EPROTO      71
+#define LNX_ETIMEDOUT   110
+#define LNX_ENOENT      2
+#define LNX_ENODEV      19
+#define LNX_EOVERFLOW   75
+#define LNX_EXDEV       18
+#define LNX_EIO         5
+
+/* struct usbmon_packet as read from /dev/usbmonN with the mmap API */
+typedef struct
+{
+    uint64_t id;
+    uint8_t type;
+    uint8_t xfer_type;
+    uint8_t epnum;
+    uint8_t devnum;
+    uint16_t busnum;
+    char flag_setup;
+    char flag_data;
+    int64_t ts_sec;
+    int32_t ts_usec;
+    int32_t status;
+    uint32_t length;
+    uint32_t len_cap;
+    uint8_t setup[8];
+    int32_t interval;
+    int32_t start_frame;
+    uint32_t xfer_flags;
+    uint32_t ndesc;
+} __attribute__((packed)) usbmon_packet_t;
+
+_Static_assert(sizeof(usbmon_packet_t) == 64, "usbmon header must be 64 bytes");
+
+typedef struct
+{
+    usbmon_packet_t hdr;
+    uint8_t data[DATA_BYTES];
+} usbmon_slot_t;
+
+static const char *TAG = "USBMON";
+
+static usbmon_slot_t *ring = NULL;
+static uint32_t head = 0;           // Monotonic count of recorded events
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t mon_xfer_type(uint8_t type)
+{
+    switch (type) {
+        case USB_TRANSFER_TYPE_CTRL:  return MON_CTRL;
+        case USB_TRANSFER_TYPE_ISOCHRONOUS:  return MON_ISO;
+        case USB_TRANSFER_TYPE_BULK:  return MON_BULK;
+        default:                      return MON_INTR;
+    }
+}
+
+static int32_t mon_status(usb_transfer_status_t status)
+{
+    switch (status) {
+        case USB_TRANSFER_STATUS_COMPLETED:  return 0;
+        case USB_TRANSFER_STATUS_STALL:      return -LNX_EPIPE;
+        case USB_TRANSFER_STATUS_TIMED_OUT:  return -LNX_ETIMEDOUT;
+        case USB_TRANSFER_STATUS_CANCELED:   return -LNX_ENOENT;
+        case USB_TRANSFER_STATUS_NO_DEVICE:  return -LNX_ENODEV;
+        case USB_TRANSFER_STATUS_OVERFLOW:   return -LNX_EOVERFLOW;
+        case USB_TRANSFER_STATUS_SKIPPED:    return -LNX_EXDEV;
+        default:                             return -LNX_EPROTO;
+    }
+}
+
+esp_err_t usbmon_init(void)
+{
+    ring = mem_calloc(MEM_USE_CAPTURE, RING_ENTRIES, sizeof(usbmon_slot_t));
+    if (ring == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d usbmon entries", RING_ENTRIES);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void usbmon_record(usbmon_event_t event, const usb_transfer_t *transfer, uint32_t urb_id,
+                   uint8_t xfer_type, uint8_t devnum)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (mem_pressure_tier() >= MEM_PRESSURE_QUIET) {
+        mem_pressure_note_drop(MEM_PRESSURE_DROP_CAPTURE);
+        return;
+    }
+
+    usbmon_slot_t slot;
+    usbmon_packet_t *h = &slot.hdr;
+    int64_t now = esp_timer_get_time();
+    bool ctrl = (xfer_type == USB_TRANSFER_TYPE_CTRL);
+    bool in = (transfer->bEndpointAddress & 0x80) != 0;
+
+    memset(h, 0, sizeof(*h));
+    h->id = urb_id;
+    h->type = event;
+    h->xfer_type = mon_xfer_type(xfer_type);
+    h->epnum = transfer->bEndpointAddress;
+    h->devnum = devnum;
+    h->busnum = 1;
+    h->ts_sec = now / 1000000;
+    h->ts_usec = now % 1000000;
+    h->xfer_flags = transfer->flags;
+    h->flag_setup = '-';
+
+    // Control transfers carry the setup packet in the first 8 bytes of the buffer
+    const uint8_t *data = transfer->data_buffer;
+    int len;
+    if (event == USBMON_COMPLETE) {
+        h->status = mon_status(transfer->status);
+        len = transfer->actual_num_bytes;
+    } else {
+        h->status = (event == USBMON_ERROR) ? -LNX_EIO : -LNX_EINPROGRESS;
+        len = transfer->num_bytes;
+    }
+    if (ctrl) {
+        if (event != USBMON_COMPLETE) {
+            h->flag_setup = 0;
+            memcpy(h->setup, data, sizeof(h->setup));
+        }
+        data += sizeof(usb_setup_packet_t);
+        len = (len > (int)sizeof(usb_setup_packet_t)) ? len - sizeof(usb_setup_packet_t) : 0;
+    }
+    h->length = len;
+
+    // Data travels with the submit for OUT and with the completion for IN
+    bool has_data = (event == USBMON_COMPLETE) ? in : !in;
+    if (has_data && len > 0) {
+        h->len_cap = (len < DATA_BYTES) ? len : DATA_BYTES;
+        memcpy(slot.data, data, h->len_cap);
+    } else {
+        h->flag_data = in ? '<' : '>';
+    }
+
+    portENTER_CRITICAL(&ring_lock);
+    memcpy(&ring[head % RING_ENTRIES], &slot, sizeof(usbmon_packet_t) + h->len_cap);
+    head++;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+esp_err_t usbmon_export(pcapng_write_fn write, void *ctx)
+{
+    if (ring == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pcapng_writer_t *w = mem_alloc(MEM_USE_CAPTURE, sizeof(pcapng_writer_t));
+    usbmon_slot_t *slot = mem_alloc(MEM_USE_CAPTURE, sizeof(usbmon_slot_t));
+    if (w == NULL || slot == NULL) {
+        mem_free(MEM_USE_CAPTURE, w);
+        mem_free(MEM_USE_CAPTURE, slot);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pcapng_begin(w, write, ctx);
+    pcapng_add_interface(w, PCAPNG_LINKTYPE_USB_LINUX_MMAPPED, sizeof(usbmon_packet_t) + DATA_BYTES, "usbmon1");
+
+    portENTER_CRITICAL(&ring_lock);
+    uint32_t end = head;
+    portEXIT_CRITICAL(&ring_lock);
+    uint32_t pos = (end > RING_ENTRIES) ? end - RING_ENTRIES : 0;
+
+    // Copy one slot at a time so recording continues while the file is sent
+    for (; pos != end && w->err == ESP_OK; pos++) {
+        portENTER_CRITICAL(&ring_lock);
+        bool lost = (head - pos) > RING_ENTRIES;
+        if (!lost) {
+            memcpy(slot, &ring[pos % RING_ENTRIES], sizeof(usbmon_slot_t));
+        }
+        portEXIT_CRITICAL(&ring_lock);
+        if (lost) {
+            continue;           // Overwritten while we were sending
+        }
+
+        const usbmon_packet_t *h = &slot->hdr;
+        uint64_t ts_us = (uint64_t)h->ts_sec * 1000000 + h->ts_usec;
+        uint32_t orig_len = sizeof(usbmon_packet_t) + (h->flag_data == 0 ? h->length : 0);
+        pcapng_add_packet(w, 0, ts_us, h, sizeof(*h), slot->data, h->len_cap, orig_len);
+    }
+
+    esp_err_t err = pcapng_end(w);
+    mem_free(MEM_USE_CAPTURE, slot);
+    mem_free(MEM_USE_CAPTURE, w);
+    return err;
+}
+
+void usbmon_clear(void)
+{
+    portENTER_CRITICAL(&ring_lock);
+    head = 0;
+    portEXIT_CRITICAL(&ring_lock);
+}
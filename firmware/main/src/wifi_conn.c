@@ -0,0 +1,124 @@
+#include "wifi_conn.h"
+#include <string.h>
+
+static uint32_t elapsed_ms(const wifi_ops_t *ops, int64_t since)
+{
+    return (uint32_t)((ops->now_us(ops->ctx) - since) / 1000);
+}
+
+static bool same_link(const wifi_cache_t *a, const wifi_cache_t *b)
+{
+    return memcmp(a->bssid, b->bssid, sizeof(a->bssid)) == 0 && a->channel == b->channel &&
+           memcmp(&a->ip, &b->ip, sizeof(a->ip)) == 0;
+}
+
+/* One association attempt; the link is torn down again if it fails */
+static esp_err_t attempt(const wifi_ops_t *ops, const uint8_t *bssid, uint8_t channel,
+                         const wifi_ip_config_t *ip, uint32_t timeout_ms, wifi_cache_t *link)
+{
+    esp_err_t err = ops->set_target(ops->ctx, bssid, channel);
+    if (err == ESP_OK) {
+        err = ops->set_ip(ops->ctx, ip);
+    }
+    if (err == ESP_OK) {
+        err = ops->connect(ops->ctx);
+    }
+    if (err == ESP_OK) {
+        err = ops->wait(ops->ctx, timeout_ms, link);
+    }
+    if (err != ESP_OK) {
+        ops->disconnect(ops->ctx);
+    }
+    return err;
+}
+
+esp_err_t wifi_conn_run(const wifi_ops_t *ops, const wifi_conn_params_t *params,
+                        wifi_cache_t *cache, wifi_conn_result_t *res)
+{
+    int64_t start = ops->now_us(ops->ctx);
+    const wifi_ip_config_t *static_ip = params->static_ip.ip ? &params->static_ip : NULL;
+    esp_err_t err = ESP_FAIL;
+
+    memset(res, 0, sizeof(*res));
+
+    if (cache->channel != 0) {
+        const wifi_ip_config_t *ip = static_ip;
+        if (ip == NULL && params->reuse_lease && cache->ip.ip != 0) {
+            ip = &cache->ip;
+        }
+        err = attempt(ops, cache->bssid, cache->channel, ip, params->fast_timeout_ms, &res->link);
+        res->fast_ms = elapsed_ms(ops, start);
+        res->fast_err = err;
+        if (err == ESP_OK) {
+            res->path = WIFI_PATH_FAST;
+        }
+    }
+
+    while (err != ESP_OK && res->scan_attempts < params->scan_attempts) {
+        res->scan_attempts++;
+        err = attempt(ops, NULL, 0, static_ip, params->scan_timeout_ms, &res->link);
+        if (err == ESP_OK) {
+            res->path = WIFI_PATH_SCAN;
+        }
+    }
+
+    res->total_ms = elapsed_ms(ops, start);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // A reused lease comes back unchanged, so only a real DHCP result refreshes it
+    if (!same_link(&res->link, cache)) {
+        *cache = res->link;
+        ops->cache_store(ops->ctx, cache);
+        res->cache_updated = true;
+    }
+    return ESP_OK;
+}
+
+uint32_t wifi_conn_backoff_ms(const wifi_conn_params_t *params, uint32_t failed)
+{
+    uint32_t delay = params->retry_delay_ms;
+    while (failed-- > 1 && delay < params->retry_max_delay_ms) {
+        delay *= 2;
+    }
+    return delay < params->retry_max_delay_ms ? delay : params->retry_max_delay_ms;
+}
+
+esp_err_t wifi_conn_until_up(const wifi_ops_t *ops, const wifi_conn_params_t *params,
+                             wifi_cache_t *cache, wifi_conn_result_t *res,
+                             void (*on_retry)(const wifi_conn_result_t *res, uint32_t delay_ms))
+{
+    int64_t start = ops->now_us(ops->ctx);
+    uint32_t failed = 0;
+    uint32_t slept = 0;
+    esp_err_t err;
+
+    while ((err = wifi_conn_run(ops, params, cache, res)) != ESP_OK) {
+        failed++;
+        if (params->max_rounds != 0 && failed >= params->max_rounds) {
+            break;
+        }
+        uint32_t delay = wifi_conn_backoff_ms(params, failed);
+        if (on_retry != NULL) {
+            res->retries = failed;
+            on_retry(res, delay);
+        }
+        ops->sleep_ms(ops->ctx, delay);
+        slept += delay;
+    }
+
+    res->retries = failed;
+    res->backoff_ms = slept;
+    res->total_ms = elapsed_ms(ops, start);
+    return err;
+}
+
+const char *wifi_conn_path_name(wifi_conn_path_t path)
+{
+    switch (path) {
+        case WIFI_PATH_FAST: return "fast";
+        case WIFI_PATH_SCAN: return "scan";
+        default:             return "none";
+    }
+}
@@ -0,0 +1,347 @@
+#include "wifi_manager.h"
+#include "log_handler.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define NVS_NAMESPACE       "wifi_mgr"
+#define NVS_KEY             "cache"
+#define CACHE_VERSION       1
+
+#define BIT_GOT_IP          BIT0    // Address assigned during an attempt
+#define BIT_FAILED          BIT1    // Disconnected during an attempt
+#define BIT_UP              BIT2    // Link established
+#define BIT_LOST            BIT3    // Established link dropped
+
+#define RETRY_DELAY_MS      1000    // Backoff after a failed round, doubled per failure
+#define RETRY_MAX_DELAY_MS  8000
+
+/* NVS record; the cache is dropped when the configured SSID changes */
+typedef struct
+{
+    uint8_t version;
+    char ssid[33];
+    wifi_cache_t cache;
+} cache_blob_t;
+
+static esp_netif_t *sta_netif = NULL;
+static EventGroupHandle_t wifi_events = NULL;
+static wifi_cache_t cache;          // Last good link, mirrors NVS
+static wifi_cache_t link;           // Filled in by the event handlers during an attempt
+static wifi_conn_params_t params;
+static wifi_manager_stats_t stats;
+static volatile bool forget_pending = false;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t *ev = data;
+        memcpy(link.bssid, ev->bssid, sizeof(link.bssid));
+        link.channel = ev->channel;
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *ev = data;
+        // Our own esp_wifi_disconnect() after a failed attempt
+        if (ev->reason == WIFI_REASON_ASSOC_LEAVE) {
+            return;
+        }
+        if (xEventGroupClearBits(wifi_events, BIT_UP) & BIT_UP) {
+            log_write("[WIFI] Disconnected (reason %d)", ev->reason);
+            xEventGroupSetBits(wifi_events, BIT_LOST);
+        } else {
+            xEventGroupSetBits(wifi_events, BIT_FAILED);
+        }
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *ev = data;
+        esp_netif_dns_info_t dns;
+        link.ip.ip = ev->ip_info.ip.addr;
+        link.ip.netmask = ev->ip_info.netmask.addr;
+        link.ip.gw = ev->ip_info.gw.addr;
+        link.ip.dns = 0;
+        if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+            link.ip.dns = dns.ip.u_addr.ip4.addr;
+        }
+        xEventGroupSetBits(wifi_events, BIT_GOT_IP);
+    }
+}
+
+/* wifi_ops_t on top of esp_wifi, esp_netif and NVS */
+
+static esp_err_t esp_set_target(void *ctx, const uint8_t *bssid, uint8_t channel)
+{
+    wifi_config_t cfg = {0};
+    strlcpy((char *)cfg.sta.ssid, CONFIG_USB_REPEATER_WIFI_SSID, sizeof(cfg.sta.ssid));
+    strlcpy((char *)cfg.sta.password, CONFIG_USB_REPEATER_WIFI_PASSWORD, sizeof(cfg.sta.password));
+    cfg.sta.threshold.authmode = cfg.sta.password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    if (bssid != NULL) {
+        // Probe a single channel for a single AP
+        cfg.sta.scan_method = WIFI_FAST_SCAN;
+        cfg.sta.bssid_set = true;
+        memcpy(cfg.sta.bssid, bssid, sizeof(cfg.sta.bssid));
+        cfg.sta.channel = channel;
+    } else {
+        cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        cfg.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    return esp_wifi_set_config(WIFI_IF_STA, &cfg);
+}
+
+static esp_err_t esp_set_ip(void *ctx, const wifi_ip_config_t *ip)
+{
+    if (ip == NULL) {
+        esp_err_t err = esp_netif_dhcpc_start(sta_netif);
+        return (err == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) ? ESP_OK : err;
+    }
+
+    esp_err_t err = esp_netif_dhcpc_stop(sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        return err;
+    }
+    esp_netif_ip_info_t info = {
+        .ip.addr = ip->ip,
+        .netmask.addr = ip->netmask,
+        .gw.addr = ip->gw,
+    };
+    err = esp_netif_set_ip_info(sta_netif, &info);
+    if (err == ESP_OK && ip->dns != 0) {
+        esp_netif_dns_info_t dns = {0};
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        dns.ip.u_addr.ip4.addr = ip->dns;
+        err = esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    return err;
+}
+
+static esp_err_t esp_connect(void *ctx)
+{
+    memset(&link, 0, sizeof(link));
+    xEventGroupClearBits(wifi_events, BIT_GOT_IP | BIT_FAILED);
+    return esp_wifi_connect();
+}
+
+static esp_err_t esp_wait(void *ctx, uint32_t timeout_ms, wifi_cache_t *out)
+{
+    EventBits_t bits = xEventGroupWaitBits(wifi_events, BIT_GOT_IP | BIT_FAILED,
+                                           pdTRUE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    if (bits & BIT_GOT_IP) {
+        *out = link;
+        return ESP_OK;
+    }
+    return (bits & BIT_FAILED) ? ESP_FAIL : ESP_ERR_TIMEOUT;
+}
+
+static void esp_disconnect(void *ctx)
+{
+    esp_wifi_disconnect();
+}
+
+static void esp_cache_store(void *ctx, const wifi_cache_t *c)
+{
+    cache_blob_t blob = {0};
+    blob.version = CACHE_VERSION;
+    strlcpy(blob.ssid, CONFIG_USB_REPEATER_WIFI_SSID, sizeof(blob.ssid));
+    blob.cache = *c;
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, NVS_KEY, &blob, sizeof(blob)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static int64_t esp_now_us(void *ctx)
+{
+    return esp_timer_get_time();
+}
+
+static void esp_sleep_ms(void *ctx, uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+static const wifi_ops_t esp_ops = {
+    .set_target  = esp_set_target,
+    .set_ip      = esp_set_ip,
+    .connect     = esp_connect,
+    .wait        = esp_wait,
+    .disconnect  = esp_disconnect,
+    .cache_store = esp_cache_store,
+    .now_us      = esp_now_us,
+    .sleep_ms    = esp_sleep_ms,
+    .ctx         = NULL,
+};
+
+static void cache_load(void)
+{
+    cache_blob_t blob;
+    size_t len = sizeof(blob);
+    nvs_handle_t nvs;
+
+    memset(&cache, 0, sizeof(cache));
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, NVS_KEY, &blob, &len) == ESP_OK && len == sizeof(blob) &&
+        blob.version == CACHE_VERSION && strcmp(blob.ssid, CONFIG_USB_REPEATER_WIFI_SSID) == 0) {
+        cache = blob.cache;
+    }
+    nvs_close(nvs);
+}
+
+/* Fills params from Kconfig; the static address is optional */
+static void params_load(void)
+{
+    memset(&params, 0, sizeof(params));
+#ifdef CONFIG_WIFI_REUSE_LEASE
+    params.reuse_lease = true;
+#endif
+    params.fast_timeout_ms = CONFIG_WIFI_FAST_CONNECT_TIMEOUT_MS;
+    params.scan_timeout_ms = CONFIG_WIFI_SCAN_CONNECT_TIMEOUT_MS;
+    params.scan_attempts = CONFIG_USB_REPEATER_WIFI_MAX_RETRY;
+    params.retry_delay_ms = RETRY_DELAY_MS;
+    params.retry_max_delay_ms = RETRY_MAX_DELAY_MS;
+
+    if (CONFIG_WIFI_STATIC_IP[0] != '\0') {
+        params.static_ip.ip = esp_ip4addr_aton(CONFIG_WIFI_STATIC_IP);
+        params.static_ip.netmask = esp_ip4addr_aton(CONFIG_WIFI_STATIC_NETMASK);
+        params.static_ip.gw = esp_ip4addr_aton(CONFIG_WIFI_STATIC_GATEWAY);
+        if (CONFIG_WIFI_STATIC_DNS[0] != '\0') {
+            params.static_ip.dns = esp_ip4addr_aton(CONFIG_WIFI_STATIC_DNS);
+        }
+    }
+}
+
+static void log_retry(const wifi_conn_result_t *res, uint32_t delay_ms)
+{
+    log_write("[WIFI] Connection failed after %lu ms (%u scan(s)), retrying in %lu ms",
+              res->total_ms, res->scan_attempts, delay_ms);
+}
+
+/* Connects, retrying until it works; returns the time taken */
+static uint32_t connect_until_up(void)
+{
+    wifi_conn_result_t res;
+    int64_t start = esp_timer_get_time();
+
+    if (forget_pending) {
+        forget_pending = false;
+        memset(&cache, 0, sizeof(cache));
+    }
+    wifi_conn_until_up(&esp_ops, &params, &cache, &res, log_retry);
+    xEventGroupSetBits(wifi_events, BIT_UP);
+
+    if (res.fast_ms != 0 && res.path == WIFI_PATH_SCAN) {
+        log_write("[WIFI] Cached AP %02x:%02x:%02x:%02x:%02x:%02x failed after %lu ms (%s)",
+                  cache.bssid[0], cache.bssid[1], cache.bssid[2],
+                  cache.bssid[3], cache.bssid[4], cache.bssid[5],
+                  res.fast_ms, esp_err_to_name(res.fast_err));
+    }
+    log_write("[WIFI] Connected via %s in %lu ms after %lu retries: ch %u, " IPSTR "%s",
+              wifi_conn_path_name(res.path), res.total_ms, res.retries, res.link.channel,
+              IP2STR((esp_ip4_addr_t *)&res.link.ip.ip),
+              res.cache_updated ? " (cache updated)" : "");
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.connects++;
+    if (res.path == WIFI_PATH_FAST) {
+        stats.fast_hits++;
+    } else {
+        stats.scan_fallbacks++;
+    }
+    stats.last = res;
+    portEXIT_CRITICAL(&stats_lock);
+
+    return (uint32_t)((esp_timer_get_time() - start) / 1000);
+}
+
+static void wifi_manager_task(void *arg)
+{
+    while (1) {
+        xEventGroupWaitBits(wifi_events, BIT_LOST, pdTRUE, pdFALSE, portMAX_DELAY);
+        int64_t lost_at = esp_timer_get_time();
+
+        connect_until_up();
+
+        uint32_t ms = (uint32_t)((esp_timer_get_time() - lost_at) / 1000);
+        log_write("[WIFI] Reconnected %lu ms after link loss", ms);
+        portENTER_CRITICAL(&stats_lock);
+        stats.reconnects++;
+        stats.last_reconnect_ms = ms;
+        if (ms > stats.max_reconnect_ms) {
+            stats.max_reconnect_ms = ms;
+        }
+        portEXIT_CRITICAL(&stats_lock);
+    }
+}
+
+esp_err_t wifi_manager_start(void)
+{
+    wifi_events = xEventGroupCreate();
+    if (wifi_events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_err_t err = esp_wifi_init(&init_cfg);
+    if (err != ESP_OK) {
+        log_write_err("[WIFI] ERROR: esp_wifi_init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, event_handler, NULL, NULL);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, event_handler, NULL, NULL);
+
+    // The AP cache lives in our own NVS record; skip the driver's flash writes on every set_config
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    err = esp_wifi_start();
+    if (err != ESP_OK) {
+        log_write_err("[WIFI] ERROR: esp_wifi_start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    params_load();
+    cache_load();
+    if (cache.channel != 0) {
+        log_write("[WIFI] Cached AP on channel %u, trying it first", cache.channel);
+    }
+
+    uint32_t ms = connect_until_up();
+    portENTER_CRITICAL(&stats_lock);
+    stats.first_connect_ms = ms;
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (xTaskCreate(wifi_manager_task, "wifi_mgr", 4096, NULL, 5, NULL) != pdPASS) {
+        log_write_err("[WIFI] ERROR: Failed to create reconnect task");
+    }
+    return ESP_OK;
+}
+
+void wifi_manager_get_stats(wifi_manager_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void wifi_manager_forget(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    // The RAM copy belongs to whoever is connecting; drop it before the next attempt
+    forget_pending = true;
+    log_write("[WIFI] AP cache erased");
+}
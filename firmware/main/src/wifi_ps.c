@@ -0,0 +1,137 @@
+#include "wifi_ps.h"
+#include "global.h"
+#include "log_handler.h"
+#include "boot_timeline.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define POLL_MS             250         // Detach is noticed within this time
+#define TURNAROUND_MAX_US   1000000     // Longer gaps are the host being idle, not latency
+
+#ifdef CONFIG_WIFI_PS_IDLE_MAX_MODEM
+#define IDLE_MODE WIFI_PS_MAX_MODEM
+#else
+#define IDLE_MODE WIFI_PS_MIN_MODEM
+#endif
+
+static const char *TAG = "WIFI_PS";
+
+static TaskHandle_t ps_task = NULL;
+static volatile wifi_ps_type_t cur_mode = IDLE_MODE;
+static volatile uint32_t last_activity_us = 0;
+static volatile uint32_t last_sent_us = 0;     // 0: no RET_SUBMIT since the last sample
+static int64_t mode_since_us = 0;
+static wifi_ps_mode_stats_t mode_stats[WIFI_PS_NUM_MODES];
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t now_us32(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static void set_mode(wifi_ps_type_t mode)
+{
+    esp_err_t err = esp_wifi_set_ps(mode);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_set_ps(%s) failed: %s", wifi_ps_mode_name(mode), esp_err_to_name(err));
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    mode_stats[cur_mode].time_us += now - mode_since_us;
+    mode_stats[mode].entries++;
+    mode_since_us = now;
+    cur_mode = mode;
+    portEXIT_CRITICAL(&stats_lock);
+    ESP_LOGD(TAG, "Power save -> %s", wifi_ps_mode_name(mode));
+}
+
+static void wifi_ps_task(void *arg)
+{
+    // esp_wifi_set_ps() needs a started driver
+    boot_timeline_wait(BOOT_BIT(BOOT_EV_WIFI_CONNECTED), portMAX_DELAY);
+    mode_since_us = esp_timer_get_time();
+    cur_mode = WIFI_PS_NONE;    // Forces the first set_mode() below
+    set_mode(IDLE_MODE);
+    log_write("[WIFI_PS] Controller running: %s when idle for %d ms, %s while URBs flow",
+              wifi_ps_mode_name(IDLE_MODE), CONFIG_WIFI_PS_IDLE_MS, wifi_ps_mode_name(WIFI_PS_NONE));
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POLL_MS));
+
+        uint32_t idle_us = now_us32() - last_activity_us;
+        bool active = device_busy && idle_us < CONFIG_WIFI_PS_IDLE_MS * 1000U;
+        wifi_ps_type_t want = active ? WIFI_PS_NONE : IDLE_MODE;
+        if (want != cur_mode) {
+            set_mode(want);
+        }
+    }
+}
+
+esp_err_t wifi_ps_init(void)
+{
+    if (xTaskCreate(wifi_ps_task, "wifi_ps", 3072, NULL, 6, &ps_task) != pdPASS) {
+        log_write_err("[WIFI_PS] ERROR: Failed to create controller task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void wifi_ps_urb_received(void)
+{
+    uint32_t now = now_us32();
+    uint32_t sent = last_sent_us;
+    wifi_ps_type_t mode = cur_mode;
+
+    if (sent != 0) {
+        uint32_t turnaround = now - sent;
+        last_sent_us = 0;
+        if (turnaround < TURNAROUND_MAX_US) {
+            portENTER_CRITICAL(&stats_lock);
+            wifi_ps_mode_stats_t *st = &mode_stats[mode];
+            st->samples++;
+            st->sum_us += turnaround;
+            if (turnaround > st->max_us) {
+                st->max_us = turnaround;
+            }
+            portEXIT_CRITICAL(&stats_lock);
+        }
+    }
+
+    last_activity_us = now;
+    if (mode != WIFI_PS_NONE && ps_task != NULL) {
+        xTaskNotifyGive(ps_task);
+    }
+}
+
+void wifi_ps_urb_sent(void)
+{
+    uint32_t now = now_us32();
+    last_sent_us = now ? now : 1;
+}
+
+void wifi_ps_get_stats(wifi_ps_stats_t *out)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    memcpy(out->mode, mode_stats, sizeof(out->mode));
+    out->current = cur_mode;
+    if (mode_since_us != 0) {
+        out->mode[cur_mode].time_us += now - mode_since_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+const char *wifi_ps_mode_name(wifi_ps_type_t mode)
+{
+    switch (mode) {
+        case WIFI_PS_NONE:      return "none";
+        case WIFI_PS_MIN_MODEM: return "min_modem";
+        case WIFI_PS_MAX_MODEM: return "max_modem";
+        default:                return "?";
+    }
+}
@@ -0,0 +1,139 @@
+#include "usbip_codec.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+/*
+ * Header handling cost of one URB, submit to RET_SUBMIT, in two styles:
+ *
+ *  legacy  fields stay in wire order in the packed structs and every use
+ *          converts again, as usb_handler did before the codec
+ *  codec   one decode off the socket, plain fields in between, one encode
+ *
+ * Both variants hand the same values to the same number of consume() calls,
+ * which stand in for the ledger, flight recorder, usbmon and send paths.
+ * Not a test; run by hand. Host numbers only show the relative cost, the
+ * ESP32-S2 has no byte-swap instruction so each conversion costs more there.
+ */
+
+#define ITERATIONS  20000000
+#define RUNS        5
+
+static volatile uint32_t sink;
+
+static void __attribute__((noinline)) consume(uint32_t v)
+{
+    sink += v;
+}
+
+static usbip_header_basic header;
+static usbip_cmd_submit cmd;
+static usbip_ret_submit ret_wire;
+
+static void __attribute__((noinline)) legacy_urb(uint32_t actual)
+{
+    // Dispatch
+    uint32_t ep = ntohl(header.ep) & 0x0F;
+    consume(ntohl(header.seqnum));
+    consume(ep);
+    consume(ntohl(cmd.transfer_buffer_length));
+    consume(ntohl(header.direction));
+    consume(ntohl(cmd.transfer_flags) & USBIP_URB_ZERO_PACKET);
+
+    // RET_SUBMIT prepared from the request
+    ret_wire.base.command = htonl(USBIP_RET_SUBMIT);
+    ret_wire.base.seqnum = header.seqnum;
+    ret_wire.base.devid = header.devid;
+    ret_wire.base.direction = 0;
+    ret_wire.base.ep = header.ep;
+    ret_wire.status = htonl(0);
+    ret_wire.start_frame = htonl(0);
+    ret_wire.number_of_packets = htonl(0);
+    ret_wire.error_count = htonl(0);
+    memset(ret_wire.padding, 0, sizeof(ret_wire.padding));
+    consume(ntohl(cmd.transfer_buffer_length));
+
+    // Completion
+    consume(ntohl(ret_wire.base.seqnum));
+    consume(ntohl(ret_wire.base.seqnum));
+    consume(ntohl(ret_wire.base.seqnum));
+    ret_wire.status = htonl(0);
+    ret_wire.actual_length = htonl(actual);
+    consume(ntohl(header.direction) != 0 ? ntohl(ret_wire.actual_length) : 0);
+    consume(ntohl(ret_wire.base.seqnum));
+    consume(ntohl(ret_wire.base.seqnum));
+    consume(ntohl(ret_wire.base.ep));
+    consume(ntohl(ret_wire.base.seqnum));
+}
+
+static void __attribute__((noinline)) codec_urb(uint32_t actual)
+{
+    usbip_submit_desc_t d;
+    usbip_ret_desc_t r;
+
+    // Dispatch
+    usbip_decode_cmd_submit(&header, &cmd, &d);
+    consume(d.seqnum);
+    consume(d.ep & 0x0F);
+    consume(d.transfer_buffer_length);
+    consume(d.direction);
+    consume(d.transfer_flags & USBIP_URB_ZERO_PACKET);
+
+    // RET_SUBMIT prepared from the request
+    usbip_ret_desc_init(&d, &r);
+    consume(d.transfer_buffer_length);
+
+    // Completion
+    consume(r.seqnum);
+    consume(r.seqnum);
+    consume(r.seqnum);
+    r.status = 0;
+    r.actual_length = actual;
+    consume(d.direction != 0 ? r.actual_length : 0);
+    usbip_encode_ret_submit(&r, &ret_wire);
+    consume(r.seqnum);
+    consume(r.seqnum);
+    consume(r.ep);
+    consume(r.seqnum);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double best_ns_per_urb(void (*urb)(uint32_t))
+{
+    double best = 1e9;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_s();
+        for (uint32_t i = 0; i < ITERATIONS; i++) {
+            urb(i & 0x3f);
+        }
+        double ns = (now_s() - start) * 1e9 / ITERATIONS;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int main(void)
+{
+    header.command = htonl(USBIP_CMD_SUBMIT);
+    header.seqnum = htonl(0x01020304);
+    header.devid = htonl(0x00010002);
+    header.direction = htonl(1);
+    header.ep = htonl(1);
+    cmd.transfer_buffer_length = htonl(64);
+
+    double legacy = best_ns_per_urb(legacy_urb);
+    double codec = best_ns_per_urb(codec_urb);
+    printf("legacy (convert on every use): %6.2f ns/URB\n", legacy);
+    printf("codec (decode once, encode once): %6.2f ns/URB\n", codec);
+    printf("ratio: %.2fx\n", legacy / codec);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef __ESP_ERR_H__
+#define __ESP_ERR_H__
+
+/* Host stand-in for the subset of esp_err.h the portable modules use */
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_TIMEOUT         0x107
+
+#endif // __ESP_ERR_H__
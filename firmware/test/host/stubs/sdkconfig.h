@@ -0,0 +1,7 @@
+#ifndef __SDKCONFIG_H__
+#define __SDKCONFIG_H__
+
+/* The general device profile */
+#define CONFIG_USBIP_MAX_TRANSFER_SIZE 1024
+
+#endif // __SDKCONFIG_H__
@@ -0,0 +1,19 @@
+#ifndef __USB_HOST_H__
+#define __USB_HOST_H__
+
+/* Host stand-in for the USB host library: only the setup packet layout */
+
+#include <stdint.h>
+
+typedef union {
+    struct {
+        uint8_t bmRequestType;
+        uint8_t bRequest;
+        uint16_t wValue;
+        uint16_t wIndex;
+        uint16_t wLength;
+    } __attribute__((packed));
+    uint8_t val[8];
+} usb_setup_packet_t;
+
+#endif // __USB_HOST_H__
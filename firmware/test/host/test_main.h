@@ -0,0 +1,27 @@
+#ifndef __TEST_MAIN_H__
+#define __TEST_MAIN_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Minimal assertion helpers; each test binary exits non-zero on the first failure */
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %lld, expected %lld\n", \
+                __FILE__, __LINE__, #a, _a, _b); \
+        exit(1); \
+    } \
+} while (0)
+
+#define RUN(test) do { test(); printf("PASS %s\n", #test); } while (0)
+
+#endif // __TEST_MAIN_H__
@@ -0,0 +1,171 @@
+#include "usbip_codec.h"
+#include "test_main.h"
+#include <string.h>
+
+/*
+ * usbip_codec against hand-written wire bytes, so byte order is checked
+ * independently of the htonl()/ntohl() the codec itself uses.
+ */
+
+/* GET_DESCRIPTOR(DEVICE) on EP0 IN, seqnum 0x01020304, devid 0x00010002 */
+static const uint8_t get_desc_in[] = {
+    0x00, 0x00, 0x00, 0x01,     // command: CMD_SUBMIT
+    0x01, 0x02, 0x03, 0x04,     // seqnum
+    0x00, 0x01, 0x00, 0x02,     // devid
+    0x00, 0x00, 0x00, 0x01,     // direction: IN
+    0x00, 0x00, 0x00, 0x00,     // ep
+    0x00, 0x00, 0x02, 0x00,     // transfer_flags: URB_DIR_IN
+    0x00, 0x00, 0x00, 0x12,     // transfer_buffer_length: 18
+    0xff, 0xff, 0xff, 0xff,     // start_frame: -1
+    0x00, 0x00, 0x00, 0x00,     // number_of_packets
+    0x00, 0x00, 0x00, 0x0a,     // interval
+    0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x12, 0x00,     // setup, little-endian
+};
+
+/* 64-byte bulk OUT on EP2 with URB_ZERO_PACKET */
+static const uint8_t bulk_out[] = {
+    0x00, 0x00, 0x00, 0x01,
+    0xde, 0xad, 0xbe, 0xef,
+    0x00, 0x01, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00,     // direction: OUT
+    0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x40,     // transfer_flags: URB_ZERO_PACKET
+    0x00, 0x00, 0x00, 0x40,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static void decode(const uint8_t *raw, usbip_submit_desc_t *out)
+{
+    usbip_header_basic header;
+    usbip_cmd_submit cmd;
+    memcpy(&header, raw, sizeof(header));
+    memcpy(&cmd, raw + sizeof(header), sizeof(cmd));
+    usbip_decode_cmd_submit(&header, &cmd, out);
+}
+
+static void test_wire_sizes(void)
+{
+    CHECK_EQ(sizeof(usbip_header_basic), 20);
+    CHECK_EQ(sizeof(usbip_cmd_submit), 28);
+    CHECK_EQ(sizeof(get_desc_in), sizeof(usbip_header_basic) + sizeof(usbip_cmd_submit));
+    CHECK_EQ(USBIP_RET_SUBMIT_HEADER_SIZE, 48);
+    CHECK_EQ(sizeof(usbip_ret_submit), 48 + USBIP_MAX_TRANSFER_SIZE);
+}
+
+static void test_decode_byte_order(void)
+{
+    usbip_submit_desc_t d;
+    decode(get_desc_in, &d);
+    CHECK_EQ(d.seqnum, 0x01020304);
+    CHECK_EQ(d.devid, 0x00010002);
+    CHECK_EQ(d.direction, 1);
+    CHECK_EQ(d.ep, 0);
+    CHECK_EQ(d.transfer_flags, 0x200);
+    CHECK_EQ(d.transfer_buffer_length, 18);
+    CHECK_EQ(d.start_frame, -1);
+    CHECK_EQ(d.number_of_packets, 0);
+    CHECK_EQ(d.interval, 10);
+
+    decode(bulk_out, &d);
+    CHECK_EQ(d.seqnum, 0xdeadbeef);
+    CHECK_EQ(d.direction, 0);
+    CHECK_EQ(d.ep, 2);
+    CHECK_EQ(d.transfer_flags & USBIP_URB_ZERO_PACKET, USBIP_URB_ZERO_PACKET);
+    CHECK_EQ(d.transfer_buffer_length, 64);
+}
+
+/* The setup packet is already little-endian on the wire and must not be swapped */
+static void test_setup_passthrough(void)
+{
+    usbip_submit_desc_t d;
+    decode(get_desc_in, &d);
+    CHECK(memcmp(d.setup.val, get_desc_in + 40, 8) == 0);
+    CHECK_EQ(d.setup.bmRequestType, 0x80);
+    CHECK_EQ(d.setup.bRequest, 0x06);
+    const uint8_t *w = d.setup.val;
+    CHECK_EQ(w[2] | (w[3] << 8), 0x0100);      // wValue: DEVICE descriptor
+    CHECK_EQ(w[6] | (w[7] << 8), 18);          // wLength
+}
+
+static void test_ret_init_echoes_request(void)
+{
+    usbip_submit_desc_t d;
+    usbip_ret_desc_t r;
+    decode(get_desc_in, &d);
+    memset(&r, 0x5a, sizeof(r));
+    usbip_ret_desc_init(&d, &r);
+    CHECK_EQ(r.seqnum, d.seqnum);
+    CHECK_EQ(r.devid, d.devid);
+    CHECK_EQ(r.ep, d.ep);
+    CHECK_EQ(r.status, 0);
+    CHECK_EQ(r.actual_length, 0);
+    CHECK_EQ(r.start_frame, -1);
+    CHECK_EQ(r.number_of_packets, 0);
+    CHECK_EQ(r.error_count, 0);
+}
+
+static usbip_ret_submit wire;
+
+static void test_encode_in_completion(void)
+{
+    usbip_submit_desc_t d;
+    usbip_ret_desc_t r;
+    decode(get_desc_in, &d);
+    usbip_ret_desc_init(&d, &r);
+    r.actual_length = 18;
+
+    memset(&wire, 0xaa, sizeof(wire));
+    usbip_encode_ret_submit(&r, &wire);
+
+    static const uint8_t expect[48] = {
+        0x00, 0x00, 0x00, 0x03,     // command: RET_SUBMIT
+        0x01, 0x02, 0x03, 0x04,     // seqnum echoed
+        0x00, 0x01, 0x00, 0x02,     // devid echoed
+        0x00, 0x00, 0x00, 0x00,     // direction is always 0 in a reply
+        0x00, 0x00, 0x00, 0x00,     // ep echoed
+        0x00, 0x00, 0x00, 0x00,     // status
+        0x00, 0x00, 0x00, 0x12,     // actual_length
+        0xff, 0xff, 0xff, 0xff,     // start_frame echoed
+        0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+        0, 0, 0, 0, 0, 0, 0, 0,     // padding
+    };
+    CHECK(memcmp(&wire, expect, sizeof(expect)) == 0);
+    CHECK_EQ(wire.transfer_buffer[0], 0xaa);   // Data is the caller's
+}
+
+static void test_encode_out_error(void)
+{
+    usbip_submit_desc_t d;
+    usbip_ret_desc_t r;
+    decode(bulk_out, &d);
+    usbip_ret_desc_init(&d, &r);
+    r.status = -USBIP_EPIPE;
+
+    memset(&wire, 0xaa, sizeof(wire));
+    usbip_encode_ret_submit(&r, &wire);
+
+    const uint8_t *b = (const uint8_t *)&wire;
+    static const uint8_t seq[] = {0xde, 0xad, 0xbe, 0xef};
+    static const uint8_t ep[] = {0x00, 0x00, 0x00, 0x02};
+    static const uint8_t status[] = {0xff, 0xff, 0xff, 0xe0};     // -32
+    CHECK(memcmp(b + 4, seq, 4) == 0);
+    CHECK(memcmp(b + 16, ep, 4) == 0);
+    CHECK(memcmp(b + 20, status, 4) == 0);
+    CHECK_EQ(b[12] | b[13] | b[14] | b[15], 0);
+    CHECK_EQ(b[24] | b[25] | b[26] | b[27], 0);     // Nothing transferred
+}
+
+int main(void)
+{
+    RUN(test_wire_sizes);
+    RUN(test_decode_byte_order);
+    RUN(test_setup_passthrough);
+    RUN(test_ret_init_echoes_request);
+    RUN(test_encode_in_completion);
+    RUN(test_encode_out_error);
+    return 0;
+}
@@ -0,0 +1,299 @@
+#include "wifi_conn.h"
+#include "test_main.h"
+#include <string.h>
+
+/*
+ * wifi_conn against a scripted radio: every wait() consumes the next
+ * scripted outcome and advances a fake clock, sleep_ms() only advances it.
+ */
+
+#define MAX_STEPS 64
+
+typedef struct
+{
+    esp_err_t script[MAX_STEPS];    // wait() outcomes in order; past the end times out
+    int steps;
+    int pos;
+    int64_t now_us;
+    wifi_cache_t link;              // What a successful wait() reports
+    // Observed calls
+    int fast_targets;
+    int scan_targets;
+    int disconnects;
+    int stores;
+    wifi_cache_t stored;
+    wifi_ip_config_t ip_seen[MAX_STEPS];
+    bool dhcp_seen[MAX_STEPS];
+    int ip_calls;
+    uint32_t sleeps[MAX_STEPS];
+    int nsleeps;
+    int retry_calls;
+} fake_radio_t;
+
+static esp_err_t fake_set_target(void *ctx, const uint8_t *bssid, uint8_t channel)
+{
+    fake_radio_t *f = ctx;
+    if (bssid != NULL) {
+        f->fast_targets++;
+    } else {
+        f->scan_targets++;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t fake_set_ip(void *ctx, const wifi_ip_config_t *ip)
+{
+    fake_radio_t *f = ctx;
+    f->dhcp_seen[f->ip_calls] = (ip == NULL);
+    if (ip != NULL) {
+        f->ip_seen[f->ip_calls] = *ip;
+    }
+    f->ip_calls++;
+    return ESP_OK;
+}
+
+static esp_err_t fake_connect(void *ctx)
+{
+    return ESP_OK;
+}
+
+static esp_err_t fake_wait(void *ctx, uint32_t timeout_ms, wifi_cache_t *link)
+{
+    fake_radio_t *f = ctx;
+    esp_err_t err = (f->pos < f->steps) ? f->script[f->pos++] : ESP_ERR_TIMEOUT;
+    switch (err) {
+        case ESP_OK:
+            f->now_us += 300 * 1000;
+            *link = f->link;
+            break;
+        case ESP_FAIL:
+            f->now_us += 100 * 1000;    // Rejected by the AP
+            break;
+        default:
+            f->now_us += (int64_t)timeout_ms * 1000;
+            break;
+    }
+    return err;
+}
+
+static void fake_disconnect(void *ctx)
+{
+    ((fake_radio_t *)ctx)->disconnects++;
+}
+
+static void fake_cache_store(void *ctx, const wifi_cache_t *cache)
+{
+    fake_radio_t *f = ctx;
+    f->stores++;
+    f->stored = *cache;
+}
+
+static int64_t fake_now_us(void *ctx)
+{
+    return ((fake_radio_t *)ctx)->now_us;
+}
+
+static void fake_sleep_ms(void *ctx, uint32_t ms)
+{
+    fake_radio_t *f = ctx;
+    f->sleeps[f->nsleeps++] = ms;
+    f->now_us += (int64_t)ms * 1000;
+}
+
+static fake_radio_t radio;
+static wifi_ops_t ops;
+
+/* Runs before the matching sleep */
+static void count_retry(const wifi_conn_result_t *res, uint32_t delay_ms)
+{
+    radio.retry_calls++;
+    CHECK_EQ(res->retries, radio.retry_calls);
+    CHECK_EQ(radio.nsleeps, radio.retry_calls - 1);
+    CHECK(delay_ms > 0);
+}
+
+static void fake_script(const esp_err_t *steps, int n)
+{
+    memcpy(radio.script, steps, n * sizeof(*steps));
+    radio.steps = n;
+}
+
+static void setup(void)
+{
+    memset(&radio, 0, sizeof(radio));
+    radio.now_us = 5 * 1000 * 1000;
+    const uint8_t bssid[6] = {0x02, 0x11, 0x22, 0x33, 0x44, 0x55};
+    memcpy(radio.link.bssid, bssid, sizeof(bssid));
+    radio.link.channel = 6;
+    radio.link.ip.ip = 0x0a01a8c0;          // 192.168.1.10
+    radio.link.ip.netmask = 0x00ffffff;
+    radio.link.ip.gw = 0x0101a8c0;
+
+    ops = (wifi_ops_t) {
+        .set_target  = fake_set_target,
+        .set_ip      = fake_set_ip,
+        .connect     = fake_connect,
+        .wait        = fake_wait,
+        .disconnect  = fake_disconnect,
+        .cache_store = fake_cache_store,
+        .now_us      = fake_now_us,
+        .sleep_ms    = fake_sleep_ms,
+        .ctx         = &radio,
+    };
+}
+
+static wifi_conn_params_t default_params(void)
+{
+    return (wifi_conn_params_t) {
+        .fast_timeout_ms = 1500,
+        .scan_timeout_ms = 8000,
+        .scan_attempts = 2,
+        .retry_delay_ms = 1000,
+        .retry_max_delay_ms = 8000,
+    };
+}
+
+static void test_fast_hit_keeps_cache(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    wifi_cache_t cache = radio.link;
+    wifi_conn_result_t res;
+    fake_script((esp_err_t[]) {ESP_OK}, 1);
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, count_retry), ESP_OK);
+    CHECK_EQ(res.path, WIFI_PATH_FAST);
+    CHECK_EQ(res.scan_attempts, 0);
+    CHECK_EQ(res.retries, 0);
+    CHECK_EQ(res.total_ms, 300);
+    CHECK_EQ(radio.fast_targets, 1);
+    CHECK_EQ(radio.scan_targets, 0);
+    CHECK_EQ(radio.stores, 0);
+    CHECK(!res.cache_updated);
+    CHECK_EQ(radio.nsleeps, 0);
+}
+
+/* Link lost and the AP came back on another channel: the cached attempt times out */
+static void test_moved_ap_falls_back_to_scan(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    wifi_cache_t cache = radio.link;
+    wifi_conn_result_t res;
+    radio.link.channel = 11;
+    fake_script((esp_err_t[]) {ESP_ERR_TIMEOUT, ESP_OK}, 2);
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, count_retry), ESP_OK);
+    CHECK_EQ(res.path, WIFI_PATH_SCAN);
+    CHECK_EQ(res.fast_err, ESP_ERR_TIMEOUT);
+    CHECK_EQ(res.fast_ms, 1500);
+    CHECK_EQ(res.scan_attempts, 1);
+    CHECK_EQ(res.total_ms, 1800);
+    CHECK_EQ(radio.disconnects, 1);
+    CHECK(res.cache_updated);
+    CHECK_EQ(radio.stores, 1);
+    CHECK_EQ(radio.stored.channel, 11);
+    CHECK_EQ(cache.channel, 11);
+}
+
+static void test_backoff_doubles_and_caps(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    wifi_cache_t cache = {0};
+    wifi_conn_result_t res;
+    esp_err_t steps[11];
+    for (int i = 0; i < 10; i++) {
+        steps[i] = ESP_FAIL;            // Five rounds of two scans
+    }
+    steps[10] = ESP_OK;
+    fake_script(steps, 11);
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, count_retry), ESP_OK);
+    CHECK_EQ(res.path, WIFI_PATH_SCAN);
+    CHECK_EQ(res.retries, 5);
+    CHECK_EQ(radio.retry_calls, 5);
+    CHECK_EQ(radio.nsleeps, 5);
+    const uint32_t expect[] = {1000, 2000, 4000, 8000, 8000};
+    for (int i = 0; i < 5; i++) {
+        CHECK_EQ(radio.sleeps[i], expect[i]);
+    }
+    CHECK_EQ(res.backoff_ms, 23000);
+    CHECK_EQ(res.total_ms, 23000 + 10 * 100 + 300);
+    CHECK_EQ(radio.fast_targets, 0);
+    CHECK_EQ(radio.stores, 1);
+}
+
+static void test_max_rounds_gives_up(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    params.max_rounds = 3;
+    wifi_cache_t cache = radio.link;
+    wifi_conn_result_t res;
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, NULL), ESP_ERR_TIMEOUT);
+    CHECK_EQ(res.path, WIFI_PATH_NONE);
+    CHECK_EQ(res.retries, 3);
+    CHECK_EQ(radio.nsleeps, 2);
+    CHECK_EQ(res.backoff_ms, 3000);
+    CHECK_EQ(radio.fast_targets, 3);
+    CHECK_EQ(radio.scan_targets, 6);
+    CHECK_EQ(radio.stores, 0);
+    CHECK_EQ(cache.channel, 6);             // A failed run never touches the cache
+}
+
+static void test_lease_reuse_only_on_fast_path(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    params.reuse_lease = true;
+    wifi_cache_t cache = radio.link;
+    wifi_conn_result_t res;
+    fake_script((esp_err_t[]) {ESP_FAIL, ESP_OK}, 2);
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, NULL), ESP_OK);
+    CHECK_EQ(radio.ip_calls, 2);
+    CHECK(!radio.dhcp_seen[0]);
+    CHECK_EQ(radio.ip_seen[0].ip, cache.ip.ip);
+    CHECK(radio.dhcp_seen[1]);              // The scan path asks DHCP again
+}
+
+static void test_static_ip_on_both_paths(void)
+{
+    setup();
+    wifi_conn_params_t params = default_params();
+    params.static_ip.ip = 0x3201a8c0;
+    params.reuse_lease = true;
+    wifi_cache_t cache = radio.link;
+    wifi_conn_result_t res;
+    fake_script((esp_err_t[]) {ESP_FAIL, ESP_OK}, 2);
+
+    CHECK_EQ(wifi_conn_until_up(&ops, &params, &cache, &res, NULL), ESP_OK);
+    CHECK_EQ(radio.ip_calls, 2);
+    CHECK_EQ(radio.ip_seen[0].ip, 0x3201a8c0);
+    CHECK_EQ(radio.ip_seen[1].ip, 0x3201a8c0);
+}
+
+static void test_backoff_limits(void)
+{
+    wifi_conn_params_t params = default_params();
+    CHECK_EQ(wifi_conn_backoff_ms(&params, 1), 1000);
+    CHECK_EQ(wifi_conn_backoff_ms(&params, 3), 4000);
+    CHECK_EQ(wifi_conn_backoff_ms(&params, 1000), 8000);
+    params.retry_max_delay_ms = 3000;
+    CHECK_EQ(wifi_conn_backoff_ms(&params, 2), 2000);
+    CHECK_EQ(wifi_conn_backoff_ms(&params, 3), 3000);
+}
+
+int main(void)
+{
+    RUN(test_fast_hit_keeps_cache);
+    RUN(test_moved_ap_falls_back_to_scan);
+    RUN(test_backoff_doubles_and_caps);
+    RUN(test_max_rounds_gives_up);
+    RUN(test_lease_reuse_only_on_fast_path);
+    RUN(test_static_ip_on_both_paths);
+    RUN(test_backoff_limits);
+    return 0;
+}